@@ -0,0 +1,281 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "benchframes.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+enum { TYPE_A = 1, TYPE_CNAME = 5, TYPE_AAAA = 28 };
+
+void push16(Frame &b, unsigned int v)
+{
+    b.push_back(static_cast<unsigned char>(v >> 8));
+    b.push_back(static_cast<unsigned char>(v));
+}
+
+void push32(Frame &b, unsigned int v)
+{
+    push16(b, v >> 16);
+    push16(b, v & 0xffff);
+}
+
+/* Little-endian, for the pcap headers */
+void pushLE32(Frame &b, unsigned int v)
+{
+    for (int i = 0; i < 4; i++)
+        b.push_back(static_cast<unsigned char>(v >> ( 8 * i )));
+}
+
+void pushName(Frame &b, const std::string &name)
+{
+    size_t start = 0;
+    while ( start < name.size() )
+    {
+        size_t dot = name.find('.', start);
+        if ( std::string::npos == dot )
+            dot = name.size();
+        b.push_back(static_cast<unsigned char>(dot - start));
+        b.insert(b.end(), name.begin() + start, name.begin() + dot);
+        start = dot + 1;
+    }
+    b.push_back(0);
+}
+
+void pushPointer(Frame &b, size_t offset)
+{
+    push16(b, 0xc000 | static_cast<unsigned int>(offset));
+}
+
+void pushAddr(Frame &b, unsigned char ver, bool server, unsigned int client)
+{
+    if ( 4 == ver )
+    {
+        push32(b, server ? 0x0a000035 : 0x0a010000 + client);
+        return;
+    }
+    /* 2001:db8::35 and 2001:db8::1:<client> */
+    push32(b, 0x20010db8);
+    push32(b, 0);
+    push32(b, server ? 0 : 1);
+    push32(b, server ? 0x35 : client);
+}
+
+/* Puts msg in UDP, IP and Ethernet headers; checksums are left at 0 */
+void frameMessage(Frame &frame, unsigned char ver, bool fromServer, unsigned int client, 
+        const Frame &msg)
+{
+    unsigned int port = 1024 + client % 60000;
+    unsigned int udpLen = static_cast<unsigned int>(8 + msg.size());
+    frame.clear();
+    push32(frame, 0x02000000);
+    push16(frame, fromServer ? 0x0001 : 0x0035);
+    push32(frame, 0x02000000);
+    push16(frame, fromServer ? 0x0035 : 0x0001);
+    if ( 4 == ver )
+    {
+        push16(frame, 0x0800);
+        push16(frame, 0x4500);
+        push16(frame, 20 + udpLen);
+        push32(frame, 0x4000);                  /* DF, not a fragment */
+        push16(frame, 64 << 8 | 17);
+        push16(frame, 0);
+    }
+    else
+    {
+        push16(frame, 0x86dd);
+        push32(frame, 0x60000000);
+        push16(frame, udpLen);
+        push16(frame, 17 << 8 | 64);
+    }
+    pushAddr(frame, ver, fromServer, client);
+    pushAddr(frame, ver, !fromServer, client);
+    push16(frame, fromServer ? 53 : port);
+    push16(frame, fromServer ? port : 53);
+    push16(frame, udpLen);
+    push16(frame, 0);
+    frame.insert(frame.end(), msg.begin(), msg.end());
+}
+
+void pushHeader(Frame &msg, unsigned short id, unsigned int flags, unsigned int ancount)
+{
+    push16(msg, id);
+    push16(msg, flags);
+    push16(msg, 1);
+    push16(msg, ancount);
+    push32(msg, 0);
+}
+
+void pushRecord(Frame &msg, size_t owner, unsigned int type, unsigned int ttl)
+{
+    pushPointer(msg, owner);
+    push16(msg, type);
+    push16(msg, 1);
+    push32(msg, ttl);
+}
+
+}
+
+std::string benchName(unsigned int i, bool longName)
+{
+    char label[16];
+    std::snprintf(label, sizeof(label), "host%u", i);
+    std::string name(label);
+    if ( longName )
+    {
+        /* Three full labels: 224 bytes on the wire for the largest i */
+        for (int l = 0; l < 3; l++)
+        {
+            name += '.';
+            for (int c = 0; c < 63; c++)
+                name += static_cast<char>('a' + ( i + l * 7 + c ) % 26);
+        }
+        name += ".cdn";
+    }
+    return name + ".example.com";
+}
+
+Frame benchWire(const std::string &name)
+{
+    Frame wire;
+    pushName(wire, name);
+    return wire;
+}
+
+void buildQuery(Frame &frame, unsigned char ver, const std::string &name, 
+        unsigned short id, unsigned int client)
+{
+    Frame msg;
+    pushHeader(msg, id, 0x0100, 0);
+    pushName(msg, name);
+    push16(msg, 4 == ver ? TYPE_A : TYPE_AAAA);
+    push16(msg, 1);
+    frameMessage(frame, ver, false, client, msg);
+}
+
+void buildResponse(Frame &frame, unsigned char ver, const std::string &name, 
+        unsigned short id, unsigned int client, int nCnames)
+{
+    Frame msg;
+    pushHeader(msg, id, 0x8180, nCnames + 1);
+    pushName(msg, name);
+    push16(msg, 4 == ver ? TYPE_A : TYPE_AAAA);
+    push16(msg, 1);
+
+    /* Each CNAME target is one new label in front of a pointer to the
+     * question, and the owner of the next record points at it */
+    size_t owner = 12;
+    for (int c = 0; c < nCnames; c++)
+    {
+        pushRecord(msg, owner, TYPE_CNAME, 300);
+        push16(msg, 5);
+        owner = msg.size();
+        msg.push_back(2);
+        msg.push_back('c');
+        msg.push_back(static_cast<unsigned char>('0' + c % 10));
+        pushPointer(msg, 12);
+    }
+    pushRecord(msg, owner, 4 == ver ? TYPE_A : TYPE_AAAA, 60);
+    if ( 4 == ver )
+    {
+        push16(msg, 4);
+        push32(msg, 0xc6336400 + ( client & 0xff ));
+    }
+    else
+    {
+        push16(msg, 16);
+        push32(msg, 0x20010db8);
+        push32(msg, 0x00640000);
+        push32(msg, 0);
+        push32(msg, client);
+    }
+    frameMessage(frame, ver, true, client, msg);
+}
+
+int writeCapture(const std::string &path, unsigned int nQueries, std::string &errmsg)
+{
+    enum { DISTINCT_NAMES = 4000, SPACING_US = 250, LATENCY_US = 200 };
+
+    Frame out;
+    pushLE32(out, 0xa1b2c3d4);
+    pushLE32(out, 2 | 4 << 16);     /* version 2.4 */
+    pushLE32(out, 0);
+    pushLE32(out, 0);
+    pushLE32(out, 65535);
+    pushLE32(out, 1);               /* Ethernet */
+
+    unsigned int rand = 12345;
+    unsigned long long us = 1700000000ULL * 1000000;
+    Frame frame;
+    for (unsigned int i = 0; i < nQueries; i++, us += SPACING_US)
+    {
+        rand = rand * 1103515245 + 12345;
+        unsigned char ver = 3 == i % 4 ? 6 : 4;
+        unsigned int client = ( rand >> 20 ) & 0xff;
+        std::string name = benchName(( rand >> 8 ) % DISTINCT_NAMES, 9 == i % 10);
+        unsigned short id = static_cast<unsigned short>(rand >> 16);
+        for (int response = 0; response < 2; response++)
+        {
+            if ( response )
+                buildResponse(frame, ver, name, id, client, i % 3);
+            else
+                buildQuery(frame, ver, name, id, client);
+            unsigned long long ts = us + ( response ? LATENCY_US : 0 );
+            pushLE32(out, static_cast<unsigned int>(ts / 1000000));
+            pushLE32(out, static_cast<unsigned int>(ts % 1000000));
+            pushLE32(out, static_cast<unsigned int>(frame.size()));
+            pushLE32(out, static_cast<unsigned int>(frame.size()));
+            out.insert(out.end(), frame.begin(), frame.end());
+        }
+    }
+
+    std::FILE *pFile = std::fopen(path.c_str(), "wb");
+    if ( !pFile )
+    {
+        errmsg = "Error opening file " + path + ": " + std::strerror(errno);
+        return -1;
+    }
+    bool ok = out.size() == std::fwrite(&out[0], 1, out.size(), pFile);
+    if ( std::fclose(pFile) || !ok )
+    {
+        errmsg = "Error writing file " + path + ": " + std::strerror(errno);
+        return -1;
+    }
+    return 0;
+}
+
+}
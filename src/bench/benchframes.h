@@ -0,0 +1,36 @@
+#ifndef __BENCHFRAMES_H
+#define __BENCHFRAMES_H
+
+#include <string>
+#include <vector>
+
+namespace DNSView
+{
+
+/* Synthetic DNS traffic for the benchmarks, Ethernet framed. Everything is
+ * derived from the arguments, so two runs see the same bytes. */
+typedef std::vector<unsigned char> Frame;
+
+/* Name number i: "host<i>.example.com", or a long one of many labels
+ * close to the 255 byte limit */
+std::string benchName(unsigned int i, bool longName);
+/* Uncompressed wire form of a dotted name */
+Frame benchWire(const std::string &name);
+
+/* A query for name from client number client to the resolver, and the
+ * response to it. The response repeats the question, then answers with
+ * nCnames CNAMEs and an A/AAAA record; every owner name and CNAME target
+ * is a compression pointer into the message. */
+void buildQuery(Frame &frame, unsigned char ver, const std::string &name, 
+        unsigned short id, unsigned int client);
+void buildResponse(Frame &frame, unsigned char ver, const std::string &name, 
+        unsigned short id, unsigned int client, int nCnames);
+
+/* Writes a classic pcap of nQueries lookups, each answered a millisecond
+ * later: one in four over IPv6, one in ten for a long name, names drawn
+ * from a few thousand so most repeat. 0 on success. */
+int writeCapture(const std::string &path, unsigned int nQueries, std::string &errmsg);
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <QCoreApplication>
+#include <QDir>
+
+#include <benchmark/benchmark.h>
+
+#include "benchframes.h"
+#include "replaybench.h"
+
+using namespace DNSView;
+
+/* Lookups in the generated capture, 200000 packets */
+enum { CAPTURE_LOOKUPS = 100000 };
+
+int main(int argc, char *argv[])
+{
+    /* The benchmark flags first, Qt gets what is left */
+    benchmark::Initialize(&argc, argv);
+    if ( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    QCoreApplication a(argc, argv);
+
+    /* Replay DNSVIEWER_BENCH_PCAP if set, else a capture made up here */
+    std::string path, errmsg;
+    const char *pEnv = std::getenv("DNSVIEWER_BENCH_PCAP");
+    bool generated = !pEnv || !*pEnv;
+    if ( generated )
+    {
+        path = QDir(QDir::tempPath()).filePath(QString("dnsviewer-bench-%1.pcap")
+                .arg(QCoreApplication::applicationPid())).toLocal8Bit().constData();
+        if ( writeCapture(path, CAPTURE_LOOKUPS, errmsg) )
+        {
+            std::fprintf(stderr, "%s\n", errmsg.c_str());
+            return 1;
+        }
+    }
+    else
+        path = pEnv;
+    setReplayCapture(path);
+
+    benchmark::RunSpecifiedBenchmarks();
+    if ( generated )
+        std::remove(path.c_str());
+    return 0;
+}
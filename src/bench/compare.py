@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Compares two dnsviewer_bench runs and fails on a regression.
+
+Both files are Google Benchmark JSON output:
+
+    $ dnsviewer_bench --benchmark_out=base.json --benchmark_out_format=json
+    $ dnsviewer_bench --benchmark_out=new.json --benchmark_out_format=json
+    $ compare.py base.json new.json
+
+Each benchmark in both runs is compared on CPU time, or wall time for the
+ones measured in it (the replay). With --benchmark_repetitions the means are
+compared. The exit status is 1 if any benchmark got slower by more than the
+threshold, 2 if a file cannot be read.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Times by benchmark name, in nanoseconds"""
+    with open(path) as f:
+        runs = json.load(f)["benchmarks"]
+    # Prefer the mean of repeated runs over the single iterations
+    means = set(r["run_name"] for r in runs if r.get("aggregate_name") == "mean")
+    scale = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+    times = {}
+    for r in runs:
+        name = r.get("run_name", r["name"])
+        if r.get("error_occurred"):
+            continue
+        if name in means:
+            if r.get("aggregate_name") != "mean":
+                continue
+        elif r.get("run_type") == "aggregate":
+            continue
+        metric = "real_time" if name.endswith("/real_time") else "cpu_time"
+        times[name] = r[metric] * scale[r.get("time_unit", "ns")]
+    return times
+
+
+def format_ns(ns):
+    for unit, div in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= div:
+            return "%.3g %s" % (ns / div, unit)
+    return "%.3g ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slower that counts as a regression (10)")
+    parser.add_argument("--filter", default="",
+                        help="only benchmarks whose name contains this")
+    args = parser.parse_args()
+
+    try:
+        old = load(args.baseline)
+        new = load(args.contender)
+    except (OSError, ValueError, KeyError) as e:
+        print("Error reading results: %s" % e, file=sys.stderr)
+        return 2
+
+    names = [n for n in old if n in new and args.filter in n]
+    width = max([len(n) for n in names] + [9])
+    print("%-*s %12s %12s %8s" % (width, "Benchmark", "Baseline", "Contender", "Change"))
+    regressions = []
+    for name in names:
+        change = (new[name] - old[name]) / old[name] * 100 if old[name] else 0.0
+        mark = ""
+        if change > args.threshold:
+            mark = "  REGRESSION"
+            regressions.append(name)
+        print("%-*s %12s %12s %+7.1f%%%s" % (width, name, format_ns(old[name]),
+                                            format_ns(new[name]), change, mark))
+    for name in sorted(set(old) ^ set(new)):
+        if args.filter in name:
+            print("%-*s only in %s" % (width, name,
+                                     args.baseline if name in old else args.contender))
+
+    if regressions:
+        print("\n%d of %d benchmarks slower by more than %g%%"
+              % (len(regressions), len(names), args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
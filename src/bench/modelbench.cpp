@@ -0,0 +1,172 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "benchframes.h"
+#include "nametable.h"
+#include "querymodel.h"
+#include "timefmt.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+enum { BATCH = 1024, DISTINCT_NAMES = 4000 };
+
+/* One capture flush worth of lookups, renumbered for every batch */
+struct Lookups
+{
+    NameTable names;
+    QueryBatch queries;
+    AnswerBatch answers;
+
+    Lookups()
+    {
+        std::vector<unsigned int> ids;
+        for (unsigned int i = 0; i < DISTINCT_NAMES; i++)
+        {
+            Frame wire = benchWire(benchName(i, 9 == i % 10));
+            ids.push_back(names.intern(&wire[0], wire.size()));
+        }
+        unsigned int rand = 12345;
+        for (unsigned int i = 0; i < BATCH; i++)
+        {
+            rand = rand * 1103515245 + 12345;
+            DNSQuery query = DNSQuery();
+            query.ver = 3 == i % 4 ? 6 : 4;
+            query.saddr[0] = 10;
+            query.saddr[3] = static_cast<unsigned char>(rand >> 20);
+            query.daddr[0] = 10;
+            query.daddr[3] = 53;
+            query.qtype = 4 == query.ver ? 1 : 28;
+            query.nameId = ids[( rand >> 8 ) % DISTINCT_NAMES];
+            queries.push_back(query);
+
+            DNSAnswer answer = DNSAnswer();
+            answer.count = 1;
+            answer.status = DNSAnswer::ANSWERED;
+            answer.latencyUs = 200 + ( rand >> 24 );
+            answer.ancount = 1;
+            answer.ttl = 60;
+            answer.kind = DNSAnswer::ADDR4;
+            answer.addr[0] = 198;
+            answers.push_back(answer);
+        }
+    }
+
+    /* Batch number b, 4 batches a second of capture time */
+    void number(unsigned long long b)
+    {
+        for (unsigned int i = 0; i < BATCH; i++)
+        {
+            unsigned long long us = b * 250000 + i * 244;
+            queries[i].seq = answers[i].seq = b * BATCH + i;
+            queries[i].tv_sec = static_cast<unsigned int>(1700000000 + us / 1000000);
+            queries[i].tv_usec = static_cast<unsigned int>(us % 1000000);
+        }
+    }
+};
+
+}
+
+/* Packet timestamps as the Time column renders them; a step under a second
+ * hits the cached date, a step over it formats the whole date every time */
+static void BM_FormatTime(benchmark::State &state)
+{
+    TimeFormatter fmt;
+    char buf[TimeFormatter::TIME_STRLEN];
+    unsigned long long step = state.range(0), us = 1700000000ULL * 1000000;
+    for (auto _ : state)
+    {
+        us += step;
+        benchmark::DoNotOptimize(fmt.format(static_cast<unsigned int>(us / 1000000), 
+                    static_cast<unsigned int>(us % 1000000), buf));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FormatTime)->ArgName("step_us")->Arg(137)->Arg(1000003);
+
+/* Lookups into a fresh list as the window gets them: each batch of
+ * queries, then the answers to it. With max_rows set the oldest rows are
+ * dropped as the ring fills. */
+static void BM_ModelInsert(benchmark::State &state)
+{
+    unsigned long long rows = state.range(0);
+    Lookups lookups;
+    for (auto _ : state)
+    {
+        QueryTableModel *pModel = new QueryTableModel(&lookups.names);
+        pModel->setRetention(static_cast<int>(state.range(1)), 0);
+        for (unsigned long long b = 0; b * BATCH < rows; b++)
+        {
+            lookups.number(b);
+            pModel->append(lookups.queries);
+            pModel->applyAnswers(lookups.answers);
+        }
+        benchmark::DoNotOptimize(pModel->rowCount());
+        state.PauseTiming();
+        delete pModel;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * ( ( rows + BATCH - 1 ) / BATCH * BATCH ));
+}
+BENCHMARK(BM_ModelInsert)->ArgNames({"rows", "max_rows"})
+    ->Args({1000, 0})->Args({1000000, 0})->Args({10000000, 0})->Args({10000000, 1000000})
+    ->Unit(benchmark::kMillisecond);
+
+/* What one repaint of the view asks for: every column of 40 rows */
+static void BM_ModelData(benchmark::State &state)
+{
+    enum { VISIBLE = 40 };
+    Lookups lookups;
+    QueryTableModel model(&lookups.names);
+    model.setRetention(0, 0);
+    for (unsigned long long b = 0; b < 1000; b++)
+    {
+        lookups.number(b);
+        model.append(lookups.queries);
+        model.applyAnswers(lookups.answers);
+    }
+    int top = 0;
+    for (auto _ : state)
+    {
+        top = ( top + VISIBLE ) % ( model.rowCount() - VISIBLE );
+        for (int row = top; row < top + VISIBLE; row++)
+            for (int col = 0; col < QueryTableModel::COL_COUNT; col++)
+                benchmark::DoNotOptimize(model.data(model.index(row, col)));
+    }
+    state.SetItemsProcessed(state.iterations() * VISIBLE);
+}
+BENCHMARK(BM_ModelData);
+
+}
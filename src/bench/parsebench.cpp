@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "benchframes.h"
+#include "dnsparse.h"
+#include "ifcapimpl.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+enum { ETH_HLEN = 14, CNAMES = 3 };
+
+/* Replays the same frames on every dispatch, a second apart so the
+ * transactions of one pass never meet those of the next */
+class FrameCapImpl : public IFCapImpl
+{
+public:
+    FrameCapImpl() : sec_(1700000000) {}
+
+    std::vector<Frame> frames;
+
+protected:
+    int doInit(const std::string&, const std::string&, std::string &errmsg)
+    {
+        return setLinkType(1, errmsg);
+    }
+    std::map<std::string, std::string> doGetDeviceList(std::string&)
+    {
+        return std::map<std::string, std::string>();
+    }
+    int doGetNextPkt(const u_char*&, u_int&, u_int&) { return 0; }
+    int doDispatch(int, PktHandler handler, void *user)
+    {
+        sec_++;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            u_int len = static_cast<u_int>(frames[i].size());
+            handler(user, &frames[i][0], len, len, sec_, static_cast<u_int>(i));
+        }
+        return static_cast<int>(frames.size());
+    }
+    int doGetSelectableFd() { return -1; }
+    void doShutDown() {}
+    void doGetStats(unsigned long long &recv, unsigned long long &drop, 
+            unsigned long long &ifDrop)
+    {
+        recv = drop = ifDrop = 0;
+    }
+
+private:
+    u_int sec_;
+};
+
+void frameArgs(benchmark::internal::Benchmark *pBench)
+{
+    pBench->ArgNames({"ip", "long", "response"});
+    for (int ver = 4; ver <= 6; ver += 2)
+        for (int longName = 0; longName < 2; longName++)
+            for (int response = 0; response < 2; response++)
+                pBench->Args({ver, longName, response});
+}
+
+}
+
+/* dnsparse alone: IP, UDP, the question and every record, names expanded
+ * to wire form the way the decoder does */
+static void BM_ParseMessage(benchmark::State &state)
+{
+    unsigned char ver = static_cast<unsigned char>(state.range(0));
+    std::string name = benchName(7, 0 != state.range(1));
+    Frame frame;
+    if ( state.range(2) )
+        buildResponse(frame, ver, name, 1, 1, CNAMES);
+    else
+        buildQuery(frame, ver, name, 1, 1);
+
+    unsigned char wire[DNS_MAX_NAME];
+    for (auto _ : state)
+    {
+        IPPacket ip;
+        UDPDatagram udp;
+        DNSParser parser;
+        DNSQuestion question;
+        DNSRecord record;
+        size_t len = 0;
+        if ( parseIP(&frame[ETH_HLEN], frame.size() - ETH_HLEN, ip)
+                || parseUDP(ip.payload, ip.payloadLen, udp)
+                || parser.init(udp.payload, udp.payloadLen)
+                || parser.nextQuestion(question)
+                || nameToWire(question.name, wire, len) )
+        {
+            state.SkipWithError("frame did not parse");
+            break;
+        }
+        for (unsigned int r = 0; r < parser.header().ancount; r++)
+        {
+            if ( parser.nextRecord(record) )
+                break;
+            if ( 5 == record.type )
+                nameToWire(record.rdataName, wire, len);
+        }
+        benchmark::DoNotOptimize(len);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_ParseMessage)->Apply(frameArgs);
+
+/* The whole decode on the capture thread: link layer, parsing, name
+ * interning and query/response pairing, over 512 lookups of distinct names */
+static void BM_DecodePackets(benchmark::State &state)
+{
+    enum { LOOKUPS = 512 };
+    unsigned char ver = static_cast<unsigned char>(state.range(0));
+    bool longName = 0 != state.range(1);
+
+    NameTable names;
+    FrameCapImpl impl;
+    impl.setNameTable(&names);
+    std::string errmsg;
+    impl.init("bench", "", errmsg);
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < LOOKUPS; i++)
+    {
+        Frame query, response;
+        std::string name = benchName(i, longName);
+        buildQuery(query, ver, name, static_cast<unsigned short>(i), i);
+        buildResponse(response, ver, name, static_cast<unsigned short>(i), i, i % CNAMES);
+        impl.frames.push_back(query);
+        impl.frames.push_back(response);
+        bytes += query.size() + response.size();
+    }
+
+    QueryBatch queries;
+    AnswerBatch answers;
+    for (auto _ : state)
+    {
+        queries.clear();
+        answers.clear();
+        impl.dispatch(2 * LOOKUPS, queries, answers);
+        benchmark::DoNotOptimize(answers.data());
+    }
+    if ( LOOKUPS != queries.size() || LOOKUPS != answers.size() )
+        state.SkipWithError("lookups were not paired");
+    state.SetItemsProcessed(state.iterations() * 2 * LOOKUPS);
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_DecodePackets)->ArgNames({"ip", "long"})
+    ->Args({4, 0})->Args({4, 1})->Args({6, 0})->Args({6, 1});
+
+}
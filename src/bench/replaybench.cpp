@@ -0,0 +1,172 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "replaybench.h"
+#include "nametable.h"
+#include "pcapthread.h"
+#include "querymodel.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+std::string replayCapture;
+
+/* The window's default retention */
+enum { MAX_ROWS = 1000000 };
+
+}
+
+void setReplayCapture(const std::string &path)
+{
+    replayCapture = path;
+}
+
+ReplaySink::ReplaySink(NameTable *pNames, QObject *parent) :
+    QObject(parent),
+    pNames_(pNames),
+    packets_(0),
+    rows_(0)
+{}
+
+ReplaySink::~ReplaySink()
+{}
+
+bool ReplaySink::replay(const QString &path)
+{
+    /* As the window does before a replay: the old list goes first, it
+     * renders from the name table */
+    spModel_ = QSharedPointer<QueryTableModel>(NULL);
+    pNames_->clear();
+    spModel_ = QSharedPointer<QueryTableModel>(new QueryTableModel(pNames_));
+    spModel_->setRetention(MAX_ROWS, 0);
+    packets_ = rows_ = 0;
+    error_.clear();
+    emit sigStartReplay(path, QString(), false);
+    loop_.exec();
+    return error_.isEmpty();
+}
+
+void ReplaySink::quit()
+{
+    emit sigQuit();
+}
+
+quint64 ReplaySink::packets() const
+{
+    return packets_;
+}
+
+quint64 ReplaySink::rows() const
+{
+    return rows_;
+}
+
+const QString &ReplaySink::error() const
+{
+    return error_;
+}
+
+void ReplaySink::slotDataReady(const QueryBatch &queries)
+{
+    spModel_->append(queries);
+    rows_ += queries.size();
+}
+
+void ReplaySink::slotAnswersReady(const AnswerBatch &answers)
+{
+    spModel_->applyAnswers(answers);
+}
+
+void ReplaySink::slotError(const QString &value)
+{
+    error_ = value;
+    loop_.quit();
+}
+
+void ReplaySink::slotReplayDone(quint64 nPackets, quint64 nBytes, qint64 elapsedMs)
+{
+    (void)nBytes;
+    (void)elapsedMs;
+    packets_ = nPackets;
+    loop_.quit();
+}
+
+/* The whole pipeline on a saved capture read flat out: the mapped file
+ * split over decoding threads, pairing, batches crossing to the main
+ * thread through queued signals and the rows going into the list model.
+ * Wall time, since most of the work is on other threads. */
+static void BM_Replay(benchmark::State &state)
+{
+    NameTable names;
+    PCapThread capture;
+    capture.setNameTable(&names);
+    capture.setThreads(static_cast<int>(state.range(0)));
+    ReplaySink sink(&names);
+    QObject::connect(&capture, SIGNAL(sigDataReady(const QueryBatch&)), 
+            &sink, SLOT(slotDataReady(const QueryBatch&)));
+    QObject::connect(&capture, SIGNAL(sigAnswersReady(const AnswerBatch&)), 
+            &sink, SLOT(slotAnswersReady(const AnswerBatch&)));
+    QObject::connect(&capture, SIGNAL(sigError(const QString&)), 
+            &sink, SLOT(slotError(const QString&)));
+    QObject::connect(&capture, SIGNAL(sigReplayDone(quint64, quint64, qint64)), 
+            &sink, SLOT(slotReplayDone(quint64, quint64, qint64)));
+    QObject::connect(&sink, SIGNAL(sigStartReplay(const QString&, const QString&, bool)), 
+            &capture, SLOT(slotStartReplay(const QString&, const QString&, bool)));
+    QObject::connect(&sink, SIGNAL(sigQuit()), &capture, SLOT(slotQuit()));
+
+    QString path = QString::fromLocal8Bit(replayCapture.c_str());
+    quint64 packets = 0, rows = 0;
+    for (auto _ : state)
+    {
+        if ( !sink.replay(path) )
+        {
+            state.SkipWithError(sink.error().toLocal8Bit().constData());
+            break;
+        }
+        packets += sink.packets();
+        rows += sink.rows();
+    }
+    sink.quit();
+    capture.waitForThread();
+
+    state.counters["packets/s"] = benchmark::Counter(static_cast<double>(packets), 
+            benchmark::Counter::kIsRate);
+    state.counters["rows/s"] = benchmark::Counter(static_cast<double>(rows), 
+            benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Replay)->ArgName("threads")->Arg(1)->Arg(2)->Arg(4)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+}
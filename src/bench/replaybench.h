@@ -0,0 +1,60 @@
+#ifndef __REPLAYBENCH_H
+#define __REPLAYBENCH_H
+
+#include <string>
+#include <QEventLoop>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "dnsquery.h"
+
+namespace DNSView
+{
+
+class NameTable;
+class QueryTableModel;
+
+/* The capture the replay benchmark reads, set by main() before the run */
+void setReplayCapture(const std::string &path);
+
+/* Stands in for the window in the replay benchmark: takes the capture
+ * thread's batches into a list model the way the window does and runs the
+ * event loop until the replay is done */
+class ReplaySink : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReplaySink(NameTable *pNames, QObject *parent = 0);
+    ~ReplaySink();
+
+    /* A fresh list and name table, then the whole file; false on error */
+    bool replay(const QString &path);
+    void quit();
+
+    quint64 packets() const;
+    quint64 rows() const;
+    const QString &error() const;
+
+public slots:
+    void slotDataReady(const QueryBatch &queries);
+    void slotAnswersReady(const AnswerBatch &answers);
+    void slotError(const QString &value);
+    void slotReplayDone(quint64 nPackets, quint64 nBytes, qint64 elapsedMs);
+
+signals:
+    void sigStartReplay(const QString &path, const QString &filter, bool realtime);
+    void sigQuit();
+
+private:
+    NameTable *pNames_;
+    QSharedPointer<QueryTableModel> spModel_;
+    QEventLoop loop_;
+    quint64 packets_, rows_;
+    QString error_;
+};
+
+}
+
+#endif
@@ -0,0 +1,565 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include "binlog.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+const char FILE_MAGIC[4] = { 'D', 'N', 'S', 'L' };
+const char BLOCK_MAGIC[4] = { 'B', 'L', 'K', '1' };
+
+/* Larger blocks are taken as a damaged header rather than allocated */
+enum { MAX_BLOCK = 64 << 20 };
+/* Smallest encoding of a dictionary entry, a query and an answer */
+enum { MIN_NAME_BYTES = 1, MIN_QUERY_BYTES = 13, MIN_ANSWER_BYTES = 8 };
+
+struct CRCTable
+{
+    unsigned int entries[256];
+
+    CRCTable()
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320U ^ ( c >> 1 ) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+/* CRC-32 as in zlib and gzip */
+unsigned int crc32(const unsigned char *p, size_t len)
+{
+    static const CRCTable table;
+    unsigned int c = 0xffffffffU;
+    for (size_t i = 0; i < len; i++)
+        c = table.entries[( c ^ p[i] ) & 0xff] ^ ( c >> 8 );
+    return c ^ 0xffffffffU;
+}
+
+void put16(std::vector<char> &out, unsigned int v)
+{
+    out.push_back(static_cast<char>(v & 0xff));
+    out.push_back(static_cast<char>(( v >> 8 ) & 0xff));
+}
+
+void put32(std::vector<char> &out, unsigned int v)
+{
+    put16(out, v & 0xffff);
+    put16(out, v >> 16);
+}
+
+void put64(std::vector<char> &out, unsigned long long v)
+{
+    put32(out, static_cast<unsigned int>(v));
+    put32(out, static_cast<unsigned int>(v >> 32));
+}
+
+void putVarint(std::vector<char> &out, unsigned long long v)
+{
+    while ( v >= 0x80 )
+    {
+        out.push_back(static_cast<char>(( v & 0x7f ) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+void putDelta(std::vector<char> &out, unsigned long long from, unsigned long long to)
+{
+    long long d = static_cast<long long>(to - from);
+    putVarint(out, ( static_cast<unsigned long long>(d) << 1 ) ^ static_cast<unsigned long long>(d >> 63));
+}
+
+unsigned int get32(const unsigned char *p)
+{
+    return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( static_cast<unsigned int>(p[3]) << 24 );
+}
+
+unsigned long long get64(const unsigned char *p)
+{
+    return get32(p) | ( static_cast<unsigned long long>(get32(p + 4)) << 32 );
+}
+
+/* Bounds-checked reads over a block payload; a short read sets bad and
+ * returns zeros */
+struct Cursor
+{
+    const unsigned char *p, *end;
+    bool bad;
+
+    unsigned int byte()
+    {
+        if ( p >= end )
+        {
+            bad = true;
+            return 0;
+        }
+        return *p++;
+    }
+
+    unsigned long long varint()
+    {
+        unsigned long long v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            unsigned int b = byte();
+            v |= static_cast<unsigned long long>(b & 0x7f) << shift;
+            if ( !( b & 0x80 ) )
+                return v;
+        }
+        bad = true;
+        return 0;
+    }
+
+    unsigned long long delta(unsigned long long from)
+    {
+        unsigned long long z = varint();
+        return from + ( ( z >> 1 ) ^ ( ~( z & 1 ) + 1 ) );
+    }
+
+    void bytes(unsigned char *out, size_t n)
+    {
+        if ( static_cast<size_t>(end - p) < n )
+        {
+            bad = true;
+            std::memset(out, 0, n);
+            return;
+        }
+        std::memcpy(out, p, n);
+        p += n;
+    }
+};
+
+unsigned long long queryUs(const DNSQuery &query)
+{
+    return query.tv_sec * 1000000ULL + query.tv_usec;
+}
+
+}
+
+int seekFile(std::FILE *pFile, unsigned long long offset)
+{
+#if defined(_MSC_VER)
+    return _fseeki64(pFile, static_cast<__int64>(offset), SEEK_SET);
+#elif defined(_WIN32)
+    return fseeko64(pFile, static_cast<off64_t>(offset), SEEK_SET);
+#else
+    return fseeko(pFile, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+BinLogWriter::BinLogWriter(const NameTable &names) :
+    names_(names),
+    nNames_(0),
+    nQueries_(0),
+    nAnswers_(0),
+    dropped_(0),
+    noName_(0),
+    firstUs_(0),
+    prevUs_(0),
+    prevSeq_(0),
+    prevAnswerSeq_(0)
+{}
+
+void BinLogWriter::fileHeader(std::vector<char> &out)
+{
+    out.insert(out.end(), FILE_MAGIC, FILE_MAGIC + 4);
+    put16(out, BINLOG_VERSION);
+    put16(out, 0);
+}
+
+unsigned int BinLogWriter::nameIndex(unsigned int nameId)
+{
+    /* Each name goes into the block's dictionary the first time it is used */
+    unsigned int *pIndex = &noName_;
+    if ( nameId < NameTable::FULL_ID )
+    {
+        if ( nameId >= index_.size() )
+            index_.resize(nameId + 1 + nameId / 2, 0);
+        pIndex = &index_[nameId];
+    }
+    if ( !*pIndex )
+    {
+        unsigned char wire[NameTable::NAME_STRLEN];
+        size_t len = names_.wire(nameId, wire);
+        dict_.push_back(static_cast<char>(len));
+        dict_.insert(dict_.end(), wire, wire + len);
+        *pIndex = ++nNames_;
+        if ( pIndex != &noName_ )
+            used_.push_back(nameId);
+    }
+    return *pIndex - 1;
+}
+
+void BinLogWriter::add(const QueryBatch &queries)
+{
+    for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+    {
+        unsigned long long us = queryUs(*it);
+        if ( !nQueries_++ )
+            firstUs_ = prevUs_ = us;
+        putDelta(queries_, prevUs_, us);
+        putDelta(queries_, prevSeq_, it->seq);
+        prevUs_ = us;
+        prevSeq_ = it->seq;
+        size_t addrLen = 6 == it->ver ? 16 : 4;
+        queries_.push_back(static_cast<char>(it->ver));
+        queries_.insert(queries_.end(), it->saddr, it->saddr + addrLen);
+        queries_.insert(queries_.end(), it->daddr, it->daddr + addrLen);
+        putVarint(queries_, it->qtype);
+        putVarint(queries_, nameIndex(it->nameId));
+    }
+}
+
+void BinLogWriter::add(const AnswerBatch &answers)
+{
+    for (AnswerBatch::const_iterator it = answers.begin(); it != answers.end(); ++it)
+    {
+        nAnswers_++;
+        putDelta(answers_, prevAnswerSeq_, it->seq);
+        prevAnswerSeq_ = it->seq;
+        putVarint(answers_, it->count);
+        answers_.push_back(static_cast<char>(it->status));
+        answers_.push_back(static_cast<char>(it->rcode));
+        putVarint(answers_, it->latencyUs);
+        putVarint(answers_, it->ancount);
+        putVarint(answers_, it->ttl);
+        answers_.push_back(static_cast<char>(it->kind));
+        if ( DNSAnswer::ADDR4 == it->kind || DNSAnswer::ADDR6 == it->kind )
+        {
+            size_t addrLen = DNSAnswer::ADDR6 == it->kind ? 16 : 4;
+            answers_.insert(answers_.end(), it->addr, it->addr + addrLen);
+        }
+        else if ( DNSAnswer::CNAME == it->kind )
+            putVarint(answers_, nameIndex(it->cnameId));
+    }
+}
+
+void BinLogWriter::addDropped(unsigned long long dropped)
+{
+    unsigned long long total = dropped_ + dropped;
+    dropped_ = total > 0xffffffffULL ? 0xffffffffU : static_cast<unsigned int>(total);
+}
+
+size_t BinLogWriter::size() const
+{
+    return dict_.size() + queries_.size() + answers_.size();
+}
+
+bool BinLogWriter::empty() const
+{
+    return !nQueries_ && !nAnswers_ && !dropped_;
+}
+
+void BinLogWriter::finish(std::vector<char> &out)
+{
+    /* The payload is assembled behind the header, then checksummed in place */
+    size_t start = out.size();
+    out.insert(out.end(), BLOCK_MAGIC, BLOCK_MAGIC + 4);
+    put32(out, static_cast<unsigned int>(size()));
+    put32(out, 0);
+    put32(out, nNames_);
+    put32(out, nQueries_);
+    put32(out, nAnswers_);
+    put32(out, dropped_);
+    put64(out, firstUs_);
+    put64(out, prevUs_);
+    out.insert(out.end(), dict_.begin(), dict_.end());
+    out.insert(out.end(), queries_.begin(), queries_.end());
+    out.insert(out.end(), answers_.begin(), answers_.end());
+    unsigned int crc = crc32(reinterpret_cast<const unsigned char*>(&out[start + BINLOG_BLOCK_HEADER]), size());
+    for (int i = 0; i < 4; i++)
+        out[start + 8 + i] = static_cast<char>(( crc >> ( i * 8 ) ) & 0xff);
+
+    for (std::vector<unsigned int>::const_iterator it = used_.begin(); it != used_.end(); ++it)
+        index_[*it] = 0;
+    used_.clear();
+    dict_.clear();
+    queries_.clear();
+    answers_.clear();
+    nNames_ = nQueries_ = nAnswers_ = dropped_ = noName_ = 0;
+    firstUs_ = prevUs_ = prevSeq_ = prevAnswerSeq_ = 0;
+}
+
+BinLogReader::BinLogReader() : pFile_(NULL), offset_(0), badBlocks_(0)
+{
+    std::memset(&block_, 0, sizeof(block_));
+}
+
+BinLogReader::~BinLogReader()
+{
+    close();
+}
+
+bool BinLogReader::probe(const std::string &path)
+{
+    std::FILE *pFile = std::fopen(path.c_str(), "rb");
+    if ( !pFile )
+        return false;
+    char magic[4];
+    bool ok = 4 == std::fread(magic, 1, 4, pFile) && !std::memcmp(magic, FILE_MAGIC, 4);
+    std::fclose(pFile);
+    return ok;
+}
+
+int BinLogReader::open(const std::string &path, std::string &errmsg)
+{
+    close();
+    path_ = path;
+    pFile_ = std::fopen(path.c_str(), "rb");
+    if ( !pFile_ )
+    {
+        errmsg = "Error opening file " + path + ": " + std::strerror(errno);
+        return -1;
+    }
+    unsigned char header[BINLOG_FILE_HEADER];
+    if ( sizeof(header) != std::fread(header, 1, sizeof(header), pFile_) || 
+            std::memcmp(header, FILE_MAGIC, 4) )
+    {
+        errmsg = path + " is not a binary DNS log";
+        close();
+        return -1;
+    }
+    if ( ( header[4] | ( header[5] << 8 ) ) > BINLOG_VERSION )
+    {
+        errmsg = path + " was written by a newer version";
+        close();
+        return -1;
+    }
+    offset_ = BINLOG_FILE_HEADER;
+    badBlocks_ = 0;
+    return 0;
+}
+
+void BinLogReader::close()
+{
+    if ( pFile_ )
+        std::fclose(pFile_);
+    pFile_ = NULL;
+}
+
+int BinLogReader::next(NameTable &names, QueryBatch &queries, AnswerBatch &answers, std::string &errmsg)
+{
+    if ( !pFile_ )
+        return 0;
+    for (;;)
+    {
+        unsigned char header[BINLOG_BLOCK_HEADER];
+        size_t n = std::fread(header, 1, sizeof(header), pFile_);
+        if ( !n )
+            return 0;
+        if ( n < sizeof(header) )
+        {
+            /* Cut off by a crash or a copy in progress */
+            badBlocks_++;
+            return 0;
+        }
+        unsigned int length = get32(header + 4);
+        if ( std::memcmp(header, BLOCK_MAGIC, 4) || length > MAX_BLOCK )
+        {
+            char offset[32];
+            std::snprintf(offset, sizeof(offset), "%llu", offset_);
+            errmsg = path_ + ": damaged block header at offset " + offset;
+            return -1;
+        }
+        block_.offset = offset_;
+        block_.length = BINLOG_BLOCK_HEADER + length;
+        block_.nQueries = get32(header + 16);
+        block_.nAnswers = get32(header + 20);
+        block_.dropped = get32(header + 24);
+        block_.firstUs = get64(header + 28);
+        block_.lastUs = get64(header + 36);
+        offset_ += block_.length;
+
+        buf_.resize(length);
+        if ( length && length != std::fread(&buf_[0], 1, length, pFile_) )
+        {
+            badBlocks_++;
+            return 0;
+        }
+        /* The counts are outside the CRC, so anything sized from them is
+         * bounded by the payload first */
+        unsigned int nNames = get32(header + 12);
+        unsigned long long minLength = 1ULL * nNames * MIN_NAME_BYTES + 
+            1ULL * block_.nQueries * MIN_QUERY_BYTES + 1ULL * block_.nAnswers * MIN_ANSWER_BYTES;
+        size_t nQueries = queries.size(), nAnswers = answers.size();
+        if ( minLength <= length && crc32(length ? &buf_[0] : NULL, length) == get32(header + 8) )
+        {
+            names_.resize(nNames);
+            if ( !decode(names, queries, answers) )
+                return 1;
+        }
+        /* Damaged, but the next header is still where this one says */
+        queries.resize(nQueries);
+        answers.resize(nAnswers);
+        badBlocks_++;
+    }
+}
+
+int BinLogReader::decode(NameTable &names, QueryBatch &queries, AnswerBatch &answers)
+{
+    Cursor in = { buf_.empty() ? NULL : &buf_[0], buf_.empty() ? NULL : &buf_[0] + buf_.size(), false };
+    for (size_t i = 0; i < names_.size(); i++)
+    {
+        unsigned int len = in.byte();
+        unsigned char wire[NameTable::NAME_STRLEN];
+        in.bytes(wire, len);
+        names_[i] = len ? names.intern(wire, len) : static_cast<unsigned int>(NameTable::INVALID_ID);
+    }
+
+    unsigned long long us = block_.firstUs, seq = 0;
+    queries.reserve(queries.size() + block_.nQueries);
+    for (unsigned int i = 0; i < block_.nQueries && !in.bad; i++)
+    {
+        DNSQuery query;
+        std::memset(&query, 0, sizeof(query));
+        us = in.delta(us);
+        seq = in.delta(seq);
+        query.seq = seq;
+        query.tv_sec = static_cast<unsigned int>(us / 1000000);
+        query.tv_usec = static_cast<unsigned int>(us % 1000000);
+        query.ver = static_cast<unsigned char>(in.byte());
+        size_t addrLen = 6 == query.ver ? 16 : 4;
+        in.bytes(query.saddr, addrLen);
+        in.bytes(query.daddr, addrLen);
+        query.qtype = static_cast<unsigned short>(in.varint());
+        unsigned long long name = in.varint();
+        query.nameId = name < names_.size() ? names_[name] : static_cast<unsigned int>(NameTable::INVALID_ID);
+        queries.push_back(query);
+    }
+
+    seq = 0;
+    answers.reserve(answers.size() + block_.nAnswers);
+    for (unsigned int i = 0; i < block_.nAnswers && !in.bad; i++)
+    {
+        DNSAnswer answer;
+        std::memset(&answer, 0, sizeof(answer));
+        answer.seq = seq = in.delta(seq);
+        answer.count = static_cast<unsigned short>(in.varint());
+        answer.status = static_cast<unsigned char>(in.byte());
+        answer.rcode = static_cast<unsigned char>(in.byte());
+        answer.latencyUs = static_cast<unsigned int>(in.varint());
+        answer.ancount = static_cast<unsigned short>(in.varint());
+        answer.ttl = static_cast<unsigned int>(in.varint());
+        answer.kind = static_cast<unsigned char>(in.byte());
+        answer.cnameId = NameTable::INVALID_ID;
+        if ( DNSAnswer::ADDR4 == answer.kind || DNSAnswer::ADDR6 == answer.kind )
+            in.bytes(answer.addr, DNSAnswer::ADDR6 == answer.kind ? 16 : 4);
+        else if ( DNSAnswer::CNAME == answer.kind )
+        {
+            unsigned long long name = in.varint();
+            answer.cnameId = name < names_.size() ? names_[name] : static_cast<unsigned int>(NameTable::INVALID_ID);
+        }
+        answers.push_back(answer);
+    }
+    return in.bad || in.p != in.end ? -1 : 0;
+}
+
+const BinLogBlock &BinLogReader::block() const
+{
+    return block_;
+}
+
+int BinLogReader::seek(unsigned long long offset, std::string &errmsg)
+{
+    if ( !pFile_ || seekFile(pFile_, offset) )
+    {
+        errmsg = "Error seeking in " + path_;
+        return -1;
+    }
+    offset_ = offset;
+    return 0;
+}
+
+unsigned long long BinLogReader::badBlocks() const
+{
+    return badBlocks_;
+}
+
+unsigned long long BinLogReader::bytesRead() const
+{
+    return offset_;
+}
+
+LogSequencer::LogSequencer() : next_(0)
+{}
+
+void LogSequencer::clear()
+{
+    segments_.clear();
+    next_ = 0;
+}
+
+void LogSequencer::apply(QueryBatch &queries, size_t first, AnswerBatch &answers, size_t firstAnswer)
+{
+    for (size_t i = first; i < queries.size(); i++)
+    {
+        /* A new segment wherever the logged seqs stop running on */
+        unsigned long long logged = queries[i].seq;
+        if ( segments_.empty() || logged != segments_.back().logged + segments_.back().count )
+        {
+            Segment segment = { logged, next_, 0 };
+            segments_.push_back(segment);
+            if ( segments_.size() > MAX_SEGMENTS )
+                segments_.pop_front();
+        }
+        segments_.back().count++;
+        queries[i].seq = next_++;
+    }
+
+    size_t out = firstAnswer;
+    for (size_t i = firstAnswer; i < answers.size(); i++)
+    {
+        /* Usually the latest segment; after a restart the newest match wins */
+        DNSAnswer &answer = answers[i];
+        std::deque<Segment>::reverse_iterator seg = segments_.rbegin();
+        while ( seg != segments_.rend() && 
+                ( answer.seq < seg->logged || answer.seq + answer.count > seg->logged + seg->count ) )
+            ++seg;
+        if ( seg == segments_.rend() )
+            continue;
+        answer.seq = seg->seq + ( answer.seq - seg->logged );
+        answers[out++] = answer;
+    }
+    answers.resize(out);
+}
+
+}
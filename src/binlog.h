@@ -0,0 +1,141 @@
+#ifndef __BINLOG_H
+#define __BINLOG_H
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "dnsquery.h"
+
+namespace DNSView
+{
+
+class NameTable;
+
+/* Binary query log (.dnsl), little-endian throughout:
+ *
+ *   file     "DNSL", u16 version, u16 reserved, then blocks
+ *   block    "BLK1", u32 payload length, u32 CRC-32 of the payload,
+ *            u32 names, u32 queries, u32 answers, u32 queries dropped
+ *            before the block, u64 first and last query time (us)
+ *   payload  name dictionary: u8 wire length (0 = no name), wire name
+ *            queries: zigzag varint time delta (us), zigzag varint seq
+ *                     delta, u8 IP version, source and destination
+ *                     address (4 or 16 bytes), varint qtype, varint name
+ *            answers: zigzag varint seq delta, varint count, u8 status,
+ *                     u8 rcode, varint latency, ancount and TTL, u8 kind,
+ *                     then the address for ADDR4/ADDR6 or the varint
+ *                     name for CNAME
+ *
+ * Names are numbered within the block, so each block is read on its own
+ * and a damaged one can be skipped. Deltas start from the block header. */
+enum { BINLOG_VERSION = 1, BINLOG_FILE_HEADER = 8, BINLOG_BLOCK_HEADER = 44 };
+
+/* Time range and size of one block, as read from its header */
+struct BinLogBlock
+{
+    unsigned long long offset;      /* of the block header in the file */
+    unsigned int length;            /* header and payload */
+    unsigned int nQueries, nAnswers, dropped;
+    unsigned long long firstUs, lastUs;
+};
+
+/* fseek() to an absolute offset, past 2 GiB where long is 32 bits */
+int seekFile(std::FILE *pFile, unsigned long long offset);
+
+/* Encodes batches into blocks. Not thread-safe; names are rendered from
+ * the table the ids came from. */
+class BinLogWriter
+{
+public:
+    explicit BinLogWriter(const NameTable &names);
+
+    static void fileHeader(std::vector<char> &out);
+
+    void add(const QueryBatch &queries);
+    void add(const AnswerBatch &answers);
+    void addDropped(unsigned long long dropped);
+    /* Payload bytes so far */
+    size_t size() const;
+    bool empty() const;
+    /* Appends the block to out and starts a new one */
+    void finish(std::vector<char> &out);
+
+private:
+    unsigned int nameIndex(unsigned int nameId);
+
+    const NameTable &names_;
+    std::vector<char> dict_, queries_, answers_;
+    std::vector<unsigned int> index_;   /* NameTable id -> dictionary index + 1 */
+    std::vector<unsigned int> used_;    /* ids to clear from index_ */
+    unsigned int nNames_, nQueries_, nAnswers_, dropped_;
+    unsigned int noName_;               /* dictionary index + 1 for FULL_ID/INVALID_ID */
+    unsigned long long firstUs_, prevUs_, prevSeq_, prevAnswerSeq_;
+};
+
+/* Reads a log block by block, checking each block's CRC */
+class BinLogReader
+{
+public:
+    BinLogReader();
+    ~BinLogReader();
+
+    /* Whether path starts with the binary log magic */
+    static bool probe(const std::string &path);
+
+    int open(const std::string &path, std::string &errmsg);
+    void close();
+    /* Appends the next block's records with the seqs as logged, names
+     * interned into names. 1 for a block, 0 at the end, -1 on error.
+     * Blocks failing their CRC and a truncated last block are skipped. */
+    int next(NameTable &names, QueryBatch &queries, AnswerBatch &answers, std::string &errmsg);
+    /* Header of the block next() returned last */
+    const BinLogBlock &block() const;
+    /* Moves to a block header found earlier through block() */
+    int seek(unsigned long long offset, std::string &errmsg);
+
+    unsigned long long badBlocks() const;
+    unsigned long long bytesRead() const;
+
+private:
+    BinLogReader(const BinLogReader&);
+    BinLogReader &operator=(const BinLogReader&);
+
+    int decode(NameTable &names, QueryBatch &queries, AnswerBatch &answers);
+
+    std::string path_;
+    std::FILE *pFile_;
+    std::vector<unsigned char> buf_;
+    std::vector<unsigned int> names_;   /* dictionary index -> NameTable id */
+    BinLogBlock block_;
+    unsigned long long offset_, badBlocks_;
+};
+
+/* Maps logged seqs onto one consecutive sequence, as QueryTableModel
+ * expects. A log's seqs restart with every capture appended to it and
+ * skip dropped batches; answers to queries not in the log are dropped. */
+class LogSequencer
+{
+public:
+    LogSequencer();
+
+    void clear();
+    /* Renumbers queries and answers from first and firstAnswer on */
+    void apply(QueryBatch &queries, size_t first, AnswerBatch &answers, size_t firstAnswer);
+
+private:
+    struct Segment
+    {
+        unsigned long long logged, seq;
+        unsigned long long count;
+    };
+    enum { MAX_SEGMENTS = 4096 };
+
+    std::deque<Segment> segments_;
+    unsigned long long next_;
+};
+
+}
+
+#endif
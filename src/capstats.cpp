@@ -0,0 +1,258 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "capstats.h"
+#include "dnsparse.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+const char * const FAILURE_NAMES[FAIL_COUNT] = 
+{
+    "none", "snaplen", "link", "truncated", "bad_ip", "fragment", "unsupported", 
+    "not_udp", "not_dns", "not_response", "bad_question", "tcp_no_data", 
+    "tcp_retransmit", "tcp_gap", "fragment_orphan"
+};
+
+void appendf(std::string &out, const char *fmt, unsigned long long value)
+{
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), fmt, value);
+    out.append(buf, n);
+}
+
+void appendRate(std::string &out, const char *key, double value)
+{
+    char buf[64];
+    int n = std::snprintf(buf, sizeof(buf), "\"%s\":%.2f,", key, value);
+    out.append(buf, n);
+}
+
+void appendHistogram(std::string &out, const char *key, const Histogram &hist)
+{
+    out += '"';
+    out += key;
+    appendf(out, "\":{\"count\":%llu", hist.count());
+    appendf(out, ",\"p50\":%llu", hist.quantile(0.5));
+    appendf(out, ",\"p90\":%llu", hist.quantile(0.9));
+    appendf(out, ",\"p99\":%llu", hist.quantile(0.99));
+    appendf(out, ",\"p999\":%llu", hist.quantile(0.999));
+    appendf(out, ",\"max\":%llu}", hist.max());
+}
+
+}
+
+const char *failureName(int reason)
+{
+    return reason >= 0 && reason < FAIL_COUNT ? FAILURE_NAMES[reason] : "unknown";
+}
+
+int failureOf(int parseStatus)
+{
+    switch (parseStatus)
+    {
+    case PARSE_OK: return FAIL_NONE;
+    case PARSE_TRUNCATED: return FAIL_TRUNCATED;
+    case PARSE_FRAGMENT: return FAIL_FRAGMENT;
+    case PARSE_UNSUPPORTED: return FAIL_UNSUPPORTED;
+    default: return FAIL_BAD_IP;
+    }
+}
+
+void CapCounters::reset()
+{
+    kernRecv.set(0);
+    kernDrop.set(0);
+    kernIfDrop.set(0);
+    nPackets.set(0);
+    nBytes.set(0);
+    nParsed.set(0);
+    for (int i = 0; i < FAIL_COUNT; i++)
+        failures[i].set(0);
+}
+
+void CapStats::clear()
+{
+    std::memset(this, 0, sizeof(*this));
+}
+
+void CapStats::load(const CapCounters &counters)
+{
+    kernRecv = counters.kernRecv.get();
+    kernDrop = counters.kernDrop.get();
+    kernIfDrop = counters.kernIfDrop.get();
+    nPackets = counters.nPackets.get();
+    nBytes = counters.nBytes.get();
+    nParsed = counters.nParsed.get();
+    for (int i = 0; i < FAIL_COUNT; i++)
+        failures[i] = counters.failures[i].get();
+}
+
+void CapStats::add(const CapStats &other)
+{
+    kernRecv += other.kernRecv;
+    kernDrop += other.kernDrop;
+    kernIfDrop += other.kernIfDrop;
+    nPackets += other.nPackets;
+    nBytes += other.nBytes;
+    nParsed += other.nParsed;
+    for (int i = 0; i < FAIL_COUNT; i++)
+        failures[i] += other.failures[i];
+}
+
+unsigned long long CapStats::nFailures() const
+{
+    unsigned long long n = 0;
+    for (int i = FAIL_NONE + 1; i < FAIL_COUNT; i++)
+        n += failures[i];
+    return n;
+}
+
+Histogram::Histogram()
+{
+    clear();
+}
+
+void Histogram::clear()
+{
+    std::memset(buckets_, 0, sizeof(buckets_));
+    count_ = max_ = 0;
+}
+
+unsigned int Histogram::bucketOf(unsigned long long value)
+{
+    /* Bucket shift * SUB + (value >> shift) keeps SUB_BITS + 1 significant
+     * bits, and the buckets of one power of two follow those of the last */
+    if ( value < SUB )
+        return static_cast<unsigned int>(value);
+    if ( value >> MAX_BITS )
+        value = ( 1ULL << MAX_BITS ) - 1;
+    unsigned int msb = SUB_BITS;
+    while ( value >> ( msb + 1 ) )
+        msb++;
+    unsigned int shift = msb - SUB_BITS;
+    return shift * SUB + static_cast<unsigned int>(value >> shift);
+}
+
+unsigned long long Histogram::bucketTop(unsigned int bucket)
+{
+    if ( bucket < 2 * SUB )
+        return bucket;
+    unsigned int shift = bucket / SUB - 1;
+    unsigned long long mantissa = bucket - shift * SUB;
+    return ( ( mantissa + 1 ) << shift ) - 1;
+}
+
+void Histogram::record(unsigned long long value)
+{
+    ++buckets_[bucketOf(value)];
+    ++count_;
+    if ( value > max_ )
+        max_ = value;
+}
+
+unsigned long long Histogram::quantile(double q) const
+{
+    if ( !count_ )
+        return 0;
+    unsigned long long rank = static_cast<unsigned long long>(q * count_ + 0.5);
+    if ( rank < 1 )
+        rank = 1;
+    unsigned long long seen = 0;
+    for (unsigned int i = 0; i < BUCKETS; i++)
+    {
+        if ( ( seen += buckets_[i] ) >= rank )
+            return bucketTop(i) < max_ ? bucketTop(i) : max_;
+    }
+    return max_;
+}
+
+void formatStatsJson(const StatsSnapshot &snap, const Histogram &display, 
+        const Histogram &resolver, std::string &out)
+{
+    const CapStats &totals = snap.totals;
+    out = "{";
+    appendRate(out, "uptime_s", snap.seconds);
+    appendf(out, "\"kernel\":{\"received\":%llu", totals.kernRecv);
+    appendf(out, ",\"dropped\":%llu", totals.kernDrop);
+    appendf(out, ",\"if_dropped\":%llu},", totals.kernIfDrop);
+    appendf(out, "\"packets\":%llu,", totals.nPackets);
+    appendf(out, "\"bytes\":%llu,", totals.nBytes);
+    appendf(out, "\"dns_messages\":%llu,", totals.nParsed);
+    appendRate(out, "packets_per_s", snap.pktRate);
+    appendRate(out, "dns_per_s", snap.dnsRate);
+    appendRate(out, "kbps", snap.kBps);
+    appendf(out, "\"queue_depth\":%llu,", snap.queueDepth);
+    out += "\"parse_failures\":{";
+    for (int i = FAIL_NONE + 1; i < FAIL_COUNT; i++)
+    {
+        out += '"';
+        out += FAILURE_NAMES[i];
+        appendf(out, i + 1 < FAIL_COUNT ? "\":%llu," : "\":%llu},", totals.failures[i]);
+    }
+    out += "\"latency_us\":{";
+    appendHistogram(out, "capture_to_display", display);
+    out += ',';
+    appendHistogram(out, "resolver", resolver);
+    out += "}}\n";
+}
+
+int writeStatsJson(const std::string &path, const StatsSnapshot &snap, 
+        const Histogram &display, const Histogram &resolver, std::string &errmsg)
+{
+    std::string json;
+    formatStatsJson(snap, display, resolver, json);
+    std::string tmp = path + ".tmp";
+    std::FILE *pFile = std::fopen(tmp.c_str(), "wb");
+    bool ok = pFile && json.size() == std::fwrite(json.data(), 1, json.size(), pFile);
+    if ( pFile && std::fclose(pFile) )
+        ok = false;
+#ifdef _WIN32
+    /* rename() only replaces an existing file on POSIX */
+    if ( ok )
+        std::remove(path.c_str());
+#endif
+    if ( !ok || std::rename(tmp.c_str(), path.c_str()) )
+    {
+        errmsg = "Error writing statistics to " + path + ": " + std::strerror(errno);
+        std::remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,133 @@
+#ifndef __CAPSTATS_H
+#define __CAPSTATS_H
+
+#include <atomic>
+#include <string>
+
+namespace DNSView
+{
+
+/* Why a packet handed to userspace was not decoded as a DNS message */
+enum ParseFailure
+{
+    FAIL_NONE = 0,
+    FAIL_SNAPLEN,           /* cut short by the snap length */
+    FAIL_LINK,              /* too short for the link header, or not IP */
+    FAIL_TRUNCATED,         /* an IP, UDP or DNS header runs off the end */
+    FAIL_BAD_IP,            /* unknown version or bad header length */
+    FAIL_FRAGMENT,          /* a DNS datagram not reassembled: lost, late or malformed */
+    FAIL_UNSUPPORTED,       /* transport we cannot see into (ESP, ...) */
+    FAIL_NOT_UDP,           /* neither UDP nor TCP */
+    FAIL_NOT_DNS,           /* neither port is 53 */
+    FAIL_NOT_RESPONSE,      /* from port 53 without the QR bit */
+    FAIL_QUESTION,          /* a query whose first question does not parse */
+    FAIL_TCP_NO_DATA,       /* TCP handshake, teardown or bare ACK */
+    FAIL_TCP_RETRANSMIT,    /* TCP data seen before */
+    FAIL_TCP_GAP,           /* TCP data after a segment that was missed */
+    FAIL_FRAGMENT_ORPHAN,   /* a datagram whose first fragment never came, mostly not DNS */
+    FAIL_COUNT
+};
+
+/* Short lower case name, as used in the dump */
+const char *failureName(int reason);
+/* The failure for a ParseStatus from dnsparse */
+int failureOf(int parseStatus);
+
+/* Written by one thread only, so adding is a plain load and store; any
+ * thread may read it */
+class Counter
+{
+public:
+    Counter() : value_(0) {}
+
+    void add(unsigned long long n)
+    {
+        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void set(unsigned long long n) { value_.store(n, std::memory_order_relaxed); }
+    unsigned long long get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<unsigned long long> value_;
+};
+
+/* The live counters of one capture. Padded rather than aligned to keep
+ * them off their neighbours' cache lines, plain new cannot over-align in C++11 */
+struct CapCounters
+{
+    enum { CACHE_LINE = 64 };
+
+    char padBefore[CACHE_LINE];
+    Counter kernRecv, kernDrop, kernIfDrop;
+    Counter nPackets, nBytes, nParsed;
+    Counter failures[FAIL_COUNT];
+    char padAfter[CACHE_LINE];
+
+    void reset();
+};
+
+/* A copy of the counters, for adding up and display */
+struct CapStats
+{
+    unsigned long long kernRecv;    /* accepted by the kernel filter */
+    unsigned long long kernDrop;    /* dropped for lack of buffer space */
+    unsigned long long kernIfDrop;  /* dropped by the interface or driver */
+    unsigned long long nPackets;    /* handed to userspace */
+    unsigned long long nBytes;
+    unsigned long long nParsed;     /* decoded as DNS messages */
+    unsigned long long failures[FAIL_COUNT];
+
+    void clear();
+    void load(const CapCounters &counters);
+    void add(const CapStats &other);
+    unsigned long long nFailures() const;
+};
+
+/* Log-linear histogram in the HDR style: values below 2 * SUB are exact,
+ * above that every power of two is split into SUB buckets, so any value is
+ * off by at most 1/SUB. Not thread-safe. */
+class Histogram
+{
+public:
+    enum { SUB_BITS = 4, SUB = 1 << SUB_BITS, MAX_BITS = 40 };
+
+    Histogram();
+
+    void record(unsigned long long value);
+    void clear();
+    unsigned long long count() const { return count_; }
+    unsigned long long max() const { return max_; }
+    /* Highest value of the bucket holding the q quantile, 0 <= q <= 1 */
+    unsigned long long quantile(double q) const;
+
+private:
+    enum { BUCKETS = ( MAX_BITS - SUB_BITS + 2 ) * SUB };
+
+    static unsigned int bucketOf(unsigned long long value);
+    static unsigned long long bucketTop(unsigned int bucket);
+
+    unsigned long long buckets_[BUCKETS];
+    unsigned long long count_, max_;
+};
+
+/* What the capture thread reports twice a second */
+struct StatsSnapshot
+{
+    CapStats totals;
+    double seconds;                 /* since the capture started */
+    double pktRate, dnsRate;        /* per second over the last interval */
+    double kBps;
+    unsigned long long queueDepth;  /* worker batches not yet drained */
+};
+
+/* One JSON object with the snapshot and the latency percentiles (microseconds) */
+void formatStatsJson(const StatsSnapshot &snap, const Histogram &display, 
+        const Histogram &resolver, std::string &out);
+/* The same, written to path through a temporary file renamed over it, so a
+ * reader never sees half a file */
+int writeStatsJson(const std::string &path, const StatsSnapshot &snap, 
+        const Histogram &display, const Histogram &resolver, std::string &errmsg);
+
+}
+
+#endif
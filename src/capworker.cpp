@@ -0,0 +1,195 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+
+#ifndef _WIN32
+#   include <poll.h>
+#endif
+
+#include "capworker.h"
+#include "pcapimpl.h"
+#include "tpacketimpl.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+/* Stats twice a second */
+const int STATS_MS = 500;
+
+unsigned long long wallClockUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+CaptureWorker::CaptureWorker(int id, MPSCQueue<CaptureBatch> *pOut)
+    : id_(id), pOut_(pOut), pCur_(NULL), batchSize_(1024), stop_(false), failed_(false)
+{}
+
+CaptureWorker::~CaptureWorker()
+{
+    stop();
+    if ( pImpl_ )
+        pImpl_->shutDown();
+    delete pCur_;
+    for (CaptureBatch *pBatch; ( pBatch = free_.pop() ); )
+        delete pBatch;
+}
+
+int CaptureWorker::init(const std::string &dev, const std::string &filter, unsigned short fanoutGroup, 
+        const RingConfig &ring, NameTable *pNames, unsigned int timeoutMs, int batchSize, 
+        std::string &errmsg)
+{
+    if ( ring.blockCount )
+    {
+        TPacketImpl *pRing = new TPacketImpl;
+        pRing->setRing(ring.blockSize, ring.blockCount, ring.retireMs);
+        pRing->setFanout(fanoutGroup);
+        pImpl_.reset(pRing);
+    }
+    else
+    {
+        PCapImpl *pPCap = new PCapImpl;
+        pPCap->setFanout(fanoutGroup);
+        pImpl_.reset(pPCap);
+    }
+    pImpl_->setNameTable(pNames);
+    pImpl_->setTimeout(timeoutMs);
+    batchSize_ = batchSize;
+    return pImpl_->init(dev, filter, errmsg);
+}
+
+void CaptureWorker::start()
+{
+    stop_ = false;
+    thread_ = std::thread(&CaptureWorker::run, this);
+}
+
+void CaptureWorker::stop()
+{
+    stop_ = true;
+    if ( thread_.joinable() )
+        thread_.join();
+}
+
+void CaptureWorker::recycle(CaptureBatch *pBatch)
+{
+    pBatch->queries.clear();
+    pBatch->answers.clear();
+    free_.push(pBatch);
+}
+
+bool CaptureWorker::failed(std::string &errmsg) const
+{
+    if ( !failed_.load(std::memory_order_acquire) )
+        return false;
+    errmsg = error_;
+    return true;
+}
+
+void CaptureWorker::getStats(CapStats &stats) const
+{
+    pImpl_->getStats(stats);
+}
+
+unsigned long long CaptureWorker::published() const
+{
+    return nPublished_.get();
+}
+
+void CaptureWorker::run()
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point lastFlush = Clock::now(), lastStats = lastFlush;
+    int fd = pImpl_->getSelectableFd();
+    while ( !stop_.load(std::memory_order_relaxed) )
+    {
+        if ( !pCur_ && !( pCur_ = free_.pop() ) )
+            pCur_ = new CaptureBatch;
+
+        /* Sleep until there is something to read, but wake for the flush;
+         * without a selectable fd the read timeout does the waiting */
+#ifndef _WIN32
+        if ( -1 != fd )
+        {
+            pollfd pfd = { fd, POLLIN, 0 };
+            poll(&pfd, 1, FLUSH_MS);
+        }
+#endif
+        int ret;
+        do
+        {
+            ret = pImpl_->dispatch(batchSize_, pCur_->queries, pCur_->answers);
+        } while ( 0 < ret && pCur_->queries.size() + pCur_->answers.size() < FLUSH_COUNT );
+        if ( 0 > ret )
+        {
+            error_ = "Error reading from interface";
+            failed_.store(true, std::memory_order_release);
+            break;
+        }
+
+        Clock::time_point now = Clock::now();
+        if ( pCur_->queries.size() + pCur_->answers.size() >= FLUSH_COUNT || 
+                now - lastFlush >= std::chrono::milliseconds(FLUSH_MS) )
+        {
+            /* Flag queries that timed out even if no packets are arriving */
+            pImpl_->expire(wallClockUs(), pCur_->answers);
+            publish();
+            lastFlush = now;
+        }
+        if ( now - lastStats >= std::chrono::milliseconds(STATS_MS) )
+        {
+            /* pcap_stats belongs to this thread */
+            pImpl_->updateKernelStats();
+            lastStats = now;
+        }
+    }
+    publish();
+    pImpl_->updateKernelStats();
+}
+
+void CaptureWorker::publish()
+{
+    if ( !pCur_ || ( pCur_->queries.empty() && pCur_->answers.empty() ) )
+        return;
+    pCur_->worker = id_;
+    pCur_->floorSeq = pImpl_->oldestPendingSeq();
+    nPublished_.add(1);
+    pOut_->push(pCur_);
+    pCur_ = NULL;
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef __CAPWORKER_H
+#define __CAPWORKER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "dnsquery.h"
+#include "mpscqueue.h"
+#include "ifcapimpl.h"
+
+namespace DNSView
+{
+
+class NameTable;
+
+/* TPACKET_V3 ring geometry for a live capture, no blocks means libpcap */
+struct RingConfig
+{
+    unsigned int blockSize;
+    unsigned int blockCount;
+    unsigned int retireMs;
+};
+
+/* Results are published when this many are pending or this old, by the
+ * capture workers and by the replay loop alike */
+enum { FLUSH_COUNT = 4096, FLUSH_MS = 20 };
+
+/* What a capture worker hands to the consumer. Sequence numbers are the
+ * worker's own; answers can only refer to seqs from floorSeq on. */
+struct CaptureBatch : MPSCNode
+{
+    int worker;
+    QueryBatch queries;
+    AnswerBatch answers;
+    unsigned long long floorSeq;
+};
+
+/* One live capture (an interface, or one member of a fanout group) decoded
+ * on its own thread. Batches go out through a shared MPSC queue, and come
+ * back through recycle() so their buffers are reused. */
+class CaptureWorker
+{
+public:
+    CaptureWorker(int id, MPSCQueue<CaptureBatch> *pOut);
+    ~CaptureWorker();
+
+    /* Opens the capture on the calling thread, so errors show up at once */
+    int init(const std::string &dev, const std::string &filter, unsigned short fanoutGroup, 
+            const RingConfig &ring, NameTable *pNames, unsigned int timeoutMs, int batchSize, 
+            std::string &errmsg);
+    void start();
+    /* Joins the thread, the last batch is published before it exits */
+    void stop();
+    void recycle(CaptureBatch *pBatch);
+
+    bool failed(std::string &errmsg) const;
+    /* Kernel counters are refreshed by the worker about twice a second */
+    void getStats(CapStats &stats) const;
+    unsigned long long published() const;
+
+private:
+    CaptureWorker(const CaptureWorker&);
+    CaptureWorker &operator=(const CaptureWorker&);
+
+    void run();
+    void publish();
+
+    int id_;
+    MPSCQueue<CaptureBatch> *pOut_;
+    MPSCQueue<CaptureBatch> free_;
+    CaptureBatch *pCur_;
+    std::unique_ptr<IFCapImpl> pImpl_;
+    int batchSize_;
+    std::thread thread_;
+    std::atomic<bool> stop_, failed_;
+    std::string error_;         /* set before failed_ */
+    Counter nPublished_;
+};
+
+}
+
+#endif
@@ -0,0 +1,387 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+
+#include "dnsparse.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+inline unsigned short get16(const unsigned char *p)
+{
+    return static_cast<unsigned short>(( p[0] << 8 ) | p[1]);
+}
+
+/* Walks the name at off. pEnd gets the offset just past the name where it
+ * appears (past the first pointer if compressed), wire the flattened form.
+ * Pointers must point strictly before the previous jump, so a chain of them
+ * always terminates. */
+int walkName(const unsigned char *msg, size_t len, size_t off, size_t *pEnd, 
+        unsigned char *wire, size_t *pWireLen)
+{
+    size_t wireLen = 0, end = 0, limit = off;
+    bool jumped = false;
+    for (;;)
+    {
+        if ( off >= len )
+            return PARSE_TRUNCATED;
+        unsigned int c = msg[off];
+        if ( ( c & 0xc0 ) == 0xc0 )
+        {
+            if ( off + 1 >= len )
+                return PARSE_TRUNCATED;
+            size_t target = ( ( c & 0x3f ) << 8 ) | msg[off + 1];
+            if ( !jumped )
+            {
+                end = off + 2;
+                jumped = true;
+            }
+            if ( target >= limit )
+                return PARSE_NAME_LOOP;
+            limit = off = target;
+            continue;
+        }
+        if ( c & 0xc0 )
+            return PARSE_BAD_NAME;
+        if ( wireLen + c + 1 > DNS_MAX_NAME )
+            return PARSE_BAD_NAME;
+        if ( off + c + 1 > len )
+            return PARSE_TRUNCATED;
+        if ( wire )
+            std::memcpy(wire + wireLen, msg + off, c + 1);
+        wireLen += c + 1;
+        off += c + 1;
+        if ( !c )
+            break;
+    }
+    if ( pEnd )
+        *pEnd = jumped ? end : off;
+    if ( pWireLen )
+        *pWireLen = wireLen;
+    return PARSE_OK;
+}
+
+}
+
+const char *parseStatusName(int status)
+{
+    switch (status)
+    {
+    case PARSE_OK: return "ok";
+    case PARSE_TRUNCATED: return "truncated";
+    case PARSE_BAD_IP: return "bad_ip";
+    case PARSE_FRAGMENT: return "fragment";
+    case PARSE_UNSUPPORTED: return "unsupported";
+    case PARSE_BAD_NAME: return "bad_name";
+    case PARSE_NAME_LOOP: return "name_loop";
+    default: return "unknown";
+    }
+}
+
+int parseIP(const unsigned char *data, size_t len, IPPacket &ip)
+{
+    if ( len < 1 )
+        return PARSE_TRUNCATED;
+    ip.ver = data[0] >> 4;
+    if ( ip.ver == 4 )
+    {
+        if ( len < 20 )
+            return PARSE_TRUNCATED;
+        size_t ihl = ( data[0] & 0xf ) * 4, tlen = get16(data + 2);
+        if ( ihl < 20 || tlen < ihl )
+            return PARSE_BAD_IP;
+        if ( tlen > len )
+            return PARSE_TRUNCATED;
+        ip.proto = data[9];
+        ip.saddr = data + 12;
+        ip.daddr = data + 16;
+        /* tlen, not len: Ethernet pads short frames */
+        ip.payload = data + ihl;
+        ip.payloadLen = tlen - ihl;
+        unsigned short frag = get16(data + 6);
+        if ( !( frag & 0x3fff ) )
+            return PARSE_OK;
+        ip.fragId = get16(data + 4);
+        ip.fragOffset = static_cast<unsigned short>(( frag & 0x1fff ) * 8);
+        ip.moreFragments = 0 != ( frag & 0x2000 );
+        return PARSE_FRAGMENT;
+    }
+    if ( ip.ver != 6 )
+        return PARSE_BAD_IP;
+
+    if ( len < 40 )
+        return PARSE_TRUNCATED;
+    size_t plen = get16(data + 4);
+    if ( 40 + plen > len )
+        return PARSE_TRUNCATED;
+    ip.saddr = data + 8;
+    ip.daddr = data + 24;
+    const unsigned char *p = data + 40, *end = p + plen;
+    unsigned int next = data[6];
+
+    /* Skip the extension headers we can see through */
+    for (;;)
+    {
+        size_t extLen;
+        switch (next)
+        {
+        case 0:     /* hop-by-hop */
+        case 43:    /* routing */
+        case 60:    /* destination options */
+            if ( end - p < 8 )
+                return PARSE_TRUNCATED;
+            extLen = ( p[1] + 1 ) * 8;
+            break;
+        case 44:    /* fragment, the headers after it are in the first one */
+            if ( end - p < 8 )
+                return PARSE_TRUNCATED;
+            ip.proto = p[0];
+            ip.payload = p + 8;
+            ip.payloadLen = end - p - 8;
+            ip.fragId = static_cast<unsigned int>(get16(p + 4)) << 16 | get16(p + 6);
+            ip.fragOffset = get16(p + 2) & 0xfff8;
+            ip.moreFragments = 0 != ( get16(p + 2) & 1 );
+            /* An atomic fragment (RFC 6946) is the whole datagram */
+            if ( ip.fragOffset || ip.moreFragments )
+                return PARSE_FRAGMENT;
+            extLen = 8;
+            break;
+        case 51:    /* authentication header */
+            if ( end - p < 8 )
+                return PARSE_TRUNCATED;
+            extLen = ( p[1] + 2 ) * 4;
+            break;
+        case 50:    /* ESP, the rest is encrypted */
+            return PARSE_UNSUPPORTED;
+        default:
+            ip.proto = next;
+            ip.payload = p;
+            ip.payloadLen = end - p;
+            return PARSE_OK;
+        }
+        if ( static_cast<size_t>(end - p) < extLen )
+            return PARSE_TRUNCATED;
+        next = p[0];
+        p += extLen;
+    }
+}
+
+int parseUDP(const unsigned char *data, size_t len, UDPDatagram &udp)
+{
+    if ( len < 8 )
+        return PARSE_TRUNCATED;
+    size_t ulen = get16(data + 4);
+    if ( ulen < 8 )
+        return PARSE_BAD_IP;
+    if ( ulen > len )
+        return PARSE_TRUNCATED;
+    udp.sport = get16(data);
+    udp.dport = get16(data + 2);
+    udp.payload = data + 8;
+    udp.payloadLen = ulen - 8;
+    return PARSE_OK;
+}
+
+int parseTCP(const unsigned char *data, size_t len, TCPSegment &tcp)
+{
+    if ( len < 20 )
+        return PARSE_TRUNCATED;
+    size_t off = ( data[12] >> 4 ) * 4;
+    if ( off < 20 )
+        return PARSE_BAD_IP;
+    if ( off > len )
+        return PARSE_TRUNCATED;
+    tcp.sport = get16(data);
+    tcp.dport = get16(data + 2);
+    tcp.seq = static_cast<unsigned int>(get16(data + 4)) << 16 | get16(data + 6);
+    tcp.flags = data[13];
+    tcp.payload = data + off;
+    tcp.payloadLen = len - off;
+    return PARSE_OK;
+}
+
+int nameToWire(const DNSName &name, unsigned char *buf, size_t &len)
+{
+    return walkName(name.msg, name.msgLen, name.offset, NULL, buf, &len);
+}
+
+int nameToText(const DNSName &name, char *buf, size_t &len)
+{
+    unsigned char wire[DNS_MAX_NAME];
+    size_t wireLen;
+    int ret = walkName(name.msg, name.msgLen, name.offset, NULL, wire, &wireLen);
+    if ( ret )
+        return ret;
+    len = 0;
+    for (size_t off = 0; wire[off]; off += wire[off] + 1)
+    {
+        if ( len )
+            buf[len++] = '.';
+        std::memcpy(buf + len, wire + off + 1, wire[off]);
+        len += wire[off];
+    }
+    if ( !len )
+        buf[len++] = '.';
+    buf[len] = '\0';
+    return PARSE_OK;
+}
+
+DNSParser::DNSParser() : msg_(NULL), len_(0), off_(0)
+{
+    std::memset(&hdr_, 0, sizeof(hdr_));
+}
+
+int DNSParser::init(const unsigned char *msg, size_t len)
+{
+    msg_ = msg;
+    len_ = len;
+    off_ = 12;
+    if ( len < 12 )
+        return PARSE_TRUNCATED;
+    hdr_.id = get16(msg);
+    hdr_.flags = get16(msg + 2);
+    hdr_.qdcount = get16(msg + 4);
+    hdr_.ancount = get16(msg + 6);
+    hdr_.nscount = get16(msg + 8);
+    hdr_.arcount = get16(msg + 10);
+    return PARSE_OK;
+}
+
+const DNSHeader &DNSParser::header() const
+{
+    return hdr_;
+}
+
+int DNSParser::skipName(DNSName &name)
+{
+    name.msg = msg_;
+    name.msgLen = len_;
+    name.offset = off_;
+    return walkName(msg_, len_, off_, &off_, NULL, NULL);
+}
+
+int DNSParser::nextQuestion(DNSQuestion &question)
+{
+    int ret = skipName(question.name);
+    if ( ret )
+        return ret;
+    if ( off_ + 4 > len_ )
+        return PARSE_TRUNCATED;
+    question.qtype = get16(msg_ + off_);
+    question.qclass = get16(msg_ + off_ + 2);
+    off_ += 4;
+    return PARSE_OK;
+}
+
+int DNSParser::nextRecord(DNSRecord &record)
+{
+    int ret = skipName(record.name);
+    if ( ret )
+        return ret;
+    if ( off_ + 10 > len_ )
+        return PARSE_TRUNCATED;
+    const unsigned char *p = msg_ + off_;
+    record.type = get16(p);
+    record.rclass = get16(p + 2);
+    record.ttl = ( static_cast<unsigned int>(get16(p + 4)) << 16 ) | get16(p + 6);
+    record.rdlen = get16(p + 8);
+    off_ += 10;
+    if ( off_ + record.rdlen > len_ )
+        return PARSE_TRUNCATED;
+    record.rdata = msg_ + off_;
+    record.rdataName.msg = msg_;
+    record.rdataName.msgLen = len_;
+    record.rdataName.offset = off_;
+    off_ += record.rdlen;
+    return PARSE_OK;
+}
+
+const char *qtypeName(unsigned short qtype)
+{
+    switch (qtype)
+    {
+    case 1: return "A";
+    case 2: return "NS";
+    case 5: return "CNAME";
+    case 6: return "SOA";
+    case 12: return "PTR";
+    case 15: return "MX";
+    case 16: return "TXT";
+    case 28: return "AAAA";
+    case 33: return "SRV";
+    case 35: return "NAPTR";
+    case 43: return "DS";
+    case 46: return "RRSIG";
+    case 48: return "DNSKEY";
+    case 64: return "SVCB";
+    case 65: return "HTTPS";
+    case 252: return "AXFR";
+    case 255: return "ANY";
+    default: return NULL;
+    }
+}
+
+const char *rcodeName(unsigned int rcode)
+{
+    switch (rcode)
+    {
+    case 0: return "NOERROR";
+    case 1: return "FORMERR";
+    case 2: return "SERVFAIL";
+    case 3: return "NXDOMAIN";
+    case 4: return "NOTIMP";
+    case 5: return "REFUSED";
+    case 6: return "YXDOMAIN";
+    case 7: return "YXRRSET";
+    case 8: return "NXRRSET";
+    case 9: return "NOTAUTH";
+    case 10: return "NOTZONE";
+    default: return NULL;
+    }
+}
+
+const char *qclassName(unsigned short qclass)
+{
+    switch (qclass)
+    {
+    case 1: return "IN";
+    case 3: return "CH";
+    case 4: return "HS";
+    case 254: return "NONE";
+    case 255: return "ANY";
+    default: return NULL;
+    }
+}
+
+}
@@ -0,0 +1,149 @@
+#ifndef __DNSPARSE_H
+#define __DNSPARSE_H
+
+#include <cstddef>
+
+/* Bounds-checked IP/UDP/DNS decoding. Nothing here allocates or copies
+ * packet data: results point into the caller's buffer and are only valid
+ * while it is. Every read is checked against the captured length. */
+
+namespace DNSView
+{
+
+enum ParseStatus
+{
+    PARSE_OK = 0,
+    PARSE_TRUNCATED,        /* ran off the end of the capture */
+    PARSE_BAD_IP,           /* unknown version or bad header length */
+    PARSE_FRAGMENT,         /* part of a fragmented datagram, see IPPacket */
+    PARSE_UNSUPPORTED,      /* transport we cannot see into (ESP, ...) */
+    PARSE_BAD_NAME,         /* bad label type or name too long */
+    PARSE_NAME_LOOP,        /* compression pointer not pointing backwards */
+    PARSE_STATUS_COUNT
+};
+
+const char *parseStatusName(int status);
+
+enum { DNS_MAX_NAME = 255, DNS_MAX_TEXT = 256 };
+
+struct IPPacket
+{
+    unsigned char ver;
+    unsigned char proto;                /* after any IPv6 extension headers */
+    const unsigned char *saddr;         /* 4 or 16 bytes */
+    const unsigned char *daddr;
+    const unsigned char *payload;
+    size_t payloadLen;
+
+    /* Set with PARSE_FRAGMENT: the payload is the part of the datagram
+     * after the IP header (the fragment header for IPv6) at fragOffset */
+    unsigned int fragId;
+    unsigned short fragOffset;
+    bool moreFragments;
+};
+
+/* data starts at the IP header. Every fragment of a datagram, the first
+ * included, is PARSE_FRAGMENT with the fragment fields filled in. */
+int parseIP(const unsigned char *data, size_t len, IPPacket &ip);
+
+struct UDPDatagram
+{
+    unsigned short sport;
+    unsigned short dport;
+    const unsigned char *payload;
+    size_t payloadLen;
+};
+
+int parseUDP(const unsigned char *data, size_t len, UDPDatagram &udp);
+
+struct TCPSegment
+{
+    enum { FIN = 0x01, SYN = 0x02, RST = 0x04 };
+
+    unsigned short sport;
+    unsigned short dport;
+    unsigned int seq;
+    unsigned char flags;
+    const unsigned char *payload;
+    size_t payloadLen;
+};
+
+/* len is the IP payload length, so trailing link padding is not data */
+int parseTCP(const unsigned char *data, size_t len, TCPSegment &tcp);
+
+struct DNSHeader
+{
+    unsigned short id;
+    unsigned short flags;
+    unsigned short qdcount;
+    unsigned short ancount;
+    unsigned short nscount;
+    unsigned short arcount;
+
+    bool isResponse() const { return 0 != ( flags & 0x8000 ); }
+    unsigned int opcode() const { return ( flags >> 11 ) & 0xf; }
+    unsigned int rcode() const { return flags & 0xf; }
+};
+
+/* A possibly compressed name somewhere in a message */
+struct DNSName
+{
+    const unsigned char *msg;
+    size_t msgLen;
+    size_t offset;
+};
+
+/* Uncompressed wire form, buf must hold DNS_MAX_NAME bytes */
+int nameToWire(const DNSName &name, unsigned char *buf, size_t &len);
+/* Dotted text ("." for the root), buf must hold DNS_MAX_TEXT bytes */
+int nameToText(const DNSName &name, char *buf, size_t &len);
+
+struct DNSQuestion
+{
+    DNSName name;
+    unsigned short qtype;
+    unsigned short qclass;
+};
+
+struct DNSRecord
+{
+    DNSName name;
+    unsigned short type;
+    unsigned short rclass;
+    unsigned int ttl;
+    const unsigned char *rdata;
+    unsigned short rdlen;
+    DNSName rdataName;      /* rdata as a name, for CNAME/NS/PTR */
+};
+
+/* Cursor over one DNS message */
+class DNSParser
+{
+public:
+    DNSParser();
+
+    int init(const unsigned char *msg, size_t len);
+    const DNSHeader &header() const;
+
+    /* Call header().qdcount times, stops at the first error */
+    int nextQuestion(DNSQuestion &question);
+    /* Once the questions are done: answer, authority, then additional records */
+    int nextRecord(DNSRecord &record);
+
+private:
+    int skipName(DNSName &name);
+
+    const unsigned char *msg_;
+    size_t len_;
+    size_t off_;
+    DNSHeader hdr_;
+};
+
+/* Mnemonics, NULL if there is none */
+const char *qtypeName(unsigned short qtype);
+const char *qclassName(unsigned short qclass);
+const char *rcodeName(unsigned int rcode);
+
+}
+
+#endif
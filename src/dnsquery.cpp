@@ -0,0 +1,145 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "dnsquery.h"
+
+namespace DNSView
+{
+
+int formatAddr(unsigned char ver, const unsigned char *addr, char *buf)
+{
+    if ( ver != 6 )
+        return std::sprintf(buf, "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+
+    /* RFC 5952: lower case, longest run of two or more zero groups as "::" */
+    unsigned int groups[8];
+    for (int i = 0; i < 8; i++)
+        groups[i] = ( addr[i * 2] << 8 ) | addr[i * 2 + 1];
+    int bestStart = -1, bestLen = 1;
+    for (int i = 0; i < 8; )
+    {
+        int j = i;
+        while ( j < 8 && !groups[j] )
+            j++;
+        if ( j - i > bestLen )
+        {
+            bestStart = i;
+            bestLen = j - i;
+        }
+        i = ( j == i ) ? i + 1 : j;
+    }
+    int n = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if ( i == bestStart )
+        {
+            buf[n++] = ':';
+            if ( i == 0 )
+                buf[n++] = ':';
+            i += bestLen - 1;
+            continue;
+        }
+        n += std::sprintf(buf + n, "%x", groups[i]);
+        if ( i < 7 )
+            buf[n++] = ':';
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+int parseAddr(const char *text, unsigned char &ver, unsigned char *addr)
+{
+    std::memset(addr, 0, 16);
+    if ( !std::strchr(text, ':') )
+    {
+        unsigned int b[4];
+        char tail;
+        if ( 4 != std::sscanf(text, "%u.%u.%u.%u%c", &b[0], &b[1], &b[2], &b[3], &tail) )
+            return -1;
+        for (int i = 0; i < 4; i++)
+        {
+            if ( b[i] > 255 )
+                return -1;
+            addr[i] = static_cast<unsigned char>(b[i]);
+        }
+        ver = 4;
+        return 0;
+    }
+
+    /* Groups before and after the "::", which stands for the zeros between */
+    unsigned int groups[8];
+    int nGroups = 0, gap = -1;
+    const char *p = text;
+    if ( ':' == p[0] && ':' == p[1] )
+    {
+        gap = 0;
+        p += 2;
+    }
+    while ( *p )
+    {
+        char *end;
+        unsigned long v = std::strtoul(p, &end, 16);
+        if ( end == p || end - p > 4 || v > 0xffff || nGroups == 8 )
+            return -1;
+        groups[nGroups++] = static_cast<unsigned int>(v);
+        p = end;
+        if ( !*p )
+            break;
+        if ( ':' != *p++ )
+            return -1;
+        if ( ':' == *p )
+        {
+            if ( -1 != gap )
+                return -1;
+            gap = nGroups;
+            p++;
+        }
+        else if ( !*p )
+            return -1;
+    }
+    if ( -1 == gap ? 8 != nGroups : nGroups > 7 )
+        return -1;
+    int skip = -1 == gap ? 0 : 8 - nGroups;
+    for (int i = 0, g = 0; i < 8; i++)
+    {
+        if ( i >= gap && i < gap + skip )
+            continue;
+        addr[i * 2] = static_cast<unsigned char>(groups[g] >> 8);
+        addr[i * 2 + 1] = static_cast<unsigned char>(groups[g++] & 0xff);
+    }
+    ver = 6;
+    return 0;
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef __DNSQUERY_H
+#define __DNSQUERY_H
+
+#include <string>
+#include <vector>
+
+namespace DNSView
+{
+
+/* One question of a captured DNS query */
+struct DNSQuery
+{
+    unsigned long long seq;     /* consecutive from 0 for each capture */
+    unsigned int tv_sec;
+    unsigned int tv_usec;
+    unsigned char ver;          /* 4 or 6 */
+    unsigned char saddr[16];    /* IPv4 uses the first 4 bytes */
+    unsigned char daddr[16];
+    unsigned short qtype;
+    unsigned int nameId;        /* NameTable id */
+};
+
+typedef std::vector<DNSQuery> QueryBatch;
+
+/* Outcome of the query whose questions are seq .. seq + count - 1 */
+struct DNSAnswer
+{
+    enum Status { ANSWERED, TIMEOUT };
+    enum Kind { NONE, ADDR4, ADDR6, CNAME };
+
+    unsigned long long seq;
+    unsigned short count;
+    unsigned char status;
+    unsigned char rcode;
+    unsigned int latencyUs;
+    unsigned short ancount;
+    unsigned int ttl;           /* lowest TTL in the answer section */
+    unsigned char kind;         /* first A/AAAA, else first CNAME */
+    unsigned char addr[16];
+    unsigned int cnameId;       /* NameTable id */
+};
+
+typedef std::vector<DNSAnswer> AnswerBatch;
+
+/* Text form of an IPv4/IPv6 address, buf must hold at least ADDR_STRLEN */
+enum { ADDR_STRLEN = 46 };
+int formatAddr(unsigned char ver, const unsigned char *addr, char *buf);
+/* The reverse, for dotted IPv4 or IPv6 with "::"; 0 on success */
+int parseAddr(const char *text, unsigned char &ver, unsigned char *addr);
+
+}
+
+#endif
@@ -0,0 +1,407 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "binlog.h"
+#include "dnsparse.h"
+#include "nametable.h"
+#include "querylog.h"
+#include "querystore.h"
+
+using namespace DNSView;
+
+namespace
+{
+
+enum Format { TEXT, CSV, JSON };
+
+/* Longest decimal text of an unsigned int and of an unsigned long long */
+enum { UINT_STRLEN = 10, ULL_STRLEN = 20 };
+
+/* Name bytes are arbitrary; CSV doubles quotes, JSON escapes anything
+ * outside printable ASCII */
+void putName(std::string &out, const NameTable &names, unsigned int id, Format format)
+{
+    char buf[NameTable::NAME_STRLEN];
+    size_t n = names.render(id, buf);
+    out += '"';
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(buf[i]);
+        if ( '"' == c )
+            out += CSV == format ? "\"\"" : "\\\"";
+        else if ( JSON == format && '\\' == c )
+            out += "\\\\";
+        else if ( JSON == format && ( c < 0x20 || c >= 0x7f ) )
+        {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        }
+        else
+            out += static_cast<char>(c);
+    }
+    out += '"';
+}
+
+void putAddr(std::string &out, unsigned char ver, const unsigned char *addr, bool quote)
+{
+    char buf[ADDR_STRLEN];
+    formatAddr(ver, addr, buf);
+    if ( quote )
+        out += '"';
+    out += buf;
+    if ( quote )
+        out += '"';
+}
+
+std::string typeName(unsigned short qtype)
+{
+    const char *name = qtypeName(qtype);
+    char buf[16];
+    if ( !name )
+        std::snprintf(buf, sizeof(buf), "TYPE%u", qtype);
+    return name ? name : buf;
+}
+
+std::string rcodeText(unsigned int rcode)
+{
+    const char *name = rcodeName(rcode);
+    char buf[16];
+    if ( !name )
+        std::snprintf(buf, sizeof(buf), "RCODE%u", rcode);
+    return name ? name : buf;
+}
+
+void putQuery(std::string &out, const DNSQuery &query, const NameTable &names, TimeFormatter &times, 
+        Format format)
+{
+    char buf[LOG_LINE_MAX];
+    if ( TEXT == format )
+    {
+        out.append(buf, formatLogLine(query, names, times, buf));
+        return;
+    }
+    bool json = JSON == format;
+    times.format(query.tv_sec, query.tv_usec, buf);
+    out += json ? "{\"type\":\"query\",\"time\":\"" : "query,";
+    out += buf;
+    /* The fixed text and the widest numbers */
+    char num[32 + 2 * UINT_STRLEN + ULL_STRLEN];
+    std::snprintf(num, sizeof(num), json ? "\",\"ts\":%u.%06u,\"seq\":%llu,\"src\":" : ",%u.%06u,%llu,", 
+            query.tv_sec, query.tv_usec, query.seq);
+    out += num;
+    putAddr(out, query.ver, query.saddr, json);
+    out += json ? ",\"dst\":" : ",";
+    putAddr(out, query.ver, query.daddr, json);
+    out += json ? ",\"qtype\":\"" : ",";
+    out += typeName(query.qtype);
+    out += json ? "\",\"name\":" : ",";
+    putName(out, names, query.nameId, format);
+    out += json ? "}\n" : ",,,,,,,\n";
+}
+
+void putAnswer(std::string &out, const DNSAnswer &answer, const NameTable &names, Format format)
+{
+    bool json = JSON == format;
+    /* The fixed text and the widest numbers, the names go in as they are */
+    char num[48 + ULL_STRLEN + 3 * UINT_STRLEN];
+    std::snprintf(num, sizeof(num), json ? "{\"type\":\"answer\",\"seq\":%llu,\"count\":%u,\"status\":\"" : 
+            "answer,,,%llu,,,,,%u,", answer.seq, answer.count);
+    out += num;
+    out += DNSAnswer::ANSWERED == answer.status ? "answered" : "timeout";
+    out += json ? "\",\"rcode\":\"" : ",";
+    out += rcodeText(answer.rcode);
+    std::snprintf(num, sizeof(num), json ? "\",\"latency_us\":%u,\"ancount\":%u,\"ttl\":%u,\"answer\":" : 
+            ",%u,%u,%u,", answer.latencyUs, answer.ancount, answer.ttl);
+    out += num;
+    if ( DNSAnswer::ADDR4 == answer.kind || DNSAnswer::ADDR6 == answer.kind )
+        putAddr(out, DNSAnswer::ADDR6 == answer.kind ? 6 : 4, answer.addr, json);
+    else if ( DNSAnswer::CNAME == answer.kind )
+        putName(out, names, answer.cnameId, format);
+    else if ( json )
+        out += "null";
+    out += json ? "}\n" : "\n";
+}
+
+/* Writes results out as they come, as text, CSV or JSON lines, or into a
+ * binary log that the viewer can replay */
+class DumpSink : public SearchSink
+{
+public:
+    DumpSink(const NameTable &names, Format format, std::FILE *pSave) :
+        names_(names), format_(format), pSave_(pSave), writer_(names)
+    {
+        if ( pSave_ )
+        {
+            BinLogWriter::fileHeader(block_);
+            out_.assign(block_.begin(), block_.end());
+            block_.clear();
+        }
+    }
+
+    void dropped(unsigned int count)
+    {
+        /* As the text log itself reports it */
+        static const char * const lines[] = { "# %u queries dropped, log writer behind\n",
+            "dropped,,,,,,,,%u,,,,,,\n", "{\"type\":\"dropped\",\"count\":%u}\n" };
+        if ( pSave_ )
+        {
+            writer_.addDropped(count);
+            return;
+        }
+        char line[96];
+        std::snprintf(line, sizeof(line), lines[format_], count);
+        out_ += line;
+    }
+
+    virtual int onResults(const QueryBatch &queries, const AnswerBatch &answers, std::string &errmsg)
+    {
+        if ( pSave_ )
+        {
+            writer_.add(queries);
+            writer_.add(answers);
+            if ( writer_.size() < SAVE_BLOCK )
+                return 0;
+            finishBlock();
+            return flush(errmsg);
+        }
+        for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+            putQuery(out_, *it, names_, times_, format_);
+        if ( TEXT != format_ )
+        {
+            for (AnswerBatch::const_iterator it = answers.begin(); it != answers.end(); ++it)
+                putAnswer(out_, *it, names_, format_);
+        }
+        return flush(errmsg);
+    }
+
+    int finish(std::string &errmsg)
+    {
+        if ( pSave_ && !writer_.empty() )
+            finishBlock();
+        if ( flush(errmsg) )
+            return -1;
+        if ( std::fflush(pSave_ ? pSave_ : stdout) )
+        {
+            errmsg = std::string("Error writing output: ") + std::strerror(errno);
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    enum { SAVE_BLOCK = 1 << 20 };
+
+    void finishBlock()
+    {
+        writer_.finish(block_);
+        out_.append(block_.begin(), block_.end());
+        block_.clear();
+    }
+
+    int flush(std::string &errmsg)
+    {
+        if ( !out_.empty() && out_.size() != std::fwrite(out_.data(), 1, out_.size(), pSave_ ? pSave_ : stdout) )
+        {
+            errmsg = std::string("Error writing output: ") + std::strerror(errno);
+            return -1;
+        }
+        out_.clear();
+        return 0;
+    }
+
+    const NameTable &names_;
+    Format format_;
+    std::FILE *pSave_;
+    BinLogWriter writer_;
+    TimeFormatter times_;
+    std::vector<char> block_;
+    std::string out_;
+};
+
+/* Everything in a log, in the order written */
+int dump(const char *path, NameTable &names, DumpSink &sink, std::string &errmsg)
+{
+    BinLogReader reader;
+    if ( reader.open(path, errmsg) )
+        return -1;
+    QueryBatch queries;
+    AnswerBatch answers;
+    int ret;
+    while ( 0 < ( ret = reader.next(names, queries, answers, errmsg) ) )
+    {
+        if ( reader.block().dropped )
+            sink.dropped(reader.block().dropped);
+        if ( sink.onResults(queries, answers, errmsg) )
+            return -1;
+        queries.clear();
+        answers.clear();
+    }
+    if ( reader.badBlocks() )
+        std::fprintf(stderr, "%s: skipped %llu damaged blocks\n", path, reader.badBlocks());
+    return ret;
+}
+
+/* "yyyy-mm-dd hh:mm[:ss]" in local time, or seconds since the epoch */
+int parseTime(const char *text, unsigned long long &us)
+{
+    std::tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    int n = std::sscanf(text, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, 
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if ( n >= 5 )
+    {
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        std::time_t t = std::mktime(&tm);
+        if ( -1 == t )
+            return -1;
+        us = static_cast<unsigned long long>(t) * 1000000ULL;
+        return 0;
+    }
+    char *end;
+    unsigned long long secs = std::strtoull(text, &end, 10);
+    if ( end == text || *end )
+        return -1;
+    us = secs * 1000000ULL;
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    /* dnsviewer-dump [--format <text|csv|json>] [--save <results.dnsl>]
+     *                [--name <name | *.domain>] [--client <address>]
+     *                [--from <time>] [--to <time>] (--store <dir> | <file.dnsl> ...)
+     * Times are "yyyy-mm-dd hh:mm[:ss]" in local time or epoch seconds */
+    Format format = TEXT;
+    StoreFilter filter;
+    const char *store = NULL, *save = NULL;
+    bool search = false, usage = false;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i], *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool option = '-' == arg[0] && '-' == arg[1];
+        if ( option && !value )
+            usage = true;
+        else if ( !std::strcmp(arg, "--format") )
+        {
+            format = !std::strcmp(value, "csv") ? CSV : !std::strcmp(value, "json") ? JSON : TEXT;
+            usage = usage || ( TEXT == format && std::strcmp(value, "text") );
+        }
+        else if ( !std::strcmp(arg, "--save") )
+            save = value;
+        else if ( !std::strcmp(arg, "--store") )
+            store = value;
+        else if ( !std::strcmp(arg, "--name") )
+            filter.name = value;
+        else if ( !std::strcmp(arg, "--client") )
+        {
+            filter.hasClient = true;
+            usage = usage || parseAddr(value, filter.ver, filter.client);
+        }
+        else if ( !std::strcmp(arg, "--from") )
+            usage = usage || parseTime(value, filter.fromUs);
+        else if ( !std::strcmp(arg, "--to") )
+            usage = usage || parseTime(value, filter.toUs);
+        else if ( option )
+            usage = true;
+        else
+        {
+            files.push_back(arg);
+            continue;
+        }
+        search = search || std::strcmp(arg, "--format");
+        i++;
+    }
+    if ( usage || ( !store && files.empty() ) )
+    {
+        std::fprintf(stderr, "usage: %s [--format <text|csv|json>] [--save <results.dnsl>]\n"
+                "        [--name <name | *.domain>] [--client <address>] [--from <time>] [--to <time>]\n"
+                "        (--store <dir> | <file.dnsl> ...)\n", argv[0]);
+        return 2;
+    }
+    filter.normalize();
+
+    std::FILE *pSave = NULL;
+    if ( save && !( pSave = std::fopen(save, "wb") ) )
+    {
+        std::fprintf(stderr, "Error opening %s: %s\n", save, std::strerror(errno));
+        return 1;
+    }
+    if ( CSV == format && !pSave )
+        std::fputs("type,time,ts,seq,src,dst,qtype,name,count,status,rcode,latency_us,ancount,ttl,answer\n", stdout);
+
+    /* Names are interned block by block, so one table serves every file */
+    NameTable names;
+    DumpSink sink(names, format, pSave);
+    SearchStats stats;
+    std::clock_t start = std::clock();
+    int status = 0;
+    std::string errmsg;
+    if ( store && searchStore(store, filter, names, sink, stats, errmsg) )
+    {
+        std::fprintf(stderr, "%s\n", errmsg.c_str());
+        status = 1;
+    }
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        int ret = search ? searchLog(files[i], filter, names, sink, stats, errmsg) : 
+            dump(files[i], names, sink, errmsg);
+        if ( ret )
+        {
+            std::fprintf(stderr, "%s\n", errmsg.c_str());
+            status = 1;
+        }
+    }
+    if ( sink.finish(errmsg) )
+    {
+        std::fprintf(stderr, "%s\n", errmsg.c_str());
+        status = 1;
+    }
+    if ( pSave && std::fclose(pSave) )
+        status = 1;
+    if ( search )
+        std::fprintf(stderr, "%llu segments, %llu indexed, %llu skipped, %llu blocks read in %.0f ms\n", 
+                stats.segments, stats.indexed, stats.skipped, stats.blocksRead, 
+                1000.0 * ( std::clock() - start ) / CLOCKS_PER_SEC);
+    return status;
+}
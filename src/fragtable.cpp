@@ -0,0 +1,367 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "fragtable.h"
+
+namespace DNSView
+{
+
+bool FragmentKey::operator==(const FragmentKey &other) const
+{
+    return id == other.id && proto == other.proto && ver == other.ver && 
+        !std::memcmp(saddr, other.saddr, sizeof(saddr)) && 
+        !std::memcmp(daddr, other.daddr, sizeof(daddr));
+}
+
+FragmentTable::FragmentTable(unsigned int capacity, size_t maxBuffered) 
+    : maxOrphans_(capacity / 8 ? capacity / 8 : 1), maxBuffered_(maxBuffered), 
+    timeoutUs_(30000000), dropped_(0), orphans_(0)
+{
+    /* Twice as many buckets as datagrams, a power of two */
+    unsigned int size = 1;
+    while ( size < capacity )
+        size <<= 1;
+    datagrams_.resize(capacity ? capacity : 1);
+    buckets_.resize(size * 2);
+    clear();
+}
+
+void FragmentTable::setTimeout(unsigned int timeoutMs)
+{
+    timeoutUs_ = static_cast<unsigned long long>(timeoutMs) * 1000;
+}
+
+void FragmentTable::clear()
+{
+    buckets_.assign(buckets_.size(), -1);
+    for (size_t i = 0; i < datagrams_.size(); i++)
+    {
+        std::vector<unsigned char>().swap(datagrams_[i].data);
+        datagrams_[i].live = false;
+        datagrams_[i].next = static_cast<int>(i) + 1;
+    }
+    datagrams_.back().next = -1;
+    free_ = 0;
+    for (int list = 0; list < 2; list++)
+    {
+        oldest_[list] = newest_[list] = -1;
+        live_[list] = buffered_[list] = 0;
+    }
+    dropped_ = orphans_ = 0;
+    std::vector<unsigned char>().swap(done_);
+}
+
+size_t FragmentTable::pending() const
+{
+    return live_[0] + live_[1];
+}
+
+size_t FragmentTable::buffered() const
+{
+    return buffered_[0] + buffered_[1];
+}
+
+unsigned long long FragmentTable::takeDropped()
+{
+    unsigned long long dropped = dropped_;
+    dropped_ = 0;
+    return dropped;
+}
+
+unsigned long long FragmentTable::takeOrphans()
+{
+    unsigned long long orphans = orphans_;
+    orphans_ = 0;
+    return orphans;
+}
+
+unsigned int FragmentTable::bucket(const FragmentKey &key) const
+{
+    /* FNV-1a, as in TxnTable */
+    unsigned int h = 2166136261u;
+    const unsigned char *parts[2] = { key.saddr, key.daddr };
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 16; j++)
+            h = ( h ^ parts[i][j] ) * 16777619u;
+    h = ( h ^ key.id ) * 16777619u;
+    h = ( h ^ key.proto ) * 16777619u;
+    return h & ( buckets_.size() - 1 );
+}
+
+int FragmentTable::find(const FragmentKey &key) const
+{
+    for (int slot = buckets_[bucket(key)]; -1 != slot; slot = datagrams_[slot].next)
+    {
+        if ( datagrams_[slot].key == key )
+            return slot;
+    }
+    return -1;
+}
+
+int FragmentTable::firstState(const IPPacket &fragment)
+{
+    /* Only the first fragment has the ports, UDP and TCP both start with them */
+    if ( fragment.fragOffset )
+        return ORPHAN;
+    if ( 17 != fragment.proto && 6 != fragment.proto )
+        return NOT_DNS;
+    if ( fragment.payloadLen < 4 )
+        return ORPHAN;
+    const unsigned char *p = fragment.payload;
+    unsigned int sport = p[0] << 8 | p[1], dport = p[2] << 8 | p[3];
+    return 53 == sport || 53 == dport ? DNS : NOT_DNS;
+}
+
+int FragmentTable::alloc(const FragmentKey &key, unsigned long long ts, int state)
+{
+    /* Orphans only ever make room among themselves, a DNS datagram takes
+     * the oldest orphan before the oldest DNS one */
+    int list = DNS == state;
+    if ( !list && live_[0] >= maxOrphans_ )
+        dropOldest(0);
+    if ( -1 == free_ )
+    {
+        if ( !list )
+            return -1;
+        dropOldest(-1 != oldest_[0] ? 0 : 1);
+    }
+    int slot = free_;
+    Datagram &datagram = datagrams_[slot];
+    free_ = datagram.next;
+    datagram.key = key;
+    datagram.ts = ts;
+    datagram.state = static_cast<unsigned char>(state);
+    datagram.data.clear();
+    datagram.nRanges = 0;
+    datagram.total = 0;
+    datagram.live = true;
+    int &head = buckets_[bucket(key)];
+    datagram.next = head;
+    head = slot;
+    link(slot);
+    buffered_[list] += datagram.data.capacity();
+    live_[list]++;
+    return slot;
+}
+
+void FragmentTable::link(int slot)
+{
+    Datagram &datagram = datagrams_[slot];
+    int list = DNS == datagram.state;
+    datagram.older = newest_[list];
+    datagram.newer = -1;
+    if ( -1 != newest_[list] )
+        datagrams_[newest_[list]].newer = slot;
+    else
+        oldest_[list] = slot;
+    newest_[list] = slot;
+}
+
+void FragmentTable::unlink(int slot)
+{
+    Datagram &datagram = datagrams_[slot];
+    int list = DNS == datagram.state;
+    ( -1 != datagram.older ? datagrams_[datagram.older].newer : oldest_[list] ) = datagram.newer;
+    ( -1 != datagram.newer ? datagrams_[datagram.newer].older : newest_[list] ) = datagram.older;
+}
+
+void FragmentTable::release(int slot)
+{
+    Datagram &datagram = datagrams_[slot];
+    int *pLink = &buckets_[bucket(datagram.key)];
+    while ( *pLink != slot )
+        pLink = &datagrams_[*pLink].next;
+    *pLink = datagram.next;
+    unlink(slot);
+
+    /* Small buffers stay with the slot for the datagram that takes it next */
+    int list = DNS == datagram.state;
+    buffered_[list] -= datagram.data.capacity();
+    if ( datagram.data.capacity() > KEEP_BYTES )
+        std::vector<unsigned char>().swap(datagram.data);
+    datagram.live = false;
+    datagram.next = free_;
+    free_ = slot;
+    live_[list]--;
+}
+
+void FragmentTable::dropOldest(int list)
+{
+    /* Turned away datagrams were never going to be reassembled */
+    int slot = oldest_[list];
+    if ( DNS == datagrams_[slot].state )
+        dropped_++;
+    else if ( ORPHAN == datagrams_[slot].state )
+        orphans_++;
+    release(slot);
+}
+
+bool FragmentTable::addRange(Datagram &datagram, unsigned int begin, unsigned int end)
+{
+    /* Merge [begin, end) into the sorted list, swallowing what it touches */
+    unsigned int i = 0;
+    while ( i < datagram.nRanges && datagram.ranges[i][1] < begin )
+        i++;
+    unsigned int j = i;
+    while ( j < datagram.nRanges && datagram.ranges[j][0] <= end )
+    {
+        begin = std::min(begin, datagram.ranges[j][0]);
+        end = std::max(end, datagram.ranges[j][1]);
+        j++;
+    }
+    if ( i == j )
+    {
+        if ( datagram.nRanges == MAX_RANGES )
+            return false;
+        std::memmove(datagram.ranges[i + 1], datagram.ranges[i], 
+                ( datagram.nRanges - i ) * sizeof(datagram.ranges[0]));
+        datagram.nRanges++;
+    }
+    else if ( j > i + 1 )
+    {
+        std::memmove(datagram.ranges[i + 1], datagram.ranges[j], 
+                ( datagram.nRanges - j ) * sizeof(datagram.ranges[0]));
+        datagram.nRanges -= j - i - 1;
+    }
+    datagram.ranges[i][0] = begin;
+    datagram.ranges[i][1] = end;
+    return true;
+}
+
+int FragmentTable::add(const IPPacket &fragment, unsigned long long ts, IPPacket &datagram)
+{
+    FragmentKey key;
+    std::memset(&key, 0, sizeof(key));
+    size_t addrLen = fragment.ver == 6 ? 16 : 4;
+    key.ver = fragment.ver;
+    key.proto = fragment.proto;
+    std::memcpy(key.saddr, fragment.saddr, addrLen);
+    std::memcpy(key.daddr, fragment.daddr, addrLen);
+    key.id = fragment.fragId;
+
+    int state = firstState(fragment);
+    int slot = find(key);
+    if ( -1 == slot )
+    {
+        slot = alloc(key, ts, state);
+        if ( -1 == slot )
+        {
+            orphans_++;
+            return FRAGMENT_DROPPED;
+        }
+    }
+    else if ( ORPHAN == datagrams_[slot].state && ORPHAN != state )
+    {
+        Datagram &orphan = datagrams_[slot];
+        if ( DNS == state )
+        {
+            /* Its first fragment is DNS: it joins the others, timed from now */
+            unlink(slot);
+            buffered_[0] -= orphan.data.capacity();
+            live_[0]--;
+            orphan.state = DNS;
+            orphan.ts = ts;
+            link(slot);
+            buffered_[1] += orphan.data.capacity();
+            live_[1]++;
+        }
+        else
+        {
+            /* The slot stays to turn the rest away, without the data */
+            buffered_[0] -= orphan.data.capacity();
+            std::vector<unsigned char>().swap(orphan.data);
+            orphan.state = NOT_DNS;
+        }
+    }
+    Datagram &entry = datagrams_[slot];
+    if ( NOT_DNS == entry.state )
+        return FRAGMENT_NOT_DNS;
+
+    unsigned int begin = fragment.fragOffset;
+    unsigned int end = begin + static_cast<unsigned int>(fragment.payloadLen);
+    if ( end > MAX_DATAGRAM || ( entry.total && end > entry.total ) || 
+            ( !fragment.moreFragments && end < entry.data.size() ) || 
+            !addRange(entry, begin, end) )
+    {
+        release(slot);
+        ( DNS == entry.state ? dropped_ : orphans_ )++;
+        return FRAGMENT_BAD;
+    }
+
+    int list = DNS == entry.state;
+    size_t before = entry.data.capacity();
+    if ( !fragment.moreFragments )
+    {
+        entry.total = end;
+        entry.data.reserve(end);
+    }
+    if ( entry.data.size() < end )
+        entry.data.resize(end);
+    if ( fragment.payloadLen )
+        std::memcpy(&entry.data[begin], fragment.payload, fragment.payloadLen);
+    buffered_[list] = buffered_[list] - before + entry.data.capacity();
+
+    if ( !entry.total || 1 != entry.nRanges || entry.ranges[0][0] || entry.ranges[0][1] != entry.total )
+    {
+        /* Over budget: drop the oldest of the same kind, never the one just fed */
+        size_t budget = list ? maxBuffered_ - maxBuffered_ / 8 : maxBuffered_ / 8;
+        while ( buffered_[list] > budget && oldest_[list] != slot )
+            dropOldest(list);
+        return FRAGMENT_HELD;
+    }
+
+    /* Hand the buffer over; the slot gets the previous one back */
+    doneKey_ = entry.key;
+    buffered_[list] -= entry.data.capacity();
+    done_.swap(entry.data);
+    buffered_[list] += entry.data.capacity();
+    release(slot);
+    datagram.ver = doneKey_.ver;
+    datagram.proto = doneKey_.proto;
+    datagram.saddr = doneKey_.saddr;
+    datagram.daddr = doneKey_.daddr;
+    datagram.payload = done_.empty() ? NULL : &done_[0];
+    datagram.payloadLen = done_.size();
+    return FRAGMENT_COMPLETE;
+}
+
+void FragmentTable::expire(unsigned long long now)
+{
+    for (int list = 0; list < 2; list++)
+    {
+        while ( -1 != oldest_[list] && datagrams_[oldest_[list]].ts + timeoutUs_ <= now )
+            dropOldest(list);
+    }
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef __FRAGTABLE_H
+#define __FRAGTABLE_H
+
+#include <vector>
+
+#include "dnsparse.h"
+
+namespace DNSView
+{
+
+struct FragmentKey
+{
+    unsigned char ver;
+    unsigned char proto;
+    unsigned char saddr[16];
+    unsigned char daddr[16];
+    unsigned int id;
+
+    bool operator==(const FragmentKey &other) const;
+};
+
+/* Puts fragmented IPv4 and IPv6 datagrams back together, mostly EDNS
+ * responses too big for the path MTU. Fragments may come in any order and
+ * twice; a datagram is done once its last fragment has been seen and the
+ * pieces cover everything before it. Memory is fixed like TcpFlowTable's:
+ * datagrams come from a preallocated pool in order of arrival, a full pool
+ * drops the oldest one and so does going over the byte budget.
+ *
+ * The kernel filter passes every later fragment on the link, since those
+ * carry no ports, but only the first fragments of DNS. Until its first
+ * fragment shows port 53 a datagram is an orphan: orphans share an eighth
+ * of the pool and of the budget and only ever push out each other, so
+ * fragmented bulk traffic cannot displace a DNS reassembly. A first
+ * fragment with other ports ends the datagram, and the rest of it is
+ * turned away as FRAGMENT_NOT_DNS. Not thread-safe. */
+class FragmentTable
+{
+public:
+    enum Result
+    {
+        FRAGMENT_HELD = 0,      /* waiting for the rest */
+        FRAGMENT_COMPLETE,
+        FRAGMENT_BAD,           /* past 64 KiB, or too scattered to track */
+        FRAGMENT_NOT_DNS,       /* its first fragment has neither port 53 */
+        FRAGMENT_DROPPED        /* an orphan with no room left for it */
+    };
+
+    explicit FragmentTable(unsigned int capacity = 1024, size_t maxBuffered = 8 << 20);
+
+    /* Datagrams not finished after this long are dropped by expire() */
+    void setTimeout(unsigned int timeoutMs);
+    void clear();
+    size_t pending() const;
+    /* Bytes held for unfinished datagrams */
+    size_t buffered() const;
+
+    /* fragment is as parseIP() filled it, ts is in microseconds. With
+     * FRAGMENT_COMPLETE datagram is the whole of it, payload starting at the
+     * transport header, valid until the next call. */
+    int add(const IPPacket &fragment, unsigned long long ts, IPPacket &datagram);
+    /* Unfinished DNS datagrams dropped, for any reason, since the last call */
+    unsigned long long takeDropped();
+    /* Orphans dropped since the last call, their first fragment never seen */
+    unsigned long long takeOrphans();
+    /* Datagrams time out counted from their first fragment, or from when
+     * the first fragment of an orphan showed it was DNS */
+    void expire(unsigned long long now);
+
+private:
+    enum { MAX_RANGES = 16, MAX_DATAGRAM = 65535, KEEP_BYTES = 2048 };
+    enum State { ORPHAN, DNS, NOT_DNS };    /* NOT_DNS holds no data */
+
+    struct Datagram
+    {
+        FragmentKey key;
+        unsigned long long ts;
+        unsigned char state;
+        std::vector<unsigned char> data;
+        unsigned int ranges[MAX_RANGES][2];     /* received [begin, end), sorted, disjoint */
+        unsigned int nRanges;
+        unsigned int total;     /* length once the last fragment is in, else 0 */
+        bool live;
+        int next;               /* hash chain, or the free list */
+        int older, newer;       /* list of live datagrams, orphans or DNS */
+    };
+
+    unsigned int bucket(const FragmentKey &key) const;
+    int find(const FragmentKey &key) const;
+    static int firstState(const IPPacket &fragment);
+    int alloc(const FragmentKey &key, unsigned long long ts, int state);
+    void link(int slot);
+    void unlink(int slot);
+    void release(int slot);
+    void dropOldest(int list);
+    bool addRange(Datagram &datagram, unsigned int begin, unsigned int end);
+
+    std::vector<Datagram> datagrams_;
+    std::vector<int> buckets_;
+    int free_;
+    /* By list, [0] orphans and turned away datagrams, [1] DNS, oldest first */
+    int oldest_[2], newest_[2];
+    size_t live_[2], buffered_[2];
+    size_t maxOrphans_, maxBuffered_;
+    unsigned long long timeoutUs_, dropped_, orphans_;
+
+    /* The last datagram completed */
+    FragmentKey doneKey_;
+    std::vector<unsigned char> done_;
+};
+
+}
+
+#endif
@@ -0,0 +1,303 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <QCoreApplication>
+#include <QSocketNotifier>
+
+#ifndef _WIN32
+#   include <sys/socket.h>
+#   include <unistd.h>
+#endif
+
+#include "headless.h"
+#include "options.h"
+#include "pcapthread.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+int HeadlessApp::sigFds_[2] = { -1, -1 };
+
+HeadlessApp::HeadlessApp(QObject *parent) :
+    QObject(parent),
+    spPCapThread_(new PCapThread),
+    spNames_(new NameTable),
+    live_(false),
+    stopping_(false),
+    failed_(false)
+{
+    spPCapThread_->setNameTable(spNames_.data());
+    connect(spPCapThread_.data(), SIGNAL(sigDataReady(const QueryBatch&)), this, SLOT(slotDataReady(const QueryBatch&)));
+    connect(spPCapThread_.data(), SIGNAL(sigAnswersReady(const AnswerBatch&)), this, SLOT(slotAnswersReady(const AnswerBatch&)));
+    connect(spPCapThread_.data(), SIGNAL(sigError(const QString&)), this, SLOT(slotError(const QString&)));
+    connect(spPCapThread_.data(), SIGNAL(sigDone()), this, SLOT(slotDone()));
+    connect(spPCapThread_.data(), SIGNAL(sigStats(const StatsSnapshot&)), 
+            this, SLOT(slotStats(const StatsSnapshot&)));
+    connect(this, SIGNAL(sigQuit()), spPCapThread_.data(), SLOT(slotQuit()));
+    connect(this, SIGNAL(sigStartPoll(const QStringList&, const QString&)), spPCapThread_.data(), SLOT(slotStart(const QStringList&, const QString&)));
+    connect(this, SIGNAL(sigStartReplay(const QString&, const QString&, bool)), 
+            spPCapThread_.data(), SLOT(slotStartReplay(const QString&, const QString&, bool)));
+    connect(this, SIGNAL(sigStopPoll()), spPCapThread_.data(), SLOT(slotStop()));
+}
+
+HeadlessApp::~HeadlessApp()
+{}
+
+int HeadlessApp::installSignalHandlers(std::string &errmsg)
+{
+#ifndef _WIN32
+    /* The handlers only write the signal number to a socket, the notifier
+     * picks it up in the event loop */
+    if ( socketpair(AF_UNIX, SOCK_STREAM, 0, sigFds_) )
+    {
+        errmsg = std::string("socketpair: ") + std::strerror(errno);
+        return -1;
+    }
+    spSigNotifier_ = QSharedPointer<QSocketNotifier>(new QSocketNotifier(sigFds_[1], QSocketNotifier::Read));
+    connect(spSigNotifier_.data(), SIGNAL(activated(int)), this, SLOT(slotSignal()));
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &HeadlessApp::onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+#else
+    (void)errmsg;
+#endif
+    return 0;
+}
+
+void HeadlessApp::onSignal(int sig)
+{
+#ifndef _WIN32
+    char c = static_cast<char>(sig);
+    ssize_t ret = ::write(sigFds_[0], &c, 1);
+    (void)ret;
+#else
+    (void)sig;
+#endif
+}
+
+void HeadlessApp::slotSignal()
+{
+#ifndef _WIN32
+    char c;
+    if ( 1 != ::read(sigFds_[1], &c, 1) )
+        return;
+    if ( SIGHUP == c )
+    {
+        log_.reopen();
+        return;
+    }
+    if ( !stopping_ )
+    {
+        stopping_ = true;
+        emit sigStopPoll();
+    }
+#endif
+}
+
+PCapThread &HeadlessApp::capture()
+{
+    return *spPCapThread_;
+}
+
+int HeadlessApp::setOutput(const std::string &path, const LogPolicy &policy, std::string &errmsg)
+{
+    log_.setPolicy(policy);
+    return log_.open(path, *spNames_, errmsg);
+}
+
+int HeadlessApp::setStore(const std::string &dir, unsigned int segmentSecs, std::string &errmsg)
+{
+    /* Binary segments, cut every segmentSecs and indexed when closed */
+    LogPolicy policy;
+    policy.binary = true;
+    policy.index = true;
+    policy.rotateSecs = segmentSecs;
+    store_.setPolicy(policy);
+    return store_.open(dir, *spNames_, errmsg);
+}
+
+void HeadlessApp::setStatsFile(const QString &path)
+{
+    statsPath_ = path;
+}
+
+void HeadlessApp::start(const QStringList &devs, const QString &filter)
+{
+    live_ = true;
+    emit sigStartPoll(devs, filter);
+}
+
+void HeadlessApp::startReplay(const QString &path, const QString &filter, bool realtime)
+{
+    live_ = false;
+    emit sigStartReplay(path, filter, realtime);
+}
+
+void HeadlessApp::shutDown()
+{
+    /* Same as closing the window */
+    emit sigQuit();
+    spPCapThread_->waitForThread();
+    log_.close();
+    store_.close();
+}
+
+int HeadlessApp::exitCode() const
+{
+    return failed_ ? 1 : 0;
+}
+
+void HeadlessApp::slotDataReady(const QueryBatch &queries)
+{
+    if ( live_ )
+    {
+        /* From the kernel's timestamp to the lines being written */
+        unsigned long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+        {
+            unsigned long long ts = it->tv_sec * 1000000ULL + it->tv_usec;
+            displayLatency_.record(now > ts ? now - ts : 0);
+        }
+    }
+    log_.write(queries);
+    store_.write(queries);
+}
+
+void HeadlessApp::slotAnswersReady(const AnswerBatch &answers)
+{
+    log_.write(answers);
+    store_.write(answers);
+    for (AnswerBatch::const_iterator it = answers.begin(); it != answers.end(); ++it)
+    {
+        if ( DNSAnswer::ANSWERED == it->status )
+            resolverLatency_.record(it->latencyUs);
+    }
+}
+
+void HeadlessApp::slotStats(const StatsSnapshot &snap)
+{
+    /* Errors from the log writer surface here, twice a second */
+    std::string errmsg;
+    if ( log_.takeError(errmsg) )
+        std::cerr << "dnsviewer: " << errmsg << std::endl;
+    if ( store_.takeError(errmsg) )
+        std::cerr << "dnsviewer: " << errmsg << std::endl;
+    if ( statsPath_.isEmpty() )
+        return;
+    if ( writeStatsJson(statsPath_.toLocal8Bit().constData(), snap, displayLatency_, resolverLatency_, errmsg) )
+        std::cerr << "dnsviewer: " << errmsg << std::endl;
+}
+
+void HeadlessApp::slotError(const QString &value)
+{
+    failed_ = true;
+    std::cerr << "dnsviewer: " << value.toLocal8Bit().constData() << std::endl;
+}
+
+void HeadlessApp::slotDone()
+{
+    /* Stopped by a signal, at the end of a replay, or after an error */
+    log_.close();
+    store_.close();
+    QCoreApplication::quit();
+}
+
+int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    HeadlessApp app;
+
+    /* dnsviewer-cli (--interface <dev> ... | --replay <file> [--realtime])
+     *           [--output <file, - for stdout>] [options.h options] */
+    QStringList args(a.arguments());
+    Options opts;
+    parseOptions(args, opts);
+    std::string errmsg;
+    QStringList devs;
+    for (int i = 1; i + 1 < args.size(); i++)
+    {
+        if ( "--interface" == args.at(i) || "-i" == args.at(i) )
+            devs << args.at(++i);
+    }
+    if ( devs.isEmpty() && opts.replay.isEmpty() )
+    {
+        std::cerr << "usage: " << argv[0] << " (--interface <dev> ... | --replay <file> [--realtime])"
+            " [--filter <bpf>] [--output <file|->] [--stats-file <file>] ..." << std::endl;
+        return 2;
+    }
+    int i = args.indexOf("--output");
+    if ( i > 0 && i + 1 < args.size() && 
+            app.setOutput(args.at(i + 1).toLocal8Bit().constData(), opts.logPolicy, errmsg) )
+    {
+        std::cerr << errmsg << std::endl;
+        return 1;
+    }
+    if ( !opts.storeDir.isEmpty() && 
+            app.setStore(opts.storeDir.toLocal8Bit().constData(), opts.storeSegmentSecs, errmsg) )
+    {
+        std::cerr << errmsg << std::endl;
+        return 1;
+    }
+    app.setStatsFile(opts.statsFile);
+    applyCaptureOptions(opts, app.capture());
+    if ( opts.metricsPort && 
+            app.capture().startMetrics(opts.metricsAddr, opts.metricsPort, opts.metricsTop, errmsg) )
+    {
+        std::cerr << errmsg << std::endl;
+        return 1;
+    }
+    if ( app.installSignalHandlers(errmsg) )
+    {
+        std::cerr << errmsg << std::endl;
+        return 1;
+    }
+
+    if ( !opts.replay.isEmpty() )
+        app.startReplay(opts.replay, opts.filter, opts.realtime);
+    else
+        app.start(devs, opts.filter);
+    a.exec();
+    app.shutDown();
+    return app.exitCode();
+}
+
+}
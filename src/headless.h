@@ -0,0 +1,77 @@
+#ifndef __HEADLESS_H
+#define __HEADLESS_H
+
+#include <string>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+
+#include "capstats.h"
+#include "dnsquery.h"
+#include "querylog.h"
+
+class QSocketNotifier;
+
+namespace DNSView
+{
+
+class PCapThread;
+class NameTable;
+
+/* Runs the capture pipeline with QtCore only: queries go to the text log
+ * instead of a table. SIGTERM and SIGINT stop the capture and end the
+ * event loop, SIGHUP reopens the log after rotation. */
+class HeadlessApp : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessApp(QObject *parent = 0);
+    ~HeadlessApp();
+
+    int installSignalHandlers(std::string &errmsg);
+    PCapThread &capture();
+    int setOutput(const std::string &path, const LogPolicy &policy, std::string &errmsg);
+    int setStore(const std::string &dir, unsigned int segmentSecs, std::string &errmsg);
+    void setStatsFile(const QString &path);
+
+    void start(const QStringList &devs, const QString &filter);
+    void startReplay(const QString &path, const QString &filter, bool realtime);
+    /* Stops the capture thread, after the event loop has returned */
+    void shutDown();
+    int exitCode() const;
+
+public slots:
+    void slotDataReady(const QueryBatch &queries);
+    void slotAnswersReady(const AnswerBatch &answers);
+    void slotStats(const StatsSnapshot &snap);
+    void slotError(const QString &value);
+    void slotDone();
+    void slotSignal();
+
+signals:
+    void sigStartPoll(const QStringList &devs, const QString &filter);
+    void sigStartReplay(const QString &path, const QString &filter, bool realtime);
+    void sigStopPoll();
+    void sigQuit();
+
+private:
+    static void onSignal(int sig);
+    static int sigFds_[2];
+
+    QSharedPointer<PCapThread> spPCapThread_;
+    QSharedPointer<NameTable> spNames_;
+    QSharedPointer<QSocketNotifier> spSigNotifier_;
+    QueryLog log_;
+    QueryLog store_;
+    QString statsPath_;
+    bool live_, stopping_, failed_;
+    Histogram displayLatency_, resolverLatency_;
+};
+
+/* dnsviewer-cli, and dnsviewer --headless */
+int runHeadless(int argc, char *argv[]);
+
+}
+
+#endif
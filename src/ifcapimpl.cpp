@@ -33,18 +33,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <map>
 #include <vector>
 #include <string>
-#include <sstream>
-#include <QDateTime>
+#include <cstdio>
+#include <cstring>
 
 #include "dnsviewer.h"
-#ifdef _HAS_ARPA_INET_H
-#   include <arpa/inet.h>
-#elif defined(_HAS_WSOCK2_H)
-#   include <Winsock2.h>
-#else
-#   error no ntohs
-#endif
 #include "ifcapimpl.h"
+#include "nametable.h"
+#include "dnsparse.h"
 
 namespace DNSView
 {
@@ -52,93 +47,115 @@ namespace DNSView
 namespace
 {
 
-#ifdef _MSC_VER
-#   pragma pack(push,1)
-#endif
-struct nibbles
-{
-#ifdef _BIG_ENDIAN
-    IFCapImpl::u_char nib2:4;
-    IFCapImpl::u_char nib1:4;
-#else
-    IFCapImpl::u_char nib1:4;
-    IFCapImpl::u_char nib2:4;
-#endif
-}
-#ifdef __GNUC__
-    __attribute__( (packed) )
-#endif
-    ;
-#ifdef _MSC_VER
-#   pragma pack(pop)
-#endif
-
-struct ip_address
-{
-    IFCapImpl::u_char byte1;
-    IFCapImpl::u_char byte2;
-    IFCapImpl::u_char byte3;
-    IFCapImpl::u_char byte4;
+/* Link types as pcap_datalink() gives them and savefiles store them */
+enum
+{
+    LINK_NULL = 0,          /* BSD loopback, 4-byte address family */
+    LINK_ETHERNET = 1,
+    LINK_RAW = 12,          /* no link header, DLT_RAW */
+    LINK_RAW_OPENBSD = 14,
+    LINK_RAW_SAVEFILE = 101,
+    LINK_LOOP = 108,        /* OpenBSD loopback, the family in network order */
+    LINK_LINUX_SLL = 113,   /* Linux cooked capture, the "any" device */
+    LINK_IPV4 = 228,
+    LINK_IPV6 = 229,
+    LINK_LINUX_SLL2 = 276
 };
 
-/* ipv4 header */
-struct ip_header
-{
-    nibbles ver_ihl;
-    IFCapImpl::u_char  tos; 
-    IFCapImpl::u_short tlen;
-    IFCapImpl::u_short identification;
-    IFCapImpl::u_short flags_fo;
-    IFCapImpl::u_char  ttl;
-    IFCapImpl::u_char  proto;
-    IFCapImpl::u_short crc;
-    ip_address  saddr;
-    ip_address  daddr;
-    IFCapImpl::u_int   op_pad;
-};
+/* Matches DNS in IPv4 and IPv6, and every fragment that is not the first:
+ * those carry no ports, so they cannot be told apart before reassembly */
+const char * const DNS_TRAFFIC = 
+    "udp port 53 or tcp port 53 or (ip and ip[6:2] & 0x1fff != 0) or (ip6 and ip6[6] == 44)";
 
-/* ipv6 header */
-struct ipv6_header
+inline unsigned short get16(const unsigned char *p)
 {
-    nibbles ver_prio;
-    IFCapImpl::u_char  flow_lbl[3];
-    IFCapImpl::u_short len;
-    IFCapImpl::u_char  nexthdr;
-    IFCapImpl::u_char  hop_limit;
-    IFCapImpl::u_char  saddr[16];
-    IFCapImpl::u_char  daddr[16];
-};
+    return static_cast<unsigned short>(( p[0] << 8 ) | p[1]);
+}
 
+/* From the EtherType at typeAt, the payload starting at off, through any
+ * 802.1Q and 802.1ad tags to IPv4 or IPv6 */
+int etherPayload(const unsigned char *data, unsigned int len, unsigned int typeAt, 
+        unsigned int off, unsigned int &ipOffset)
+{
+    unsigned int type = get16(data + typeAt);
+    while ( 0x8100 == type || 0x88a8 == type || 0x9100 == type )
+    {
+        if ( len < off + 4 )
+            return FAIL_LINK;
+        type = get16(data + off + 2);
+        off += 4;
+    }
+    if ( 0x0800 != type && 0x86dd != type )
+        return FAIL_LINK;
+    ipOffset = off;
+    return FAIL_NONE;
+}
 
-struct udp_header
+int ethernetLink(const unsigned char *data, unsigned int len, unsigned int &ipOffset)
 {
-    IFCapImpl::u_short sport;          
-    IFCapImpl::u_short dport;     
-    IFCapImpl::u_short len;            
-    IFCapImpl::u_short crc;            
-};
+    if ( len < 14 )
+        return FAIL_LINK;
+    return etherPayload(data, len, 12, 14, ipOffset);
+}
 
-struct dns_header
+int sllLink(const unsigned char *data, unsigned int len, unsigned int &ipOffset)
 {
-    IFCapImpl::u_short id;
-    IFCapImpl::u_short flags;
-    IFCapImpl::u_short qrrc;
-    IFCapImpl::u_short arrc;
-    IFCapImpl::u_short aurrc;
-    IFCapImpl::u_short adrrc;
-};
+    if ( len < 16 )
+        return FAIL_LINK;
+    return etherPayload(data, len, 14, 16, ipOffset);
+}
 
+int sll2Link(const unsigned char *data, unsigned int len, unsigned int &ipOffset)
+{
+    if ( len < 20 )
+        return FAIL_LINK;
+    return etherPayload(data, len, 0, 20, ipOffset);
 }
 
-IFCapImpl::IFCapImpl()
+/* The address family is in the capturing host's byte order and its value
+ * for IPv6 differs by OS; the IP version nibble says enough */
+int loopbackLink(const unsigned char *, unsigned int len, unsigned int &ipOffset)
+{
+    if ( len < 4 )
+        return FAIL_LINK;
+    ipOffset = 4;
+    return FAIL_NONE;
+}
+
+int rawLink(const unsigned char *, unsigned int, unsigned int &ipOffset)
+{
+    ipOffset = 0;
+    return FAIL_NONE;
+}
+
+}
+
+std::string dnsFilter(int linkType, const std::string &filter)
+{
+    std::string expr = filter.empty() ? std::string(DNS_TRAFFIC) : 
+        "(" + filter + ") and (" + DNS_TRAFFIC + ")";
+    if ( LINK_ETHERNET != linkType )
+        return expr;
+
+    /* "vlan" moves every offset after it, so it goes last and the whole
+     * expression is repeated behind each tag */
+    return expr + " or (vlan and (" + expr + " or (vlan and (" + expr + "))))";
+}
+
+IFCapImpl::IFCapImpl() : pNames_(NULL), pLink_(&ethernetLink), linkType_(LINK_ETHERNET), seq_(0)
 {}
 
 IFCapImpl::~IFCapImpl() 
 {}
 
-int IFCapImpl::init(const std::string &dev, std::string &errmsg)
+int IFCapImpl::init(const std::string &dev, const std::string &filter, std::string &errmsg)
 {
-    return doInit(dev, errmsg);
+    counters_.reset();
+    seq_ = 0;
+    txns_.clear();
+    flows_.clear();
+    frags_.clear();
+    return doInit(dev, filter, errmsg);
 }
 
 void IFCapImpl::shutDown()
@@ -146,9 +163,42 @@ void IFCapImpl::shutDown()
     doShutDown();
 }
 
-unsigned long long IFCapImpl::getNBytes()
+void IFCapImpl::updateKernelStats()
 {
-    return nBytes_;
+    unsigned long long recv = 0, drop = 0, ifDrop = 0;
+    doGetStats(recv, drop, ifDrop);
+    counters_.kernRecv.set(recv);
+    counters_.kernDrop.set(drop);
+    counters_.kernIfDrop.set(ifDrop);
+}
+
+void IFCapImpl::getStats(CapStats &stats) const
+{
+    stats.load(counters_);
+}
+
+void IFCapImpl::setNameTable(NameTable *pNames)
+{
+    pNames_ = pNames;
+}
+
+void IFCapImpl::setTimeout(unsigned int timeoutMs)
+{
+    txns_.setTimeout(timeoutMs);
+}
+
+void IFCapImpl::expire(unsigned long long now, AnswerBatch &answers)
+{
+    txns_.expire(now, answers);
+    flows_.expire(now);
+    frags_.expire(now);
+    counters_.failures[FAIL_FRAGMENT].add(frags_.takeDropped());
+    counters_.failures[FAIL_FRAGMENT_ORPHAN].add(frags_.takeOrphans());
+}
+
+unsigned long long IFCapImpl::oldestPendingSeq() const
+{
+    return txns_.oldestSeq(seq_);
 }
 
 void IFCapImpl::getDeviceList(std::map<std::string, std::string>& devMap, std::string &errmsg)
@@ -156,78 +206,386 @@ void IFCapImpl::getDeviceList(std::map<std::string, std::string>& devMap, std::s
     doGetDeviceList(errmsg).swap(devMap);
 }
 
-int IFCapImpl::getNextPacket(std::string &pktStr)
+int IFCapImpl::getSelectableFd()
+{
+    return doGetSelectableFd();
+}
+
+int IFCapImpl::getNextPacket(QueryBatch &queries, AnswerBatch &answers)
 {
-    /* Parse the current packet */
     const u_char *pData;
-    u_int tv_sec;
-    int ret = doGetNextPkt(pData, tv_sec);
+    u_int tv_sec, tv_usec;
+    int ret = doGetNextPkt(pData, tv_sec, tv_usec);
     if ( 0 >= ret )
         return ret;
-    nBytes_ += ret;
-    pData += 14;
-    int proto, ver = reinterpret_cast<const nibbles*>(pData)->nib2;
-            
-    /* IPv6 */
-    if ( ver == 6 )
+    counters_.nBytes.add(ret);
+    counters_.nPackets.add(1);
+    parsePacket(pData, ret, tv_sec, tv_usec, queries, answers);
+    return ret;
+}
+
+namespace
+{
+
+struct DispatchCtx
+{
+    IFCapImpl *pImpl;
+    QueryBatch *pQueries;
+    AnswerBatch *pAnswers;
+};
+
+}
+
+int IFCapImpl::dispatch(int maxPkts, QueryBatch &queries, AnswerBatch &answers)
+{
+    /* Hand every ready packet (up to maxPkts) to the parser in one call */
+    DispatchCtx ctx = { this, &queries, &answers };
+    return doDispatch(maxPkts, &IFCapImpl::onPacket, &ctx);
+}
+
+void IFCapImpl::onPacket(void *user, const u_char *data, 
+        u_int caplen, u_int len, u_int tv_sec, u_int tv_usec)
+{
+    DispatchCtx *pCtx = static_cast<DispatchCtx*>(user);
+    IFCapImpl *pThis = pCtx->pImpl;
+    pThis->counters_.nBytes.add(caplen);
+    pThis->counters_.nPackets.add(1);
+    if ( caplen != len )
     {
-        const ipv6_header *pIP6Hdr = reinterpret_cast<const ipv6_header*>(pData);
-        pData += 40;
-        proto = pIP6Hdr->nexthdr;
-        while ( proto == 43 || proto == 44 || proto == 50 || 
-                            proto == 51 || proto == 60 )
-        {
-            std::cerr << "Got extension header " << proto << std::endl;
-            proto = *pData++;
-            pData += 7 + ( *pData * 8);
-        }
-    } /* IPv4 */
+        pThis->counters_.failures[FAIL_SNAPLEN].add(1);
+        return;
+    }
+    pThis->parsePacket(data, caplen, tv_sec, tv_usec, *pCtx->pQueries, *pCtx->pAnswers);
+}
+
+void IFCapImpl::deliver(void *user, const DecodedMsg &msg, const DecodedQuestion *questions)
+{
+    DispatchCtx *pCtx = static_cast<DispatchCtx*>(user);
+    if ( DecodedMsg::MESSAGE != msg.stage )
+        pCtx->pImpl->reassemble(msg, *pCtx->pQueries, *pCtx->pAnswers);
     else
+        pCtx->pImpl->commitMessage(msg, questions, *pCtx->pQueries, *pCtx->pAnswers);
+}
+
+void IFCapImpl::countPackets(void *user, const CapStats &counts)
+{
+    CapCounters &counters = static_cast<DispatchCtx*>(user)->pImpl->counters_;
+    counters.nPackets.add(counts.nPackets);
+    counters.nBytes.add(counts.nBytes);
+    for (int i = FAIL_NONE + 1; i < FAIL_COUNT; i++)
+        counters.failures[i].add(counts.failures[i]);
+}
+
+void IFCapImpl::parsePacket(const u_char *pData, u_int len, u_int tv_sec, u_int tv_usec, 
+        QueryBatch &queries, AnswerBatch &answers)
+{
+    questions_.clear();
+    DecodedMsg msg;
+    int reason = decodeMessage(pData, len, tv_sec, tv_usec, msg, questions_);
+    if ( FAIL_NONE == reason )
+        commitMessage(msg, questions_.empty() ? NULL : &questions_[0], queries, answers);
+    else if ( DECODE_PENDING == reason )
+        reassemble(msg, queries, answers);
+    else
+        counters_.failures[reason].add(1);
+}
+
+int IFCapImpl::setLinkType(int linkType, std::string &errmsg)
+{
+    switch ( linkType )
+    {
+    case LINK_ETHERNET: pLink_ = &ethernetLink; break;
+    case LINK_LINUX_SLL: pLink_ = &sllLink; break;
+    case LINK_LINUX_SLL2: pLink_ = &sll2Link; break;
+    case LINK_NULL:
+    case LINK_LOOP: pLink_ = &loopbackLink; break;
+    case LINK_RAW:
+    case LINK_RAW_OPENBSD:
+    case LINK_RAW_SAVEFILE:
+    case LINK_IPV4:
+    case LINK_IPV6: pLink_ = &rawLink; break;
+    default:
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "Unsupported link type %d", linkType);
+        errmsg = buf;
+        return -1;
+    }
+    linkType_ = linkType;
+    return 0;
+}
+
+int IFCapImpl::linkType() const
+{
+    return linkType_;
+}
+
+int IFCapImpl::decodeMessage(const u_char *pData, u_int len, u_int tv_sec, u_int tv_usec, 
+        DecodedMsg &msg, std::vector<DecodedQuestion> &questions) const
+{
+    /* The link header, then IP and UDP or TCP, all bounds checked */
+    u_int ipOffset;
+    int reason = pLink_(pData, len, ipOffset);
+    if ( FAIL_NONE != reason )
+        return reason;
+    IPPacket ip;
+    int status = parseIP(pData + ipOffset, len - ipOffset, ip);
+    msg.ts = tv_sec * 1000000ULL + tv_usec;
+    if ( PARSE_FRAGMENT == status )
+    {
+        msg.stage = DecodedMsg::IP_FRAGMENT;
+        msg.fragment = ip;
+        msg.nQuestions = 0;
+        return DECODE_PENDING;
+    }
+    if ( status )
+        return failureOf(status);
+    return decodeTransport(ip, msg, questions);
+}
+
+int IFCapImpl::decodeTransport(const IPPacket &ip, DecodedMsg &msg, 
+        std::vector<DecodedQuestion> &questions) const
+{
+    unsigned short sport, dport;
+    const u_char *payload;
+    size_t payloadLen;
+    if ( 17 == ip.proto )
+    {
+        UDPDatagram udp;
+        if ( parseUDP(ip.payload, ip.payloadLen, udp) )
+            return FAIL_TRUNCATED;
+        sport = udp.sport;
+        dport = udp.dport;
+        payload = udp.payload;
+        payloadLen = udp.payloadLen;
+    }
+    else if ( 6 == ip.proto )
+    {
+        if ( parseTCP(ip.payload, ip.payloadLen, msg.segment) )
+            return FAIL_TRUNCATED;
+        sport = msg.segment.sport;
+        dport = msg.segment.dport;
+        payload = NULL;
+        payloadLen = 0;
+    }
+    else
+        return FAIL_NOT_UDP;
+    if ( 53 != dport && 53 != sport )
+        return FAIL_NOT_DNS;
+
+    /* Transactions are keyed from the client's side */
+    msg.response = 53 == sport;
+    size_t addrLen = ip.ver == 6 ? 16 : 4;
+    std::memset(&msg.key, 0, sizeof(msg.key));
+    msg.key.ver = ip.ver;
+    std::memcpy(msg.key.client, msg.response ? ip.daddr : ip.saddr, addrLen);
+    std::memcpy(msg.key.server, msg.response ? ip.saddr : ip.daddr, addrLen);
+    msg.key.port = msg.response ? dport : sport;
+    msg.nQuestions = 0;
+    msg.firstQuestion = static_cast<unsigned int>(questions.size());
+    if ( 17 == ip.proto )
+    {
+        msg.stage = DecodedMsg::MESSAGE;
+        return decodeDNS(payload, payloadLen, msg, questions);
+    }
+
+    /* Segments are put back together in capture order by reassemble(), bare
+     * ACKs never reach it */
+    msg.stage = DecodedMsg::TCP_SEGMENT;
+    const int control = TCPSegment::SYN | TCPSegment::FIN | TCPSegment::RST;
+    return msg.segment.payloadLen || ( msg.segment.flags & control ) ? 
+        static_cast<int>(DECODE_PENDING) : FAIL_TCP_NO_DATA;
+}
+
+int IFCapImpl::decodeDNS(const u_char *data, size_t len, DecodedMsg &msg, 
+        std::vector<DecodedQuestion> &questions) const
+{
+    /* msg already holds the addresses, ports and time */
+    DNSParser parser;
+    if ( parser.init(data, len) )
+        return FAIL_TRUNCATED;
+    msg.key.txid = parser.header().id;
+    if ( msg.response )
+    {
+        if ( !parser.header().isResponse() )
+            return FAIL_NOT_RESPONSE;
+        decodeResponse(parser, msg.answer);
+        return FAIL_NONE;
+    }
+
+    /* One entry per question, names interned from their flattened form */
+    DNSQuestion question;
+    u_char wire[DNS_MAX_NAME];
+    size_t wireLen;
+    for (int i = 0; i < parser.header().qdcount; i++)
+    {
+        if ( parser.nextQuestion(question) || nameToWire(question.name, wire, wireLen) )
+            break;
+        DecodedQuestion decoded;
+        decoded.qtype = question.qtype;
+        decoded.nameId = pNames_->intern(wire, wireLen);
+        questions.push_back(decoded);
+        msg.nQuestions++;
+    }
+    return !msg.nQuestions && parser.header().qdcount ? FAIL_QUESTION : FAIL_NONE;
+}
+
+/* Decodes the messages a segment completes as if each came in a datagram */
+class IFCapImpl::TcpSink : public TcpMessageSink
+{
+public:
+    TcpSink(IFCapImpl &impl, const DecodedMsg &segment, QueryBatch &queries, 
+            AnswerBatch &answers) 
+        : impl_(impl), segment_(segment), queries_(queries), answers_(answers)
+    {}
+
+    virtual void onMessage(const unsigned char *data, size_t len)
+    {
+        DecodedMsg msg = segment_;
+        msg.stage = DecodedMsg::MESSAGE;
+        impl_.questions_.clear();
+        int reason = impl_.decodeDNS(data, len, msg, impl_.questions_);
+        if ( FAIL_NONE == reason )
+            impl_.commitMessage(msg, impl_.questions_.empty() ? NULL : &impl_.questions_[0], 
+                    queries_, answers_);
+        else
+            impl_.counters_.failures[reason].add(1);
+    }
+
+private:
+    IFCapImpl &impl_;
+    const DecodedMsg &segment_;
+    QueryBatch &queries_;
+    AnswerBatch &answers_;
+};
+
+void IFCapImpl::reassemble(const DecodedMsg &pending, QueryBatch &queries, AnswerBatch &answers)
+{
+    if ( DecodedMsg::TCP_SEGMENT == pending.stage )
+    {
+        reassembleTcp(pending, queries, answers);
+        return;
+    }
+
+    /* A fragment: once its datagram is whole it is decoded like a packet,
+     * as of the time of the fragment that completed it */
+    IPPacket ip;
+    int ret = frags_.add(pending.fragment, pending.ts, ip);
+    counters_.failures[FAIL_FRAGMENT].add(frags_.takeDropped());
+    counters_.failures[FAIL_FRAGMENT_ORPHAN].add(frags_.takeOrphans());
+    if ( FragmentTable::FRAGMENT_NOT_DNS == ret )
+        counters_.failures[FAIL_NOT_DNS].add(1);
+    if ( FragmentTable::FRAGMENT_COMPLETE != ret )
+        return;
+    DecodedMsg msg;
+    msg.ts = pending.ts;
+    questions_.clear();
+    int reason = decodeTransport(ip, msg, questions_);
+    if ( FAIL_NONE == reason )
+        commitMessage(msg, questions_.empty() ? NULL : &questions_[0], queries, answers);
+    else if ( DECODE_PENDING == reason )
+        reassembleTcp(msg, queries, answers);
+    else
+        counters_.failures[reason].add(1);
+}
+
+void IFCapImpl::reassembleTcp(const DecodedMsg &segment, QueryBatch &queries, AnswerBatch &answers)
+{
+    TcpFlowKey key;
+    key.ver = segment.key.ver;
+    std::memcpy(key.client, segment.key.client, sizeof(key.client));
+    std::memcpy(key.server, segment.key.server, sizeof(key.server));
+    key.port = segment.key.port;
+    key.fromServer = segment.response;
+    TcpSink sink(*this, segment, queries, answers);
+    switch ( flows_.add(key, segment.ts, segment.segment, sink) )
     {
-        const ip_header *pIPHdr = reinterpret_cast<const ip_header*>(pData);    
-        pData += pIPHdr->ver_ihl.nib1 * 4;
-        proto = pIPHdr->proto;
+    case TcpFlowTable::SEGMENT_NO_DATA:
+        counters_.failures[FAIL_TCP_NO_DATA].add(1);
+        break;
+    case TcpFlowTable::SEGMENT_RETRANSMIT:
+        counters_.failures[FAIL_TCP_RETRANSMIT].add(1);
+        break;
+    case TcpFlowTable::SEGMENT_GAP:
+        counters_.failures[FAIL_TCP_GAP].add(1);
+        break;
     }
-            
-    /* If this is UDP get the header */
-    if ( 17 == proto )
+}
+
+void IFCapImpl::commitMessage(const DecodedMsg &msg, const DecodedQuestion *questions, 
+        QueryBatch &queries, AnswerBatch &answers)
+{
+    /* Numbering and pairing depend on everything before, so this part runs
+     * in capture order */
+    counters_.nParsed.add(1);
+    if ( msg.response )
     {
-        const udp_header *pUDPHdr = reinterpret_cast<const udp_header*>(pData);
-        int destPort = ntohs(pUDPHdr->dport);
-        pData += sizeof(udp_header);
+        DNSAnswer answer = msg.answer;
+        if ( txns_.match(msg.key, msg.ts, answer) )
+            answers.push_back(answer);
+        return;
+    }
+    if ( !msg.nQuestions )
+        return;
+
+    DNSQuery query;
+    query.tv_sec = static_cast<unsigned int>(msg.ts / 1000000);
+    query.tv_usec = static_cast<unsigned int>(msg.ts % 1000000);
+    query.ver = msg.key.ver;
+    std::memcpy(query.saddr, msg.key.client, sizeof(query.saddr));
+    std::memcpy(query.daddr, msg.key.server, sizeof(query.daddr));
+    unsigned long long first = seq_;
+    for (unsigned int i = 0; i < msg.nQuestions; i++)
+    {
+        query.seq = seq_++;
+        query.qtype = questions[i].qtype;
+        query.nameId = questions[i].nameId;
+        queries.push_back(query);
+    }
+    txns_.add(msg.key, msg.ts, first, msg.nQuestions, answers);
+}
 
-        /* If this is DNS get the header */
-        if ( 53 == destPort )
+void IFCapImpl::decodeResponse(DNSParser &parser, DNSAnswer &answer) const
+{
+    std::memset(&answer, 0, sizeof(answer));
+    answer.status = DNSAnswer::ANSWERED;
+    answer.rcode = parser.header().rcode();
+    answer.ancount = parser.header().ancount;
+
+    /* Summarise the answer section: lowest TTL, first address or alias */
+    DNSQuestion question;
+    DNSRecord record;
+    int ret = 0;
+    for (int i = 0; !ret && i < parser.header().qdcount; i++)
+        ret = parser.nextQuestion(question);
+    for (int i = 0; !ret && i < parser.header().ancount; i++)
+    {
+        if ( ( ret = parser.nextRecord(record) ) )
+            break;
+        if ( !i || record.ttl < answer.ttl )
+            answer.ttl = record.ttl;
+        if ( 1 == record.type && 4 == record.rdlen && answer.kind != DNSAnswer::ADDR4 && 
+                answer.kind != DNSAnswer::ADDR6 )
+        {
+            answer.kind = DNSAnswer::ADDR4;
+            std::memcpy(answer.addr, record.rdata, 4);
+        }
+        else if ( 28 == record.type && 16 == record.rdlen && answer.kind != DNSAnswer::ADDR4 && 
+                answer.kind != DNSAnswer::ADDR6 )
+        {
+            answer.kind = DNSAnswer::ADDR6;
+            std::memcpy(answer.addr, record.rdata, 16);
+        }
+        else if ( 5 == record.type && answer.kind == DNSAnswer::NONE )
         {
-            const dns_header *pDNSHdr = reinterpret_cast<const dns_header*>(pData);
-            pData += sizeof(dns_header);
-
-            /* Get the time and build the display string */
-            QDateTime pktTime;
-            pktTime.setTime_t(tv_sec);
-            QDateTime local(pktTime.toLocalTime());
-            int qrrc = ntohs(pDNSHdr->qrrc);
-            std::ostringstream sstr;
-            sstr << ver;
-            pktStr = local.toString().toUtf8().constData() + std::string(": IPv") + sstr.str() + ": ";
-            for (int i = 0; i < qrrc; i++)
+            u_char wire[DNS_MAX_NAME];
+            size_t wireLen;
+            if ( !nameToWire(record.rdataName, wire, wireLen) )
             {
-                std::string name;
-                for(int j = 0; j < 5 && *pData; j++)
-                {
-                    u_char nbytes = *pData++;
-                    for (int k = 0; k < nbytes; k++, pData++)
-                        name += *pData;
-                    if (*pData)
-                        name += '.';
-                }
-                pktStr += name;
-                if ( i < qrrc - 1 )
-                    pktStr += "/";
+                answer.kind = DNSAnswer::CNAME;
+                answer.cnameId = pNames_->intern(wire, wireLen);
             }
         }
     }
-    return ret;
 }
 
 }
@@ -4,9 +4,51 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
+
+#include "capstats.h"
+#include "dnsparse.h"
+#include "dnsquery.h"
+#include "fragtable.h"
+#include "tcpflowtable.h"
+#include "txntable.h"
 
 namespace DNSView
 {
+
+class NameTable;
+class DNSParser;
+
+/* Kernel filter for a pcap link type: DNS over UDP and TCP, IPv4 and IPv6,
+ * the IP fragments it may come in and, on Ethernet, all of that inside one
+ * or two VLAN tags. A user expression narrows each of those. */
+std::string dnsFilter(int linkType, const std::string &filter);
+
+/* A DNS message decoded from a packet but not yet numbered or paired */
+struct DecodedMsg
+{
+    unsigned long long ts;      /* microseconds */
+    TxnKey key;                 /* from the client's side */
+    bool response;
+    unsigned short nQuestions;  /* queries: entries in the question list */
+    unsigned int firstQuestion;
+    DNSAnswer answer;           /* responses: summary, seq and latency unset */
+
+    /* Not a message yet: a TCP segment or an IP fragment that is put
+     * together in capture order on the dispatching thread. Both point into
+     * the packet. */
+    enum Stage { MESSAGE, TCP_SEGMENT, IP_FRAGMENT };
+    unsigned char stage;
+    TCPSegment segment;
+    IPPacket fragment;
+};
+
+struct DecodedQuestion
+{
+    unsigned short qtype;
+    unsigned int nameId;
+};
+
 class IFCapImpl
 {
 public:
@@ -15,26 +57,90 @@ public:
 
     void getDeviceList(std::map<std::string, std::string>& devMap, 
             std::string &errmsg);
-    int init(const std::string &dev, std::string &errmsg);
+    int init(const std::string &dev, const std::string &filter, std::string &errmsg);
     void shutDown();
 
-    unsigned long long getNBytes();
-    int getNextPacket(std::string &pktStr);
+    /* Refreshes the kernel counters, on the capturing thread */
+    void updateKernelStats();
+    /* Safe from any thread */
+    void getStats(CapStats &stats) const;
+    void setNameTable(NameTable *pNames);
+    void setTimeout(unsigned int timeoutMs);
+    int getSelectableFd();
+    int getNextPacket(QueryBatch &queries, AnswerBatch &answers);
+    /* Packets handled, 0 if none are ready, CAP_EOF at the end of a saved
+     * capture, any other negative value on error */
+    enum { CAP_EOF = -2 };
+    int dispatch(int maxPkts, QueryBatch &queries, AnswerBatch &answers);
+    /* Reports queries still unanswered after the timeout, now in microseconds */
+    void expire(unsigned long long now, AnswerBatch &answers);
+    /* Lowest DNSQuery::seq a later answer can still refer to */
+    unsigned long long oldestPendingSeq() const;
 
     typedef unsigned char u_char;
     typedef unsigned short u_short;
     typedef unsigned int u_int;
 
+    typedef void (*PktHandler)(void *user, const u_char *data, 
+            u_int caplen, u_int len, u_int tv_sec, u_int tv_usec);
 
 protected:
     
-    virtual int doInit(const std::string &dev, std::string errmsg) = 0;
+    virtual int doInit(const std::string &dev, const std::string &filter, 
+            std::string &errmsg) = 0;
     virtual std::map<std::string, std::string> doGetDeviceList(std::string &errmsg) = 0;
-    virtual int doGetNextPkt(const u_char* &data, u_int &tv_sec) = 0;
+    virtual int doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec) = 0;
+    virtual int doDispatch(int maxPkts, PktHandler handler, void *user) = 0;
+    virtual int doGetSelectableFd() = 0;
     virtual void doShutDown() = 0;
+    virtual void doGetStats(unsigned long long &recv, unsigned long long &drop, 
+            unsigned long long &ifDrop) = 0;
+
+    /* For subclasses that decode away from the dispatching thread. Decoding
+     * only touches the (thread-safe) NameTable; deliver() and countPackets()
+     * run on the dispatching thread with the user pointer doDispatch got.
+     * decodeMessage() returns FAIL_NONE or why the packet was not DNS, or
+     * DECODE_PENDING for a TCP segment or IP fragment deliver() reassembles;
+     * countPackets() adds the packet, byte and failure counts of counts. */
+    enum { DECODE_PENDING = FAIL_COUNT };
+    int decodeMessage(const u_char *pData, u_int len, u_int tv_sec, u_int tv_usec, 
+            DecodedMsg &msg, std::vector<DecodedQuestion> &questions) const;
+    static void deliver(void *user, const DecodedMsg &msg, const DecodedQuestion *questions);
+    static void countPackets(void *user, const CapStats &counts);
+
+    /* Picks the link-layer decoder for a pcap_datalink() value or the link
+     * type of a savefile, once per capture in doInit(). Ethernet until then. */
+    int setLinkType(int linkType, std::string &errmsg);
+    int linkType() const;
 
 private:
-    unsigned long long nBytes_;
+    class TcpSink;
+
+    typedef int (*LinkDecoder)(const u_char *data, u_int len, u_int &ipOffset);
+
+    static void onPacket(void *user, const u_char *data, 
+            u_int caplen, u_int len, u_int tv_sec, u_int tv_usec);
+    void parsePacket(const u_char *pData, u_int len, u_int tv_sec, u_int tv_usec, 
+            QueryBatch &queries, AnswerBatch &answers);
+    int decodeTransport(const IPPacket &ip, DecodedMsg &msg, 
+            std::vector<DecodedQuestion> &questions) const;
+    int decodeDNS(const u_char *data, size_t len, DecodedMsg &msg, 
+            std::vector<DecodedQuestion> &questions) const;
+    void decodeResponse(DNSParser &parser, DNSAnswer &answer) const;
+    void reassemble(const DecodedMsg &pending, QueryBatch &queries, AnswerBatch &answers);
+    void reassembleTcp(const DecodedMsg &segment, QueryBatch &queries, AnswerBatch &answers);
+    void commitMessage(const DecodedMsg &msg, const DecodedQuestion *questions, 
+            QueryBatch &queries, AnswerBatch &answers);
+
+    NameTable *pNames_;
+    TxnTable txns_;
+    TcpFlowTable flows_;
+    FragmentTable frags_;
+    LinkDecoder pLink_;
+    int linkType_;
+    std::vector<DecodedQuestion> questions_;
+    unsigned long long seq_;
+    CapCounters counters_;
 };
 
 }
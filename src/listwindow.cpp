@@ -29,62 +29,153 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <string>
 #include <QStringList>
-#include <QStringListModel>
+#include <QHeaderView>
 #include <QMessageBox>
 #include <QCloseEvent>
-#include <QTextStream>
 #include <QFile>
 #include <QFileDialog>
+#include <QLabel>
+#include <QListWidget>
+#include <QAction>
+#include <QMenu>
+#include <QDockWidget>
+#include <QHBoxLayout>
 #include "listwindow.h"
 #include "dnsviewer.h"
 #include "ui_listwindow.h" 
 #include "pcapthread.h"
+#include "querymodel.h"
+#include "nametable.h"
 
 namespace DNSView
 {
 
-class NonEditableQStringListModel : public QStringListModel
+namespace
 {
-public:
-    explicit NonEditableQStringListModel(QObject *parent = 0) : QStringListModel(parent) {}
-    ~NonEditableQStringListModel() {}
 
-    Qt::ItemFlags flags(const QModelIndex &index) const
+/* "p50 1.2 ms  p99 ..." for the stats panel */
+QString formatLatency(const Histogram &hist)
+{
+    if ( !hist.count() )
+        return QObject::tr("no samples");
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char * const LABELS[] = { "p50", "p90", "p99", "p99.9" };
+    QString text;
+    for (int i = 0; i < 4; i++)
+        text += QString("%1 %2 ms  ").arg(LABELS[i]).arg(hist.quantile(QUANTILES[i]) / 1000.0, 0, 'f', 2);
+    return text + QObject::tr("max %1 ms  (%2)").arg(hist.max() / 1000.0, 0, 'f', 2).arg(hist.count());
+}
+
+/* One list of the top panel; "~" marks counts the sketch may have overstated */
+QString formatTopList(const QString &title, const std::vector<TopEntry> &entries, 
+        unsigned long long total)
+{
+    QString text = title + "\n";
+    for (std::vector<TopEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
     {
-        return QStringListModel::flags(index) & ~Qt::ItemIsEditable;
+        text += QString("%1%2 %3%  %4\n").arg(it->error ? '~' : ' ').arg(it->count, 9)
+            .arg(total ? 100.0 * it->count / total : 0.0, 5, 'f', 1)
+            .arg(QString::fromStdString(it->label));
     }
-};
+    return text + "\n";
+}
+
+}
 
 ListWindow::ListWindow(QWidget *parent) :
     QMainWindow(parent),
     spUi_(new Ui::ListWindow),
     spPCapThread_(new PCapThread),
-    spStringListModel_(new NonEditableQStringListModel)
+    spNames_(new NameTable),
+    spQueryModel_(new QueryTableModel(spNames_.data())),
+    pStatsLabel_(new QLabel),
+    pDroppedLabel_(new QLabel),
+    pStatsPanel_(new QLabel),
+    pStatsDock_(new QDockWidget(tr("Statistics"))),
+    pTopDock_(new QDockWidget(tr("Top"))),
+    live_(false)
 {
     spUi_->setupUi(this);
+    spPCapThread_->setNameTable(spNames_.data());
+    spUi_->statusBar->addPermanentWidget(pStatsLabel_);
+    spUi_->statusBar->addPermanentWidget(pDroppedLabel_);
+    lastStats_ = StatsSnapshot();
+
+    /* Stats panel, docked at the bottom and toggled from the View menu */
+    pStatsPanel_->setFont(QFont("Monospace"));
+    pStatsPanel_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    pStatsPanel_->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+    pStatsDock_->setObjectName("statsDock_");
+    pStatsDock_->setWidget(pStatsPanel_);
+    addDockWidget(Qt::BottomDockWidgetArea, pStatsDock_);
+    pStatsDock_->hide();
+    QMenu *pViewMenu = spUi_->menuBar->addMenu(tr("&View"));
+    pViewMenu->addAction(pStatsDock_->toggleViewAction());
+
+    /* Top names, clients and types over each window, side by side on the right */
+    QWidget *pTopPanel = new QWidget;
+    QHBoxLayout *pTopLayout = new QHBoxLayout(pTopPanel);
+    for (int i = 0; i < 3; i++)
+    {
+        QLabel *pLabel = new QLabel;
+        pLabel->setFont(QFont("Monospace"));
+        pLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+        pLabel->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+        pTopLayout->addWidget(pLabel);
+        topLabels_.push_back(pLabel);
+    }
+    pTopDock_->setObjectName("topDock_");
+    pTopDock_->setWidget(pTopPanel);
+    addDockWidget(Qt::RightDockWidgetArea, pTopDock_);
+    pTopDock_->hide();
+    pViewMenu->addAction(pTopDock_->toggleViewAction());
+    spPCapThread_->setTopN(10);
+    QAction *pSaveStats = new QAction(tr("Save &Statistics..."), this);
+    spUi_->menu_File->insertAction(spUi_->actionQuit, pSaveStats);
+    connect(pSaveStats, SIGNAL(triggered()), this, SLOT(slotOnSaveStatsClick()));
 
     /* Set the view model and connect the signals/slots */
-    spUi_->listView_->setModel(spStringListModel_.data());
+    spUi_->tableView_->setModel(spQueryModel_.data());
+    spUi_->tableView_->verticalHeader()->hide();
+    spUi_->tableView_->horizontalHeader()->setStretchLastSection(true);
+    spUi_->tableView_->setSortingEnabled(true);
+    spUi_->tableView_->sortByColumn(QueryTableModel::COL_TIME, Qt::AscendingOrder);
     this->setWindowTitle(QApplication::translate("ListWindow", "DNSView " VERSION_MAJOR "." VERSION_MINOR, 0));
-    connect(spPCapThread_.data(), SIGNAL(sigDataReady(const QString&)), this, SLOT(slotDataReady(const QString&)));
+    connect(spPCapThread_.data(), SIGNAL(sigDataReady(const QueryBatch&)), this, SLOT(slotDataReady(const QueryBatch&)));
+    connect(spPCapThread_.data(), SIGNAL(sigAnswersReady(const AnswerBatch&)), this, SLOT(slotAnswersReady(const AnswerBatch&)));
     connect(spPCapThread_.data(), SIGNAL(sigError(const QString&)), this, SLOT(slotError(const QString&)));
     connect(spPCapThread_.data(), SIGNAL(sigDone()), this, SLOT(slotDone()));
     connect(spUi_->actionQuit, SIGNAL(triggered()), this, SLOT(close()));
     connect(this, SIGNAL(sigQuit()), spPCapThread_.data(), SLOT(slotQuit()));
-    connect(this, SIGNAL(sigStartPoll(const QString&)), spPCapThread_.data(), SLOT(slotStart(const QString&)));
+    connect(this, SIGNAL(sigStartPoll(const QStringList&, const QString&)), spPCapThread_.data(), SLOT(slotStart(const QStringList&, const QString&)));
+    connect(this, SIGNAL(sigStartReplay(const QString&, const QString&, bool)), 
+            spPCapThread_.data(), SLOT(slotStartReplay(const QString&, const QString&, bool)));
     connect(this, SIGNAL(sigStopPoll()), spPCapThread_.data(), SLOT(slotStop()));
     connect(spPCapThread_.data(), SIGNAL(sigkBps(double)), this, SLOT(slotKbps(double)));
+    connect(spPCapThread_.data(), SIGNAL(sigStats(const StatsSnapshot&)), 
+            this, SLOT(slotStats(const StatsSnapshot&)));
+    connect(spPCapThread_.data(), SIGNAL(sigTopN(const TopSnapshot&)), 
+            this, SLOT(slotTopN(const TopSnapshot&)));
+    connect(spPCapThread_.data(), SIGNAL(sigReplayDone(quint64, quint64, qint64)), 
+            this, SLOT(slotReplayDone(quint64, quint64, qint64)));
+    connect(spUi_->searchEdit_, SIGNAL(textChanged(const QString&)), this, SLOT(slotSearchChanged(const QString&)));
     connect(spUi_->startButton_, SIGNAL(clicked()), this, SLOT(slotOnStartClick()));
     connect(spUi_->stopButton_, SIGNAL(clicked()), this, SLOT(slotOnStopClick()));
     connect(spUi_->fileSelectButton_, SIGNAL(clicked()), this, SLOT(slotOnSaveFileClick()));
+    connect(spUi_->replaySelectButton_, SIGNAL(clicked()), this, SLOT(slotOnReplayFileClick()));
     
     /* Populate the device list */
     QStringList qlist(spPCapThread_->getDeviceList());
-    spUi_->comboBox_->insertItems(0, qlist);
+    spUi_->deviceList_->insertItems(0, qlist);
+    if ( spUi_->deviceList_->count() )
+        spUi_->deviceList_->setCurrentRow(0);
 
     /* Set the initial button state */
-    spUi_->comboBox_->setEnabled(true);
+    spUi_->deviceList_->setEnabled(true);
     spUi_->startButton_->setEnabled(true);
     spUi_->stopButton_->setEnabled(false);
 
@@ -94,12 +185,46 @@ ListWindow::ListWindow(QWidget *parent) :
 ListWindow::~ListWindow()
 {}
 
+void ListWindow::setOptions(const Options &opts)
+{
+    spUi_->filterEdit_->setText(opts.filter);
+    spUi_->replayEdit_->setText(opts.replay);
+    spUi_->realtimeCheck_->setChecked(opts.realtime);
+    applyCaptureOptions(opts, *spPCapThread_);
+    statsPath_ = opts.statsFile;
+    log_.setPolicy(opts.logPolicy);
+    if ( !opts.storeDir.isEmpty() )
+    {
+        /* Binary segments, cut every storeSegmentSecs and indexed when closed */
+        LogPolicy policy;
+        policy.binary = true;
+        policy.index = true;
+        policy.rotateSecs = opts.storeSegmentSecs;
+        store_.setPolicy(policy);
+        storeDir_ = opts.storeDir;
+    }
+    std::string errmsg;
+    if ( opts.metricsPort && spPCapThread_->startMetrics(opts.metricsAddr, opts.metricsPort, opts.metricsTop, errmsg) )
+        slotError(QString::fromStdString(errmsg));
+}
+
+void ListWindow::setRetention(int maxRows, int windowSecs)
+{
+    spQueryModel_->setRetention(maxRows, windowSecs);
+}
+
+void ListWindow::setTopN(int nTop)
+{
+    spPCapThread_->setTopN(nTop);
+    pTopDock_->toggleViewAction()->setEnabled(nTop > 0);
+}
+
 void ListWindow::closeEvent(QCloseEvent *event)
 {
     /* Emit the quit signal and wait for the thread */
     emit sigQuit();
-    qTStream_.flush();
-    qTStream_.setDevice(NULL);
+    log_.close();
+    store_.close();
     spPCapThread_->waitForThread();
     if (event)
         event->accept();
@@ -108,48 +233,96 @@ void ListWindow::closeEvent(QCloseEvent *event)
 void ListWindow::slotDone()
 {
     /* Set the button state and close the file if any */
-    spUi_->comboBox_->setEnabled(true);
+    spUi_->deviceList_->setEnabled(true);
     spUi_->startButton_->setEnabled(true);
     spUi_->stopButton_->setEnabled(false);
     spUi_->fileSaveEdit_->setEnabled(true);
     spUi_->fileSelectButton_->setEnabled(true);
-    if ( qTStream_.device() )
+    spUi_->filterEdit_->setEnabled(true);
+    spUi_->replayEdit_->setEnabled(true);
+    spUi_->replaySelectButton_->setEnabled(true);
+    spUi_->realtimeCheck_->setEnabled(true);
+    log_.close();
+    store_.close();
+}
+
+void ListWindow::slotDataReady(const QueryBatch &queries)
+{
+    /* Insert the batch of dns entries and log them to file */
+    quint64 dropped = spQueryModel_->dropped();
+    spQueryModel_->append(queries);
+    if ( spQueryModel_->dropped() != dropped )
+        pDroppedLabel_->setText(tr("History trimmed: %1 rows").arg(spQueryModel_->dropped()));
+    if ( spUi_->autoScroll_->isChecked() )
+        spUi_->tableView_->scrollToBottom();
+    if ( live_ )
     {
-        qTStream_.flush();
-        qTStream_.setDevice(NULL);
-        qFile_.close();
+        /* From the kernel's timestamp to the rows being in the model */
+        unsigned long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+        {
+            unsigned long long ts = it->tv_sec * 1000000ULL + it->tv_usec;
+            displayLatency_.record(now > ts ? now - ts : 0);
+        }
     }
+    log_.write(queries);
+    store_.write(queries);
 }
 
-void ListWindow::slotDataReady(const QString &value)
+void ListWindow::slotAnswersReady(const AnswerBatch &answers)
 {
-    /* Insert the dns entry and log to file */
-    spStringListModel_->insertRows(spStringListModel_->rowCount(), 1);
-    spStringListModel_->setData(spStringListModel_->index(spStringListModel_->rowCount() - 1), value);
-    if ( spUi_->autoScroll_->isChecked() )
-        spUi_->listView_->scrollTo(spStringListModel_->index(spStringListModel_->rowCount() - 1));
-    if ( qTStream_.device() )
-        qTStream_ << value << endl;
+    spQueryModel_->applyAnswers(answers);
+    log_.write(answers);
+    store_.write(answers);
+    for (AnswerBatch::const_iterator it = answers.begin(); it != answers.end(); ++it)
+    {
+        if ( DNSAnswer::ANSWERED == it->status )
+            resolverLatency_.record(it->latencyUs);
+    }
 }
 
 void ListWindow::slotOnStartClick()
 {
     /* Set the button state, clear the view, and open the file if one was given */
-    spUi_->comboBox_->setEnabled(false);
+    spUi_->deviceList_->setEnabled(false);
     spUi_->startButton_->setEnabled(false);
     spUi_->stopButton_->setEnabled(true);
     spUi_->fileSaveEdit_->setEnabled(false);
     spUi_->fileSelectButton_->setEnabled(false);
-    spStringListModel_->removeRows(0, spStringListModel_->rowCount() );
+    spUi_->filterEdit_->setEnabled(false);
+    spUi_->replayEdit_->setEnabled(false);
+    spUi_->replaySelectButton_->setEnabled(false);
+    spUi_->realtimeCheck_->setEnabled(false);
+    spQueryModel_->clear();
+    spNames_->clear();
+    pDroppedLabel_->clear();
+    live_ = spUi_->replayEdit_->text().isEmpty();
+    displayLatency_.clear();
+    resolverLatency_.clear();
     if ( !spUi_->fileSaveEdit_->text().isEmpty() )
     {
-        qFile_.setFileName(spUi_->fileSaveEdit_->text());
-        if ( !qFile_.open(QFile::WriteOnly | QFile::Append) )
-            slotError("Error opening file " + spUi_->fileSaveEdit_->text() );
-        else
-            qTStream_.setDevice(&qFile_);
+        std::string errmsg;
+        if ( log_.open(spUi_->fileSaveEdit_->text().toLocal8Bit().constData(), *spNames_, errmsg) )
+            slotError(QString::fromLocal8Bit(errmsg.c_str()));
+    }
+    if ( !storeDir_.isEmpty() )
+    {
+        std::string errmsg;
+        if ( store_.open(storeDir_.toLocal8Bit().constData(), *spNames_, errmsg) )
+            slotError(QString::fromLocal8Bit(errmsg.c_str()));
+    }
+    if ( !spUi_->replayEdit_->text().isEmpty() )
+        emit sigStartReplay(spUi_->replayEdit_->text(), spUi_->filterEdit_->text().trimmed(), 
+                spUi_->realtimeCheck_->isChecked() );
+    else
+    {
+        QStringList devs;
+        QList<QListWidgetItem*> items = spUi_->deviceList_->selectedItems();
+        for (QList<QListWidgetItem*>::iterator it = items.begin(); it != items.end(); ++it)
+            devs << (*it)->text();
+        emit sigStartPoll(devs, spUi_->filterEdit_->text().trimmed() );
     }
-    emit sigStartPoll(spUi_->comboBox_->currentText() );
 }
 
 void ListWindow::slotKbps(double value)
@@ -158,6 +331,87 @@ void ListWindow::slotKbps(double value)
     spUi_->KbpsLabel_->setText(str);
 }
 
+void ListWindow::slotStats(const StatsSnapshot &snap)
+{
+    /* Lost packets are shown in red so they cannot go unnoticed */
+    const CapStats &totals = snap.totals;
+    lastStats_ = snap;
+    std::string errmsg;
+    if ( log_.takeError(errmsg) )
+        slotError(QString::fromLocal8Bit(errmsg.c_str()));
+    if ( store_.takeError(errmsg) )
+        slotError(QString::fromLocal8Bit(errmsg.c_str()));
+    pStatsLabel_->setText(tr("Kernel: %1 passed, %2 dropped  Userspace: %3 read, %4 parsed")
+            .arg(totals.kernRecv).arg(totals.kernDrop + totals.kernIfDrop)
+            .arg(totals.nPackets).arg(totals.nParsed));
+    pStatsLabel_->setStyleSheet(totals.kernDrop + totals.kernIfDrop ? "QLabel { color: red; }" : "");
+
+    QString failures;
+    for (int i = FAIL_NONE + 1; i < FAIL_COUNT; i++)
+    {
+        if ( totals.failures[i] )
+            failures += QString("%1 %2  ").arg(failureName(i)).arg(totals.failures[i]);
+    }
+    pStatsPanel_->setText(tr(
+            "Kernel          %1 received, %2 dropped (buffer), %3 dropped (interface)\n"
+            "Userspace       %4 packets (%5/s), %6 DNS (%7/s), %8 kbit/s\n"
+            "Queue           %9 batches waiting\n")
+            .arg(totals.kernRecv).arg(totals.kernDrop).arg(totals.kernIfDrop)
+            .arg(totals.nPackets).arg(snap.pktRate, 0, 'f', 0).arg(totals.nParsed)
+            .arg(snap.dnsRate, 0, 'f', 0).arg(snap.kBps, 0, 'f', 1).arg(snap.queueDepth) + 
+            tr("Not DNS         %1\n").arg(failures.isEmpty() ? tr("none") : failures) + 
+            tr("To display      %1\n").arg(live_ ? formatLatency(displayLatency_) : tr("live only")) + 
+            tr("Resolver        %1").arg(formatLatency(resolverLatency_)));
+    if ( !statsPath_.isEmpty() )
+        writeStats(statsPath_);
+}
+
+void ListWindow::slotSearchChanged(const QString &text)
+{
+    /* Applied on every keystroke, a term that does not parse keeps the last filter */
+    QString errmsg;
+    if ( spQueryModel_->setFilter(text, errmsg) )
+    {
+        spUi_->searchEdit_->setStyleSheet("QLineEdit { color: red; }");
+        spUi_->searchEdit_->setToolTip(errmsg);
+        return;
+    }
+    spUi_->searchEdit_->setStyleSheet("");
+    spUi_->searchEdit_->setToolTip(tr("Rows matching all terms: text in the name, *.domain, type:AAAA, client:10.0.0.1"));
+}
+
+void ListWindow::slotTopN(const TopSnapshot &top)
+{
+    /* Counted on the capture thread, only laid out here and only when shown */
+    if ( !pTopDock_->isVisible() )
+        return;
+    for (size_t i = 0; i < top.windows.size() && i < topLabels_.size(); i++)
+    {
+        const TopWindow &window = top.windows[i];
+        QString span = window.seconds < 60 ? tr("%1 s").arg(window.seconds) : tr("%1 min").arg(window.seconds / 60);
+        topLabels_[i]->setText(tr("Last %1: %2 queries\n\n").arg(span).arg(window.queries) + 
+                formatTopList(tr("Names"), window.names, window.queries) + 
+                formatTopList(tr("Clients"), window.clients, window.queries) + 
+                formatTopList(tr("Types"), window.qtypes, window.queries) + 
+                formatTopList(tr("Responses"), window.rcodes, window.answers));
+    }
+}
+
+void ListWindow::slotOnSaveStatsClick()
+{
+    QString saveName = QFileDialog::getSaveFileName(this, tr("Save Statistics"), QString(), 
+        tr("JSON (*.json);;All Files(*.*)"));
+    if ( !saveName.isEmpty() )
+        writeStats(saveName);
+}
+
+void ListWindow::writeStats(const QString &path)
+{
+    std::string errmsg;
+    if ( writeStatsJson(path.toLocal8Bit().constData(), lastStats_, displayLatency_, resolverLatency_, errmsg) )
+        spUi_->statusBar->showMessage(QString::fromLocal8Bit(errmsg.c_str()));
+}
+
 void ListWindow::slotOnStopClick()
 {
     emit sigStopPoll();
@@ -165,11 +419,28 @@ void ListWindow::slotOnStopClick()
 
 void ListWindow::slotOnSaveFileClick()
 {
-     QString saveName = QFileDialog::getSaveFileName(this, tr("Save File"), QString(), tr("All Files(*.*)"), 
+     QString saveName = QFileDialog::getSaveFileName(this, tr("Save File"), QString(), 
+         tr("All Files(*.*);;Binary DNS Logs (*.dnsl)"), 
          0, QFileDialog::DontConfirmOverwrite);
      spUi_->fileSaveEdit_->setText(saveName);
 }
 
+void ListWindow::slotOnReplayFileClick()
+{
+     QString openName = QFileDialog::getOpenFileName(this, tr("Open Capture"), QString(), 
+         tr("Captures (*.pcap *.pcapng *.cap *.dnsl);;All Files(*.*)"));
+     if ( !openName.isEmpty() )
+         spUi_->replayEdit_->setText(openName);
+}
+
+void ListWindow::slotReplayDone(quint64 nPackets, quint64 nBytes, qint64 elapsedMs)
+{
+    double secs = qMax<qint64>(elapsedMs, 1) / 1000.0;
+    spUi_->statusBar->showMessage(tr("Replayed %1 packets in %2 s: %3 packets/s, %4 MB/s")
+            .arg(nPackets).arg(secs, 0, 'f', 2).arg(nPackets / secs, 0, 'f', 0)
+            .arg(nBytes / secs / ( 1024 * 1024 ), 0, 'f', 1));
+}
+
 void ListWindow::slotError(const QString &value)
 {
     QMessageBox::information(this, tr("DNSViewer"),
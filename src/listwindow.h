@@ -3,8 +3,17 @@
 
 #include <QMainWindow>
 #include <QSharedPointer>
-#include <QFile>
-#include <QTextStream>
+
+#include <vector>
+
+#include "capstats.h"
+#include "dnsquery.h"
+#include "options.h"
+#include "querylog.h"
+#include "topn.h"
+
+class QLabel;
+class QDockWidget;
 
 ;
 namespace Ui {
@@ -14,8 +23,9 @@ class ListWindow;
 namespace DNSView
 {
 
-class NonEditableQStringListModel;
+class QueryTableModel;
 class PCapThread;
+class NameTable;
 
 class ListWindow : public QMainWindow
 {
@@ -25,29 +35,54 @@ public:
     explicit ListWindow(QWidget *parent = 0);
     ~ListWindow();
 
+    void setOptions(const Options &opts);
+    void setRetention(int maxRows, int windowSecs);
+    void setTopN(int nTop);
+
 protected:
     void closeEvent(QCloseEvent *event);
 
 public slots:
-    void slotDataReady(const QString &value);
+    void slotDataReady(const QueryBatch &queries);
+    void slotAnswersReady(const AnswerBatch &answers);
     void slotError(const QString &value);
     void slotOnStartClick();
     void slotOnStopClick();
     void slotOnSaveFileClick();
+    void slotOnReplayFileClick();
+    void slotReplayDone(quint64 nPackets, quint64 nBytes, qint64 elapsedMs);
     void slotDone();
     void slotKbps(double value);
+    void slotStats(const StatsSnapshot &snap);
+    void slotTopN(const TopSnapshot &top);
+    void slotSearchChanged(const QString &text);
+    void slotOnSaveStatsClick();
 
 signals:
-    void sigStartPoll(const QString &dev);
+    void sigStartPoll(const QStringList &devs, const QString &filter);
+    void sigStartReplay(const QString &path, const QString &filter, bool realtime);
     void sigStopPoll();
     void sigQuit();
 
 private:
     QSharedPointer<Ui::ListWindow> spUi_;
     QSharedPointer<PCapThread> spPCapThread_;
-    QSharedPointer<NonEditableQStringListModel> spStringListModel_;
-    QFile qFile_;
-    QTextStream qTStream_;
+    QSharedPointer<NameTable> spNames_;
+    QSharedPointer<QueryTableModel> spQueryModel_;
+    void writeStats(const QString &path);
+
+    QLabel *pStatsLabel_, *pDroppedLabel_, *pStatsPanel_;
+    QDockWidget *pStatsDock_, *pTopDock_;
+    std::vector<QLabel*> topLabels_;    /* one per window */
+    QueryLog log_;
+    QueryLog store_;            /* searchable history, kept beside the save file */
+    QString storeDir_;
+
+    /* Capture to display only means something for live captures */
+    bool live_;
+    Histogram displayLatency_, resolverLatency_;
+    StatsSnapshot lastStats_;
+    QString statsPath_;         /* rewritten on every update when set */
 };
 
 }
@@ -28,15 +28,42 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstring>
 #include "listwindow.h"
+#include "headless.h"
 #include <QApplication>
 #include <QThread>
+#include <QStringList>
 
 int main(int argc, char *argv[])
 {
+    /* No display needed: the same capture without the widgets */
+    for (int i = 1; i < argc; i++)
+    {
+        if ( !std::strcmp(argv[i], "--headless") )
+            return DNSView::runHeadless(argc, argv);
+    }
+
     QApplication a(argc, argv);
     DNSView::ListWindow w;
+
+    /* dnsviewer [options.h options] [--max-rows <rows, 0 = unlimited>]
+     *           [--window <seconds>] [--top <rows in the top panel, 0 = off>] */
+    QStringList args(a.arguments());
+    DNSView::Options opts;
+    DNSView::parseOptions(args, opts);
+    w.setOptions(opts);
+    int i, maxRows = 1000000, window = 0;
+    if ( ( i = args.indexOf("--max-rows") ) > 0 && i + 1 < args.size() )
+        maxRows = args.at(i + 1).toInt();
+    if ( ( i = args.indexOf("--window") ) > 0 && i + 1 < args.size() )
+        window = args.at(i + 1).toInt();
+    w.setRetention(maxRows, window);
+    if ( ( i = args.indexOf("--top") ) > 0 && i + 1 < args.size() )
+        w.setTopN(args.at(i + 1).toInt());
     w.show();
+    if ( !opts.replay.isEmpty() )
+        w.slotOnStartClick();
 
     return a.exec();
 }
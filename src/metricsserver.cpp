@@ -0,0 +1,303 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#   include <sys/socket.h>
+#   include <sys/types.h>
+#   include <netdb.h>
+#   include <poll.h>
+#   include <unistd.h>
+#endif
+
+#include "metricsserver.h"
+#include "dnsparse.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+/* How often the accept loop looks at stop_, and how long a client may take */
+const int ACCEPT_POLL_MS = 200;
+const int CLIENT_TIMEOUT_MS = 2000;
+const size_t REQUEST_MAX = 8192;
+
+void appendHeader(std::string &out, const char *name, const char *type, const char *help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+/* name{label="value"} n, with the value escaped as the format requires */
+void appendSample(std::string &out, const char *name, const char *labels, 
+        const std::string &value, unsigned long long n)
+{
+    out += name;
+    if ( labels )
+    {
+        out += '{';
+        out += labels;
+        out += "=\"";
+        for (std::string::const_iterator it = value.begin(); it != value.end(); ++it)
+        {
+            if ( '\\' == *it || '"' == *it )
+                out += '\\';
+            if ( '\n' == *it )
+                out += "\\n";
+            else
+                out += *it;
+        }
+        out += "\"}";
+    }
+    char buf[32];
+    int len = std::snprintf(buf, sizeof(buf), " %llu\n", n);
+    out.append(buf, len);
+}
+
+void appendCounter(std::string &out, const char *name, const char *type, const char *help, 
+        unsigned long long n)
+{
+    appendHeader(out, name, type, help);
+    appendSample(out, name, NULL, std::string(), n);
+}
+
+}
+
+MetricsServer::MetricsServer() : listenFd_(-1), stop_(false)
+{}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+MetricsSnapshot &MetricsServer::writeBuffer()
+{
+    return snapshots_.writeBuffer();
+}
+
+void MetricsServer::publish()
+{
+    snapshots_.publish();
+}
+
+#ifndef _WIN32
+
+int MetricsServer::start(const std::string &addr, unsigned short port, std::string &errmsg)
+{
+    stop();
+    addrinfo hints, *pAddrs = NULL;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+    char service[8];
+    std::snprintf(service, sizeof(service), "%u", port);
+    int ret = getaddrinfo(addr.c_str(), service, &hints, &pAddrs);
+    if ( ret )
+    {
+        errmsg = "Metrics address " + addr + ": " + gai_strerror(ret);
+        return -1;
+    }
+    listenFd_ = socket(pAddrs->ai_family, pAddrs->ai_socktype, pAddrs->ai_protocol);
+    int on = 1;
+    if ( -1 == listenFd_ || 
+            setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) || 
+            bind(listenFd_, pAddrs->ai_addr, pAddrs->ai_addrlen) || 
+            listen(listenFd_, 16) )
+    {
+        errmsg = std::string("Metrics port ") + service + ": " + std::strerror(errno);
+        freeaddrinfo(pAddrs);
+        if ( -1 != listenFd_ )
+            close(listenFd_);
+        listenFd_ = -1;
+        return -1;
+    }
+    freeaddrinfo(pAddrs);
+    stop_ = false;
+    thread_ = std::thread(&MetricsServer::run, this);
+    return 0;
+}
+
+void MetricsServer::stop()
+{
+    stop_ = true;
+    if ( thread_.joinable() )
+        thread_.join();
+    if ( -1 != listenFd_ )
+        close(listenFd_);
+    listenFd_ = -1;
+}
+
+void MetricsServer::run()
+{
+    /* One client at a time, this is for a scraper every few seconds */
+    while ( !stop_.load(std::memory_order_relaxed) )
+    {
+        pollfd pfd = { listenFd_, POLLIN, 0 };
+        if ( 1 != poll(&pfd, 1, ACCEPT_POLL_MS) )
+            continue;
+        int fd = accept(listenFd_, NULL, NULL);
+        if ( -1 == fd )
+            continue;
+        serve(fd);
+        close(fd);
+    }
+}
+
+void MetricsServer::serve(int fd)
+{
+    /* Read up to the end of the request head, then answer and close */
+    char request[REQUEST_MAX];
+    size_t len = 0;
+    while ( len < sizeof(request) - 1 )
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if ( 1 != poll(&pfd, 1, CLIENT_TIMEOUT_MS) )
+            return;
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if ( 0 >= n )
+            return;
+        len += n;
+        request[len] = '\0';
+        if ( std::strstr(request, "\r\n\r\n") || std::strstr(request, "\n\n") )
+            break;
+    }
+
+    const char *status = "200 OK";
+    if ( std::strncmp(request, "GET /metrics", 12) || ( ' ' != request[12] && '?' != request[12] ) )
+    {
+        status = "404 Not Found";
+        body_ = "Metrics are at /metrics\n";
+    }
+    else
+        format(snapshots_.read(), body_);
+
+    char head[160];
+    int headLen = std::snprintf(head, sizeof(head), "HTTP/1.0 %s\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: %lu\r\nConnection: close\r\n\r\n", status, 
+            static_cast<unsigned long>(body_.size()));
+    response_.assign(head, headLen);
+    response_ += body_;
+    for (size_t sent = 0; sent < response_.size(); )
+    {
+        pollfd pfd = { fd, POLLOUT, 0 };
+        if ( 1 != poll(&pfd, 1, CLIENT_TIMEOUT_MS) )
+            return;
+        ssize_t n = send(fd, response_.data() + sent, response_.size() - sent, MSG_NOSIGNAL);
+        if ( 0 >= n )
+            return;
+        sent += n;
+    }
+}
+
+#else
+
+int MetricsServer::start(const std::string &, unsigned short, std::string &errmsg)
+{
+    errmsg = "The metrics endpoint is not available on Windows";
+    return -1;
+}
+
+void MetricsServer::stop()
+{}
+
+void MetricsServer::run()
+{}
+
+void MetricsServer::serve(int)
+{}
+
+#endif
+
+void MetricsServer::format(const MetricsSnapshot &snap, std::string &out) const
+{
+    const CapStats &totals = snap.stats.totals;
+    out.clear();
+    char uptime[64];
+    std::snprintf(uptime, sizeof(uptime), "dnsviewer_uptime_seconds %.3f\n", snap.stats.seconds);
+    appendHeader(out, "dnsviewer_uptime_seconds", "gauge", "Seconds since the capture started.");
+    out += uptime;
+    appendCounter(out, "dnsviewer_packets_total", "counter", "Packets handed to userspace.", 
+            totals.nPackets);
+    appendCounter(out, "dnsviewer_bytes_total", "counter", "Bytes of the packets handed to userspace.", 
+            totals.nBytes);
+    appendCounter(out, "dnsviewer_dns_messages_total", "counter", "Packets decoded as DNS messages.", 
+            totals.nParsed);
+    appendCounter(out, "dnsviewer_kernel_received_total", "counter", 
+            "Packets accepted by the kernel filter.", totals.kernRecv);
+
+    appendHeader(out, "dnsviewer_kernel_dropped_total", "counter", 
+            "Packets the kernel or the interface dropped before capture.");
+    appendSample(out, "dnsviewer_kernel_dropped_total", "where", "buffer", totals.kernDrop);
+    appendSample(out, "dnsviewer_kernel_dropped_total", "where", "interface", totals.kernIfDrop);
+
+    appendHeader(out, "dnsviewer_parse_failures_total", "counter", 
+            "Packets not decoded as DNS, by reason.");
+    for (int i = FAIL_NONE + 1; i < FAIL_COUNT; i++)
+        appendSample(out, "dnsviewer_parse_failures_total", "reason", failureName(i), totals.failures[i]);
+
+    appendCounter(out, "dnsviewer_queue_depth", "gauge", 
+            "Capture batches waiting to be merged.", snap.stats.queueDepth);
+
+    appendHeader(out, "dnsviewer_queries_total", "counter", "Questions seen, by query type.");
+    char typeBuf[16];
+    for (size_t i = 0; i < snap.qtypes.size(); i++)
+    {
+        const char *name = qtypeName(snap.qtypes[i].first);
+        if ( !name )
+        {
+            std::snprintf(typeBuf, sizeof(typeBuf), "TYPE%u", snap.qtypes[i].first);
+            name = typeBuf;
+        }
+        appendSample(out, "dnsviewer_queries_total", "qtype", name, snap.qtypes[i].second);
+    }
+
+    appendHeader(out, "dnsviewer_top_name_queries", "gauge", 
+            "Questions for the most queried names since the capture started.");
+    for (size_t i = 0; i < snap.topNames.size(); i++)
+        appendSample(out, "dnsviewer_top_name_queries", "name", snap.topNames[i].first, 
+                snap.topNames[i].second);
+}
+
+}
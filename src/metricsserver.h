@@ -0,0 +1,58 @@
+#ifndef __METRICSSERVER_H
+#define __METRICSSERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "capstats.h"
+#include "triplebuffer.h"
+
+namespace DNSView
+{
+
+/* What a scrape reports, refreshed by the capture thread */
+struct MetricsSnapshot
+{
+    StatsSnapshot stats;
+    std::vector<std::pair<unsigned short, unsigned long long> > qtypes;
+    std::vector<std::pair<std::string, unsigned long long> > topNames;    /* busiest first */
+};
+
+/* Serves GET /metrics in the Prometheus text format from its own thread.
+ * A scrape only reads the last published snapshot, so a slow client never
+ * holds up capture. */
+class MetricsServer
+{
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    /* Listens on addr ("127.0.0.1", "::1", "0.0.0.0", ...) and port */
+    int start(const std::string &addr, unsigned short port, std::string &errmsg);
+    void stop();
+
+    /* One producer: fill writeBuffer() in completely, then publish() */
+    MetricsSnapshot &writeBuffer();
+    void publish();
+
+private:
+    MetricsServer(const MetricsServer&);
+    MetricsServer &operator=(const MetricsServer&);
+
+    void run();
+    void serve(int fd);
+    void format(const MetricsSnapshot &snap, std::string &out) const;
+
+    int listenFd_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+    TripleBuffer<MetricsSnapshot> snapshots_;
+    std::string body_, response_;   /* reused by the server thread */
+};
+
+}
+
+#endif
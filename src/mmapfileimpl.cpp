@@ -0,0 +1,293 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#include "dnsviewer.h"
+#include "pcap.h"
+#include "mmapfileimpl.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+/* Classic pcap file and record headers, read in place */
+const size_t FILE_HDR_LEN = 24;
+const size_t REC_HDR_LEN = 16;
+const unsigned int MAGIC_USEC = 0xa1b2c3d4;
+const unsigned int MAGIC_NSEC = 0xa1b23c4d;
+const unsigned int LINKTYPE_RAW = 101;     /* DLT_RAW in a savefile */
+
+/* Consumed pages are handed back to the kernel in steps of this size */
+const size_t RELEASE_STEP = 64 * 1024 * 1024;
+
+inline unsigned int read32(const u_char *p, bool swapped)
+{
+    unsigned int v;
+    std::memcpy(&v, p, sizeof(v));
+    if ( swapped )
+        v = ( v >> 24 ) | ( ( v >> 8 ) & 0xff00 ) | ( ( v << 8 ) & 0xff0000 ) | ( v << 24 );
+    return v;
+}
+
+}
+
+MMapFileImpl::MMapFileImpl() : IFCapImpl(), mapLen_(0), offset_(0), hugePages_(false), 
+    pMap_(NULL), released_(0), swapped_(false), nanos_(false), snapLen_(0), 
+    pDeadH_(NULL), pProg_(NULL)
+{}
+
+MMapFileImpl::~MMapFileImpl() 
+{
+    doShutDown();
+}
+
+void MMapFileImpl::setHugePages(bool hugePages)
+{
+    hugePages_ = hugePages;
+}
+
+int MMapFileImpl::doInit(const std::string &dev, const std::string &filter, 
+        std::string &errmsg)
+{
+    doShutDown();
+    if ( mapFile(dev, errmsg) || readHeader(errmsg) || setFilter(filter, errmsg) )
+    {
+        doShutDown();
+        return -1;
+    }
+    return 0;
+}
+
+int MMapFileImpl::mapFile(const std::string &path, std::string &errmsg)
+{
+#ifdef _WIN32
+    (void)path;
+    errmsg = "Memory-mapped replay is not supported on this platform";
+    return -1;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if ( -1 == fd )
+    {
+        errmsg = std::strerror(errno);
+        return -1;
+    }
+    struct stat st;
+    if ( -1 == fstat(fd, &st) || st.st_size < static_cast<off_t>(FILE_HDR_LEN) )
+    {
+        errmsg = "Not a pcap file";
+        close(fd);
+        return -1;
+    }
+    mapLen_ = static_cast<size_t>(st.st_size);
+    void *pMap = mmap(NULL, mapLen_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == pMap )
+    {
+        errmsg = std::strerror(errno);
+        mapLen_ = 0;
+        return -1;
+    }
+    pMap_ = static_cast<const u_char*>(pMap);
+
+    /* One pass front to back: aggressive readahead, pages freed behind us */
+    madvise(pMap, mapLen_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if ( hugePages_ )
+        madvise(pMap, mapLen_, MADV_HUGEPAGE);
+#endif
+    return 0;
+#endif
+}
+
+int MMapFileImpl::readHeader(std::string &errmsg)
+{
+    unsigned int magic = read32(pMap_, false);
+    swapped_ = false;
+    if ( magic != MAGIC_USEC && magic != MAGIC_NSEC )
+    {
+        swapped_ = true;
+        magic = read32(pMap_, true);
+    }
+    if ( magic != MAGIC_USEC && magic != MAGIC_NSEC )
+    {
+        errmsg = "Not a classic pcap file";
+        return -1;
+    }
+    nanos_ = magic == MAGIC_NSEC;
+    snapLen_ = read32(pMap_ + 16, swapped_);
+    /* The link type is the low 16 bits, the rest says whether frames end in an FCS */
+    if ( setLinkType(static_cast<int>(read32(pMap_ + 20, swapped_) & 0xffff), errmsg) )
+        return -1;
+    offset_ = released_ = FILE_HDR_LEN;
+    return 0;
+}
+
+int MMapFileImpl::setFilter(const std::string &filter, std::string &errmsg)
+{
+    /* The parser only takes DNS anyway, so the BPF program is only needed
+     * for a user expression */
+    if ( filter.empty() )
+        return 0;
+    std::string expr = dnsFilter(linkType(), filter);
+    int dlt = LINKTYPE_RAW == static_cast<unsigned int>(linkType()) ? DLT_RAW : linkType();
+    pDeadH_ = pcap_open_dead(dlt, snapLen_ ? snapLen_ : 65535);
+    pProg_ = new bpf_program;
+    if ( !pDeadH_ || -1 == pcap_compile(pDeadH_, pProg_, expr.c_str(), 1, PCAP_NETMASK_UNKNOWN) )
+    {
+        errmsg = std::string("Bad filter: ") + ( pDeadH_ ? pcap_geterr(pDeadH_) : "" );
+        delete pProg_;
+        pProg_ = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+bool MMapFileImpl::nextRecord(size_t &offset, const u_char* &data, u_int &caplen, u_int &len, 
+        u_int &tv_sec, u_int &tv_usec) const
+{
+    /* A short or cut-off last record ends the file like a clean EOF */
+    if ( mapLen_ - offset < REC_HDR_LEN )
+        return false;
+    const u_char *hdr = pMap_ + offset;
+    caplen = read32(hdr + 8, swapped_);
+    if ( caplen > mapLen_ - offset - REC_HDR_LEN )
+        return false;
+    tv_sec = read32(hdr, swapped_);
+    tv_usec = read32(hdr + 4, swapped_);
+    if ( nanos_ )
+        tv_usec /= 1000;
+    len = read32(hdr + 12, swapped_);
+    data = hdr + REC_HDR_LEN;
+    offset += REC_HDR_LEN + caplen;
+    return true;
+}
+
+bool MMapFileImpl::passes(const u_char *data, u_int caplen, u_int len, 
+        u_int tv_sec, u_int tv_usec) const
+{
+    if ( !pProg_ )
+        return true;
+    pcap_pkthdr hdr;
+    hdr.ts.tv_sec = tv_sec;
+    hdr.ts.tv_usec = tv_usec;
+    hdr.caplen = caplen;
+    hdr.len = len;
+    return 0 != pcap_offline_filter(pProg_, &hdr, data);
+}
+
+void MMapFileImpl::release(size_t upTo)
+{
+#ifndef _WIN32
+    /* Read-only private mapping: dropping pages just refaults them from the file */
+    if ( upTo < released_ || upTo - released_ < RELEASE_STEP )
+        return;
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t end = upTo & ~( pageSize - 1 );
+    size_t start = released_ & ~( pageSize - 1 );
+    madvise(const_cast<u_char*>(pMap_) + start, end - start, MADV_DONTNEED);
+    released_ = end;
+#endif
+}
+
+std::map<std::string, std::string> MMapFileImpl::doGetDeviceList(std::string &)
+{
+    return std::map<std::string, std::string>();
+}
+
+int MMapFileImpl::doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec)
+{
+    u_int caplen, len;
+    do
+    {
+        if ( !nextRecord(offset_, data, caplen, len, tv_sec, tv_usec) )
+            return CAP_EOF;
+    } while ( caplen != len );
+    return static_cast<int>(caplen);
+}
+
+int MMapFileImpl::doDispatch(int maxPkts, PktHandler handler, void *user)
+{
+    if ( !pMap_ )
+        return -1;
+    const u_char *data;
+    u_int caplen, len, tv_sec, tv_usec;
+    int n = 0;
+    for (; n < maxPkts && nextRecord(offset_, data, caplen, len, tv_sec, tv_usec); n++)
+    {
+        if ( passes(data, caplen, len, tv_sec, tv_usec) )
+            handler(user, data, caplen, len, tv_sec, tv_usec);
+    }
+    release(offset_);
+    return n ? n : CAP_EOF;
+}
+
+int MMapFileImpl::doGetSelectableFd()
+{
+    return -1;
+}
+
+void MMapFileImpl::doShutDown()
+{
+#ifndef _WIN32
+    if ( pMap_ )
+        munmap(const_cast<u_char*>(pMap_), mapLen_);
+#endif
+    pMap_ = NULL;
+    mapLen_ = offset_ = released_ = 0;
+    if ( pProg_ )
+    {
+        pcap_freecode(pProg_);
+        delete pProg_;
+        pProg_ = NULL;
+    }
+    if ( pDeadH_ )
+    {
+        pcap_close(pDeadH_);
+        pDeadH_ = NULL;
+    }
+}
+
+void MMapFileImpl::doGetStats(unsigned long long &, unsigned long long &, unsigned long long &)
+{
+    /* No kernel counters for a file */
+}
+
+}
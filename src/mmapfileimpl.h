@@ -0,0 +1,67 @@
+#ifndef __MMAPFILEIMPL_H
+#define __MMAPFILEIMPL_H
+
+#include <string>
+
+#include "ifcapimpl.h"
+
+typedef struct pcap pcap_t;
+struct bpf_program;
+
+namespace DNSView
+{
+
+/* Replays a classic .pcap file straight out of a read-only mapping: record
+ * headers are walked in place and the parser gets pointers into the
+ * mapping, no copies and no libpcap reads. pcapng is not handled, init()
+ * fails and the caller falls back to PCapFileImpl. A user filter is still
+ * applied with pcap_offline_filter. */
+class MMapFileImpl : public IFCapImpl
+{
+public:
+    MMapFileImpl();
+    ~MMapFileImpl();
+
+    /* Ask for transparent huge pages on the mapping. Set before init(). */
+    void setHugePages(bool hugePages);
+
+protected:
+    virtual int doInit(const std::string &dev, const std::string &filter, 
+            std::string &errmsg);
+    virtual std::map<std::string, std::string> doGetDeviceList(std::string &errmsg);
+    virtual int doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec);
+    virtual int doDispatch(int maxPkts, PktHandler handler, void *user);
+    virtual int doGetSelectableFd();
+    virtual void doShutDown();
+    virtual void doGetStats(unsigned long long &recv, unsigned long long &drop, 
+            unsigned long long &ifDrop);
+
+    /* Walks the record at offset and moves offset past it, false at the end */
+    bool nextRecord(size_t &offset, const u_char* &data, u_int &caplen, u_int &len, 
+            u_int &tv_sec, u_int &tv_usec) const;
+    /* The user filter, safe to run from any thread */
+    bool passes(const u_char *data, u_int caplen, u_int len, u_int tv_sec, u_int tv_usec) const;
+    /* Drops the pages before upTo once enough have been consumed */
+    void release(size_t upTo);
+
+    size_t mapLen_;
+    size_t offset_;             /* next record header */
+
+private:
+    int mapFile(const std::string &path, std::string &errmsg);
+    int readHeader(std::string &errmsg);
+    int setFilter(const std::string &filter, std::string &errmsg);
+
+    bool hugePages_;
+    const u_char *pMap_;
+    size_t released_;           /* bytes before this were dropped from memory */
+    bool swapped_, nanos_;
+    u_int snapLen_;
+
+    pcap_t *pDeadH_;            /* only there to compile the user filter */
+    bpf_program *pProg_;
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __MPSCQUEUE_H
+#define __MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace DNSView
+{
+
+struct MPSCNode
+{
+    std::atomic<MPSCNode*> next;
+};
+
+/* Intrusive multi-producer single-consumer queue (Vyukov). push() is wait
+ * free from any thread, pop() belongs to one consumer and may report empty
+ * for a moment while a push is half done. Nodes are owned by the caller. */
+template <typename T>
+class MPSCQueue
+{
+public:
+    MPSCQueue() : head_(&stub_), tail_(&stub_)
+    {
+        stub_.next.store(NULL, std::memory_order_relaxed);
+    }
+
+    void push(T *pNode)
+    {
+        link(pNode);
+    }
+
+    T *pop()
+    {
+        MPSCNode *pTail = tail_;
+        MPSCNode *pNext = pTail->next.load(std::memory_order_acquire);
+        if ( pTail == &stub_ )
+        {
+            if ( !pNext )
+                return NULL;
+            tail_ = pTail = pNext;
+            pNext = pNext->next.load(std::memory_order_acquire);
+        }
+        if ( pNext )
+        {
+            tail_ = pNext;
+            return static_cast<T*>(pTail);
+        }
+        if ( pTail != head_.load(std::memory_order_acquire) )
+            return NULL;
+
+        /* pTail is the last node, put the stub behind it so it can be handed out */
+        link(&stub_);
+        pNext = pTail->next.load(std::memory_order_acquire);
+        if ( pNext )
+        {
+            tail_ = pNext;
+            return static_cast<T*>(pTail);
+        }
+        return NULL;
+    }
+
+private:
+    MPSCQueue(const MPSCQueue&);
+    MPSCQueue &operator=(const MPSCQueue&);
+
+    void link(MPSCNode *pNode)
+    {
+        pNode->next.store(NULL, std::memory_order_relaxed);
+        MPSCNode *pPrev = head_.exchange(pNode, std::memory_order_acq_rel);
+        pPrev->next.store(pNode, std::memory_order_release);
+    }
+
+    std::atomic<MPSCNode*> head_;
+    MPSCNode *tail_;
+    MPSCNode stub_;
+};
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cctype>
+
+#include "nameindex.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+/* Shortest list first, it bounds the candidates */
+struct BySize
+{
+    bool operator()(const std::vector<unsigned int> *a, const std::vector<unsigned int> *b) const
+    {
+        return a->size() < b->size();
+    }
+};
+
+}
+
+NameIndex::NameIndex(const NameTable &names) :
+    names_(names),
+    offsets_(1, 0)
+{}
+
+unsigned int NameIndex::trigram(const char *p)
+{
+    return static_cast<unsigned char>(p[0]) << 16 | static_cast<unsigned char>(p[1]) << 8 | 
+        static_cast<unsigned char>(p[2]);
+}
+
+bool NameIndex::add(unsigned int nameId)
+{
+    if ( nameId >= NameTable::FULL_ID )
+        return false;
+    if ( nameId >= ordinal_.size() )
+        ordinal_.resize(std::max<size_t>(nameId + 1, ordinal_.size() * 2), 0);
+    if ( ordinal_[nameId] )
+        return false;
+    unsigned int ordinal = static_cast<unsigned int>(ids_.size());
+    ordinal_[nameId] = ordinal + 1;
+    ids_.push_back(nameId);
+
+    char buf[NameTable::NAME_STRLEN];
+    size_t len = names_.render(nameId, buf);
+    for (size_t i = 0; i < len; i++)
+        buf[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(buf[i])));
+    text_.append(buf, len);
+    offsets_.push_back(static_cast<unsigned int>(text_.size()));
+
+    /* A trigram repeated within the name is posted once */
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        Postings &postings = trigrams_[trigram(buf + i)];
+        if ( postings.empty() || postings.back() != ordinal )
+            postings.push_back(ordinal);
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if ( '.' == buf[i] && i + 1 < len )
+            domains_[std::string(buf + i + 1, len - i - 1)].push_back(ordinal);
+    }
+    return true;
+}
+
+void NameIndex::clear()
+{
+    ordinal_.clear();
+    ids_.clear();
+    offsets_.assign(1, 0);
+    text_.clear();
+    trigrams_.clear();
+    domains_.clear();
+}
+
+size_t NameIndex::size() const
+{
+    return ids_.size();
+}
+
+bool NameIndex::matchesAt(unsigned int ordinal, const std::string &pattern) const
+{
+    std::string::const_iterator begin = text_.begin() + offsets_[ordinal];
+    std::string::const_iterator end = text_.begin() + offsets_[ordinal + 1];
+    if ( !pattern.compare(0, 2, "*.") )
+    {
+        size_t n = pattern.size() - 1;
+        return static_cast<size_t>(end - begin) > n && std::equal(pattern.begin() + 1, pattern.end(), end - n);
+    }
+    return std::search(begin, end, pattern.begin(), pattern.end()) != end;
+}
+
+bool NameIndex::matches(unsigned int nameId, const std::string &pattern) const
+{
+    if ( nameId >= ordinal_.size() || !ordinal_[nameId] )
+        return false;
+    return matchesAt(ordinal_[nameId] - 1, pattern);
+}
+
+void NameIndex::find(const std::string &pattern, std::vector<unsigned int> &nameIds) const
+{
+    nameIds.clear();
+    if ( !pattern.compare(0, 2, "*.") )
+    {
+        /* Every name was posted under each domain above it */
+        std::unordered_map<std::string, Postings>::const_iterator it = domains_.find(pattern.substr(2));
+        if ( it == domains_.end() )
+            return;
+        for (Postings::const_iterator p = it->second.begin(); p != it->second.end(); ++p)
+            nameIds.push_back(ids_[*p]);
+        return;
+    }
+    if ( pattern.size() < 3 )
+    {
+        /* Too short for a trigram: a pass over the names, still not the rows */
+        for (unsigned int i = 0; i < ids_.size(); i++)
+        {
+            if ( matchesAt(i, pattern) )
+                nameIds.push_back(ids_[i]);
+        }
+        return;
+    }
+
+    /* Names holding every trigram of the pattern, then checked in full */
+    std::vector<const Postings*> lists;
+    for (size_t i = 0; i + 3 <= pattern.size(); i++)
+    {
+        std::unordered_map<unsigned int, Postings>::const_iterator it = trigrams_.find(trigram(&pattern[i]));
+        if ( it == trigrams_.end() )
+            return;
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), BySize());
+    const Postings &candidates = *lists[0];
+    for (Postings::const_iterator p = candidates.begin(); p != candidates.end(); ++p)
+    {
+        bool all = true;
+        for (size_t l = 1; all && l < lists.size(); l++)
+            all = std::binary_search(lists[l]->begin(), lists[l]->end(), *p);
+        if ( all && matchesAt(*p, pattern) )
+            nameIds.push_back(ids_[*p]);
+    }
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef __NAMEINDEX_H
+#define __NAMEINDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DNSView
+{
+
+class NameTable;
+
+/* Searchable copy of the names the list has shown, each lower-cased once
+ * when its first row arrives. Every trigram of a name and every domain
+ * above it point back at it, so a filter is resolved against the distinct
+ * names through short posting lists instead of formatting every row.
+ * Not thread-safe; the model uses it on the GUI thread. */
+class NameIndex
+{
+public:
+    explicit NameIndex(const NameTable &names);
+
+    /* Indexes a name the first time it is seen; true if it was new */
+    bool add(unsigned int nameId);
+    void clear();
+
+    /* Patterns are lower case: text found anywhere in the name, or
+     * "*.example.com" for names strictly below the domain */
+    void find(const std::string &pattern, std::vector<unsigned int> &nameIds) const;
+    bool matches(unsigned int nameId, const std::string &pattern) const;
+
+    size_t size() const;
+
+private:
+    typedef std::vector<unsigned int> Postings;     /* ordinals, ascending */
+
+    static unsigned int trigram(const char *p);
+    bool matchesAt(unsigned int ordinal, const std::string &pattern) const;
+
+    const NameTable &names_;
+    std::vector<unsigned int> ordinal_;     /* NameTable id -> ordinal + 1, 0 = not seen */
+    std::vector<unsigned int> ids_;         /* ordinal -> NameTable id */
+    std::vector<unsigned int> offsets_;     /* ordinal -> start in text_, and the end */
+    std::string text_;                      /* lower-cased names back to back */
+    std::unordered_map<unsigned int, Postings> trigrams_;
+    std::unordered_map<std::string, Postings> domains_;
+};
+
+}
+
+#endif
@@ -0,0 +1,349 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+#include <cstdlib>
+
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+const size_t BLOCK_SIZE = 1 << 20;
+const unsigned int MAX_LABELS = 128;
+
+/* FNV-1a */
+size_t hashBytes(const void *data, size_t len)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(h ^ ( h >> 32 ));
+}
+
+}
+
+bool NameTable::KeyEq::operator()(const Key &a, const Key &b) const
+{
+    return a.len == b.len && !std::memcmp(a.data, b.data, a.len);
+}
+
+NameTable::NameTable(unsigned int maxNames) 
+    : maxNames_(maxNames < FULL_ID ? maxNames : FULL_ID), nLabels_(0), nNames_(0), overflows_(0),
+    pFree_(NULL), freeLen_(0)
+{
+    for (int i = 0; i < MAX_CHUNKS; i++)
+    {
+        labelChunks_[i].store(NULL, std::memory_order_relaxed);
+        nameChunks_[i].store(NULL, std::memory_order_relaxed);
+    }
+}
+
+NameTable::~NameTable()
+{
+    clear();
+}
+
+void NameTable::clear()
+{
+    for (int i = 0; i < SHARDS; i++)
+    {
+        labelShards_[i].map.clear();
+        nameShards_[i].map.clear();
+    }
+    for (int i = 0; i < MAX_CHUNKS; i++)
+    {
+        labelChunks_[i].store(NULL, std::memory_order_relaxed);
+        nameChunks_[i].store(NULL, std::memory_order_relaxed);
+    }
+    for (std::vector<char*>::iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+        std::free(*it);
+    blocks_.clear();
+    pFree_ = NULL;
+    freeLen_ = 0;
+    nLabels_ = nNames_ = 0;
+    overflows_ = 0;
+}
+
+void *NameTable::alloc(size_t n)
+{
+    /* Bump allocation, callers hold arenaLock_ */
+    n = ( n + 7 ) & ~static_cast<size_t>(7);
+    if ( n > BLOCK_SIZE / 4 )
+    {
+        char *p = static_cast<char*>(std::malloc(n));
+        blocks_.push_back(p);
+        return p;
+    }
+    if ( n > freeLen_ )
+    {
+        pFree_ = static_cast<char*>(std::malloc(BLOCK_SIZE));
+        blocks_.push_back(pFree_);
+        freeLen_ = BLOCK_SIZE;
+    }
+    void *p = pFree_;
+    pFree_ += n;
+    freeLen_ -= n;
+    return p;
+}
+
+template <typename T>
+T &NameTable::slot(std::atomic<T*> *chunks, unsigned int id)
+{
+    std::atomic<T*> &chunk = chunks[id >> CHUNK_BITS];
+    T *p = chunk.load(std::memory_order_acquire);
+    if ( !p )
+    {
+        std::lock_guard<std::mutex> guard(arenaLock_);
+        if ( !( p = chunk.load(std::memory_order_relaxed) ) )
+        {
+            p = static_cast<T*>(alloc(sizeof(T) * CHUNK_SIZE));
+            chunk.store(p, std::memory_order_release);
+        }
+    }
+    return p[id & ( CHUNK_SIZE - 1 )];
+}
+
+template <typename T>
+const T &NameTable::at(const std::atomic<T*> *chunks, unsigned int id) const
+{
+    return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & ( CHUNK_SIZE - 1 )];
+}
+
+unsigned int NameTable::internLabel(const unsigned char *text, unsigned int len)
+{
+    Key key = { text, len, hashBytes(text, len) };
+    Shard &shard = labelShards_[( key.hash >> 8 ) % SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Map::const_iterator it = shard.map.find(key);
+    if ( it != shard.map.end() )
+        return it->second;
+
+    unsigned int id = nLabels_++;
+    if ( id >= static_cast<unsigned int>(MAX_CHUNKS) * CHUNK_SIZE )
+    {
+        nLabels_--;
+        return INVALID_ID;
+    }
+    char *copy;
+    {
+        std::lock_guard<std::mutex> arenaGuard(arenaLock_);
+        copy = static_cast<char*>(alloc(len));
+    }
+    std::memcpy(copy, text, len);
+    Label &label = slot(labelChunks_, id);
+    label.text = copy;
+    label.len = len;
+    key.data = copy;
+    shard.map.insert(std::make_pair(key, id));
+    return id;
+}
+
+unsigned int NameTable::intern(const unsigned char *wire, size_t len)
+{
+    /* Map each label to its id, the id list is the key for the name */
+    unsigned int ids[MAX_LABELS];
+    unsigned int n = 0;
+    size_t off = 0;
+    if ( len > 255 )
+        return INVALID_ID;
+    for (;;)
+    {
+        if ( off >= len )
+            return INVALID_ID;
+        unsigned int labelLen = wire[off++];
+        if ( !labelLen )
+            break;
+        if ( labelLen > 63 || off + labelLen > len || n == MAX_LABELS )
+            return INVALID_ID;
+        if ( INVALID_ID == ( ids[n++] = internLabel(wire + off, labelLen) ) )
+        {
+            overflows_++;
+            return FULL_ID;
+        }
+        off += labelLen;
+    }
+
+    Key key = { ids, n * sizeof(unsigned int), hashBytes(ids, n * sizeof(unsigned int)) };
+    Shard &shard = nameShards_[( key.hash >> 8 ) % SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Map::const_iterator it = shard.map.find(key);
+    if ( it != shard.map.end() )
+        return it->second;
+
+    unsigned int id = nNames_++;
+    if ( id >= maxNames_ )
+    {
+        nNames_--;
+        overflows_++;
+        return FULL_ID;
+    }
+    unsigned int *labels;
+    {
+        std::lock_guard<std::mutex> arenaGuard(arenaLock_);
+        labels = static_cast<unsigned int*>(alloc(key.len ? key.len : 1));
+    }
+    std::memcpy(labels, ids, key.len);
+    Name &name = slot(nameChunks_, id);
+    name.labels = labels;
+    name.nLabels = n;
+    key.data = labels;
+    shard.map.insert(std::make_pair(key, id));
+    return id;
+}
+
+size_t NameTable::render(unsigned int id, char *buf) const
+{
+    const char *special = NULL;
+    if ( id == FULL_ID )
+        special = "<name table full>";
+    else if ( id == INVALID_ID || id >= nNames_.load(std::memory_order_relaxed) )
+        special = "<invalid name>";
+    if ( special )
+    {
+        std::strcpy(buf, special);
+        return std::strlen(special);
+    }
+
+    const Name &name = at(nameChunks_, id);
+    if ( !name.nLabels )
+    {
+        std::strcpy(buf, ".");
+        return 1;
+    }
+    size_t n = 0;
+    for (unsigned int i = 0; i < name.nLabels; i++)
+    {
+        const Label &label = at(labelChunks_, name.labels[i]);
+        if ( i )
+            buf[n++] = '.';
+        std::memcpy(buf + n, label.text, label.len);
+        n += label.len;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+std::string NameTable::text(unsigned int id) const
+{
+    char buf[NAME_STRLEN];
+    size_t n = render(id, buf);
+    return std::string(buf, n);
+}
+
+size_t NameTable::wire(unsigned int id, unsigned char *buf) const
+{
+    if ( id >= nNames_.load(std::memory_order_relaxed) )
+        return 0;
+    const Name &name = at(nameChunks_, id);
+    size_t n = 0;
+    for (unsigned int i = 0; i < name.nLabels; i++)
+    {
+        const Label &label = at(labelChunks_, name.labels[i]);
+        buf[n++] = static_cast<unsigned char>(label.len);
+        std::memcpy(buf + n, label.text, label.len);
+        n += label.len;
+    }
+    buf[n++] = 0;
+    return n;
+}
+
+int NameTable::compare(unsigned int a, unsigned int b) const
+{
+    if ( a == b )
+        return 0;
+    char bufA[NAME_STRLEN], bufB[NAME_STRLEN];
+    size_t lenA = render(a, bufA), lenB = render(b, bufB);
+    int ret = std::memcmp(bufA, bufB, lenA < lenB ? lenA : lenB);
+    if ( ret )
+        return ret;
+    return lenA < lenB ? -1 : ( lenA > lenB ? 1 : 0 );
+}
+
+size_t NameTable::size() const
+{
+    return nNames_.load(std::memory_order_relaxed);
+}
+
+unsigned long long NameTable::overflows() const
+{
+    return overflows_.load(std::memory_order_relaxed);
+}
+
+NameFolder::NameFolder() : pNames_(NULL)
+{}
+
+void NameFolder::setNameTable(NameTable *pNames)
+{
+    pNames_ = pNames;
+    folded_.clear();
+}
+
+unsigned int NameFolder::fold(unsigned int nameId)
+{
+    if ( !pNames_ || nameId >= NameTable::FULL_ID )
+        return nameId;
+    if ( nameId < folded_.size() && folded_[nameId] )
+        return folded_[nameId] - 1;
+
+    /* Length bytes are at most 63, below 'A', so only letters change */
+    unsigned char wire[NameTable::NAME_STRLEN];
+    size_t len = pNames_->wire(nameId, wire);
+    bool upper = false;
+    for (size_t i = 0; i < len; i++)
+    {
+        if ( wire[i] >= 'A' && wire[i] <= 'Z' )
+        {
+            wire[i] = static_cast<unsigned char>(wire[i] + ( 'a' - 'A' ));
+            upper = true;
+        }
+    }
+    unsigned int folded = upper ? pNames_->intern(wire, len) : nameId;
+    if ( folded >= NameTable::FULL_ID )
+        folded = nameId;
+    if ( nameId >= folded_.size() )
+        folded_.resize(nameId + 1 + folded_.size() / 2, 0);
+    folded_[nameId] = folded + 1;
+    return folded;
+}
+
+void NameFolder::clear()
+{
+    folded_.clear();
+}
+
+}
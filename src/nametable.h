@@ -0,0 +1,129 @@
+#ifndef __NAMETABLE_H
+#define __NAMETABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DNSView
+{
+
+/* Interned domain names. A name is stored once as a list of label ids and
+ * each distinct label is stored once, so CDN names sharing their parent
+ * domains cost a few bytes each. Ids are stable for the life of the table.
+ *
+ * intern() may be called from any number of threads; lookups of names seen
+ * before take only shard locks and never allocate. text() and compare() are
+ * lock-free and may be called for any id a caller got from intern(). */
+class NameTable
+{
+public:
+    enum { INVALID_ID = 0xffffffff, FULL_ID = 0xfffffffe };
+
+    explicit NameTable(unsigned int maxNames = 1 << 24);
+    ~NameTable();
+
+    /* Uncompressed wire-format name, length-prefixed labels up to the root */
+    unsigned int intern(const unsigned char *wire, size_t len);
+
+    /* Dotted text, "." for the root; buf must hold NAME_STRLEN bytes */
+    enum { NAME_STRLEN = 256 };
+    size_t render(unsigned int id, char *buf) const;
+    std::string text(unsigned int id) const;
+    /* Wire form as given to intern(), 0 for FULL_ID and INVALID_ID; buf
+     * must hold NAME_STRLEN bytes */
+    size_t wire(unsigned int id, unsigned char *buf) const;
+    int compare(unsigned int a, unsigned int b) const;
+
+    size_t size() const;
+    unsigned long long overflows() const;
+
+    /* Not thread-safe, only call while nothing is interning */
+    void clear();
+
+private:
+    NameTable(const NameTable &);
+    NameTable &operator=(const NameTable &);
+
+    struct Key
+    {
+        const void *data;
+        size_t len;
+        size_t hash;
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const { return k.hash; }
+    };
+    struct KeyEq
+    {
+        bool operator()(const Key &a, const Key &b) const;
+    };
+    typedef std::unordered_map<Key, unsigned int, KeyHash, KeyEq> Map;
+
+    struct Shard
+    {
+        std::mutex lock;
+        Map map;
+    };
+
+    struct Label
+    {
+        const char *text;
+        unsigned int len;
+    };
+    struct Name
+    {
+        const unsigned int *labels;
+        unsigned int nLabels;
+    };
+
+    enum { SHARDS = 16, CHUNK_BITS = 16, CHUNK_SIZE = 1 << CHUNK_BITS, MAX_CHUNKS = 4096 };
+
+    unsigned int internLabel(const unsigned char *text, unsigned int len);
+    void *alloc(size_t n);
+    template <typename T>
+    T &slot(std::atomic<T*> *chunks, unsigned int id);
+    template <typename T>
+    const T &at(const std::atomic<T*> *chunks, unsigned int id) const;
+
+    unsigned int maxNames_;
+    Shard labelShards_[SHARDS], nameShards_[SHARDS];
+    std::atomic<Label*> labelChunks_[MAX_CHUNKS];
+    std::atomic<Name*> nameChunks_[MAX_CHUNKS];
+    std::atomic<unsigned int> nLabels_, nNames_;
+    std::atomic<unsigned long long> overflows_;
+
+    /* Label text, label id lists and chunks, freed only by clear() */
+    std::mutex arenaLock_;
+    std::vector<char*> blocks_;
+    char *pFree_;
+    size_t freeLen_;
+};
+
+/* Maps a name id to the id of the same name in lower case, so a name is
+ * counted once whatever case a resolver sent it in (0x20 randomization).
+ * Names with upper case letters are interned again folded; every id seen is
+ * remembered. Not thread-safe, one per counting thread. */
+class NameFolder
+{
+public:
+    NameFolder();
+
+    void setNameTable(NameTable *pNames);
+    /* Ids past the table (FULL_ID, INVALID_ID) come back as they are */
+    unsigned int fold(unsigned int nameId);
+    /* With the table, and before it is cleared */
+    void clear();
+
+private:
+    NameTable *pNames_;
+    std::vector<unsigned int> folded_;     /* id -> folded id + 1, 0 = not seen */
+};
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "options.h"
+#include "pcapthread.h"
+
+namespace DNSView
+{
+
+Options::Options() :
+    realtime(false),
+    batchSize(1024),
+    budgetMs(5),
+    timeoutMs(5000),
+    hugePages(false),
+    threads(1),
+    fanout(1),
+    ringBlockSize(0),
+    ringBlocks(64),
+    ringRetireMs(10),
+    storeSegmentSecs(3600),
+    metricsPort(0),
+    metricsAddr("127.0.0.1"),
+    metricsTop(20)
+{}
+
+void parseOptions(const QStringList &args, Options &opts)
+{
+    /* Flags that take a value are ignored when the value is missing */
+    int i = args.indexOf("--filter");
+    if ( i > 0 && i + 1 < args.size() )
+        opts.filter = args.at(i + 1);
+    if ( ( i = args.indexOf("--replay") ) > 0 && i + 1 < args.size() )
+        opts.replay = args.at(i + 1);
+    opts.realtime = args.contains("--realtime");
+    if ( ( i = args.indexOf("--batch") ) > 0 && i + 1 < args.size() )
+        opts.batchSize = args.at(i + 1).toInt();
+    if ( ( i = args.indexOf("--budget") ) > 0 && i + 1 < args.size() )
+        opts.budgetMs = args.at(i + 1).toInt();
+    if ( ( i = args.indexOf("--timeout") ) > 0 && i + 1 < args.size() )
+        opts.timeoutMs = args.at(i + 1).toUInt();
+    opts.hugePages = args.contains("--hugepages");
+    if ( ( i = args.indexOf("--threads") ) > 0 && i + 1 < args.size() )
+        opts.threads = args.at(i + 1).toInt();
+    if ( ( i = args.indexOf("--fanout") ) > 0 && i + 1 < args.size() )
+        opts.fanout = args.at(i + 1).toInt();
+    if ( args.contains("--tpacket") )
+    {
+        unsigned int blockKiB = 1024;
+        if ( ( i = args.indexOf("--block-size") ) > 0 && i + 1 < args.size() )
+            blockKiB = args.at(i + 1).toUInt();
+        if ( ( i = args.indexOf("--blocks") ) > 0 && i + 1 < args.size() )
+            opts.ringBlocks = args.at(i + 1).toUInt();
+        if ( ( i = args.indexOf("--retire") ) > 0 && i + 1 < args.size() )
+            opts.ringRetireMs = args.at(i + 1).toUInt();
+        opts.ringBlockSize = blockKiB * 1024;
+        if ( !opts.ringBlocks )
+            opts.ringBlocks = 1;
+    }
+    if ( ( i = args.indexOf("--stats-file") ) > 0 && i + 1 < args.size() )
+        opts.statsFile = args.at(i + 1);
+    if ( ( i = args.indexOf("--log-max-mb") ) > 0 && i + 1 < args.size() )
+        opts.logPolicy.maxBytes = args.at(i + 1).toULongLong() << 20;
+    if ( ( i = args.indexOf("--log-rotate") ) > 0 && i + 1 < args.size() )
+        opts.logPolicy.rotateSecs = args.at(i + 1).toUInt();
+    if ( ( i = args.indexOf("--log-fsync") ) > 0 && i + 1 < args.size() )
+        opts.logPolicy.fsyncSecs = args.at(i + 1).toInt();
+    opts.logPolicy.compress = args.contains("--log-gzip");
+    if ( ( i = args.indexOf("--log-format") ) > 0 && i + 1 < args.size() )
+        opts.logPolicy.binary = "binary" == args.at(i + 1);
+    if ( ( i = args.indexOf("--store") ) > 0 && i + 1 < args.size() )
+        opts.storeDir = args.at(i + 1);
+    if ( ( i = args.indexOf("--store-segment") ) > 0 && i + 1 < args.size() )
+        opts.storeSegmentSecs = args.at(i + 1).toUInt();
+    if ( ( i = args.indexOf("--metrics") ) > 0 && i + 1 < args.size() )
+        opts.metricsPort = args.at(i + 1).toUShort();
+    if ( ( i = args.indexOf("--metrics-addr") ) > 0 && i + 1 < args.size() )
+        opts.metricsAddr = args.at(i + 1).toUtf8().constData();
+    if ( ( i = args.indexOf("--metrics-top") ) > 0 && i + 1 < args.size() )
+        opts.metricsTop = args.at(i + 1).toInt();
+}
+
+void applyCaptureOptions(const Options &opts, PCapThread &capture)
+{
+    capture.setBatch(opts.batchSize, opts.budgetMs);
+    capture.setTimeout(opts.timeoutMs);
+    capture.setHugePages(opts.hugePages);
+    capture.setThreads(opts.threads);
+    capture.setFanout(opts.fanout);
+    if ( opts.ringBlockSize )
+        capture.setRing(opts.ringBlockSize, opts.ringBlocks, opts.ringRetireMs);
+}
+
+}
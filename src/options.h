@@ -0,0 +1,56 @@
+#ifndef __OPTIONS_H
+#define __OPTIONS_H
+
+#include <string>
+#include <QString>
+#include <QStringList>
+
+#include "querylog.h"
+
+namespace DNSView
+{
+
+class PCapThread;
+
+/* Command line options shared by dnsviewer and dnsviewer-cli:
+ *           [--filter <bpf expression>] [--batch <packets>] [--budget <ms>]
+ *           [--timeout <ms before a query counts as unanswered>]
+ *           [--replay <.pcap/.pcapng file> [--realtime]] [--hugepages]
+ *           [--threads <decoding threads for a mapped replay>]
+ *           [--fanout <capture threads per interface, Linux PACKET_FANOUT>]
+ *           [--tpacket [--block-size <KiB>] [--blocks <n>] [--retire <ms>]]
+ *           [--stats-file <JSON statistics, rewritten twice a second>]
+ *           [--log-format <text|binary>] [--log-max-mb <MiB>]
+ *           [--log-rotate <seconds>] [--log-gzip]
+ *           [--log-fsync <seconds, 0 = on rotate and close, -1 = never>]
+ *           [--store <directory> [--store-segment <seconds>]]
+ *           [--metrics <port> [--metrics-addr <address>] [--metrics-top <names>]] */
+struct Options
+{
+    QString filter;
+    QString replay;
+    bool realtime;
+    int batchSize, budgetMs;
+    unsigned int timeoutMs;
+    bool hugePages;
+    int threads, fanout;
+    unsigned int ringBlockSize;     /* bytes, 0 = no --tpacket */
+    unsigned int ringBlocks, ringRetireMs;
+    QString statsFile;
+    LogPolicy logPolicy;
+    QString storeDir;
+    unsigned int storeSegmentSecs;
+    unsigned short metricsPort;     /* 0 = no --metrics */
+    std::string metricsAddr;
+    int metricsTop;
+
+    Options();
+};
+
+void parseOptions(const QStringList &args, Options &opts);
+/* Batching, timeout, threads and ring settings, before the capture starts */
+void applyCaptureOptions(const Options &opts, PCapThread &capture);
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+
+#include "dnsviewer.h"
+#include "pcap.h"
+#include "pcapfileimpl.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+long long monotonicUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+PCapFileImpl::PCapFileImpl() : PCapImpl(), realtime_(false), pHeld_(NULL), pHeldData_(NULL), 
+    started_(false), firstTs_(0), startUs_(0)
+{}
+
+PCapFileImpl::~PCapFileImpl() 
+{}
+
+void PCapFileImpl::setRealtime(bool realtime)
+{
+    realtime_ = realtime;
+}
+
+int PCapFileImpl::doInit(const std::string &dev, const std::string &filter, 
+        std::string &errmsg)
+{
+    /* libpcap reads both the classic and the pcapng format */
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pHeld_ = NULL;
+    started_ = false;
+    if ( ( pPCapH_ = pcap_open_offline(dev.c_str(), errbuf) ) == NULL )
+    {
+        errmsg = errbuf;
+        return -1;
+    }
+    if ( setLinkType(pcap_datalink(pPCapH_), errmsg) || setFilter(filter, errmsg) )
+    {
+        doShutDown();
+        return -1;
+    }
+    return 0;
+}
+
+std::map<std::string, std::string> PCapFileImpl::doGetDeviceList(std::string &)
+{
+    return std::map<std::string, std::string>();
+}
+
+int PCapFileImpl::doDispatch(int maxPkts, PktHandler handler, void *user)
+{
+    if ( realtime_ )
+        return dispatchPaced(maxPkts, handler, user);
+
+    /* A savefile never has "nothing ready", so 0 is the end of the file */
+    int ret = PCapImpl::doDispatch(maxPkts, handler, user);
+    return 0 == ret ? CAP_EOF : ret;
+}
+
+int PCapFileImpl::dispatchPaced(int maxPkts, PktHandler handler, void *user)
+{
+    /* Packets are due once as much wall time has passed since the first one
+     * as capture time had; the buffer behind pHeld_ stays valid until the
+     * next pcap_next_ex */
+    int n = 0;
+    long long now = monotonicUs();
+    while ( n < maxPkts )
+    {
+        if ( !pHeld_ )
+        {
+            int ret = pcap_next_ex(pPCapH_, &pHeld_, &pHeldData_);
+            if ( 1 != ret )
+            {
+                pHeld_ = NULL;
+                if ( n )
+                    return n;
+                return -2 == ret ? CAP_EOF : -1;
+            }
+        }
+        long long ts = pHeld_->ts.tv_sec * 1000000LL + pHeld_->ts.tv_usec;
+        if ( !started_ )
+        {
+            started_ = true;
+            firstTs_ = ts;
+            startUs_ = now;
+        }
+        if ( ts - firstTs_ > now - startUs_ )
+            break;
+        handler(user, pHeldData_, pHeld_->caplen, pHeld_->len, 
+                pHeld_->ts.tv_sec, pHeld_->ts.tv_usec);
+        pHeld_ = NULL;
+        ++n;
+    }
+    return n;
+}
+
+int PCapFileImpl::doGetSelectableFd()
+{
+    return -1;
+}
+
+void PCapFileImpl::doShutDown()
+{
+    pHeld_ = NULL;
+    PCapImpl::doShutDown();
+}
+
+void PCapFileImpl::doGetStats(unsigned long long &, unsigned long long &, unsigned long long &)
+{
+    /* No kernel counters for a file */
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef __PCAPFILEIMPL_H
+#define __PCAPFILEIMPL_H
+
+#include <string>
+
+#include "pcapimpl.h"
+
+struct pcap_pkthdr;
+
+namespace DNSView
+{
+
+/* Reads a saved .pcap/.pcapng file instead of a live interface. The
+ * device passed to init() is the file name. */
+class PCapFileImpl : public PCapImpl
+{
+public:
+    PCapFileImpl();
+    ~PCapFileImpl();
+
+    /* Hand packets over with the spacing they were captured at, rather than
+     * as fast as they can be read. Set before init(). */
+    void setRealtime(bool realtime);
+
+protected:
+    virtual int doInit(const std::string &dev, const std::string &filter, 
+            std::string &errmsg);
+    virtual std::map<std::string, std::string> doGetDeviceList(std::string &errmsg);
+    virtual int doDispatch(int maxPkts, PktHandler handler, void *user);
+    virtual int doGetSelectableFd();
+    virtual void doShutDown();
+    virtual void doGetStats(unsigned long long &recv, unsigned long long &drop, 
+            unsigned long long &ifDrop);
+
+private:
+    int dispatchPaced(int maxPkts, PktHandler handler, void *user);
+
+    bool realtime_;
+
+    /* Paced replay: the packet read ahead that is not due yet, and the
+     * capture time that maps to the wall-clock start */
+    pcap_pkthdr *pHeld_;
+    const u_char *pHeldData_;
+    bool started_;
+    long long firstTs_, startUs_;
+};
+
+}
+
+#endif
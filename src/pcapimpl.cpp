@@ -28,6 +28,7 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <map>
@@ -50,16 +51,44 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pcap.h"
 #include "pcapimpl.h"
 
+#ifdef __linux__
+#   include <cerrno>
+#   include <sys/socket.h>
+#   include <linux/if_packet.h>
+#endif
+
 namespace DNSView
 {
 
-PCapImpl::PCapImpl() : IFCapImpl(), pPCapH_(NULL), pDevsH_(NULL)
+namespace
+{
+
+struct DispatchCtx
+{
+    IFCapImpl::PktHandler handler;
+    void *user;
+};
+
+void dispatchCallback(u_char *user, const pcap_pkthdr *hdr, const u_char *data)
+{
+    DispatchCtx *pCtx = reinterpret_cast<DispatchCtx*>(user);
+    pCtx->handler(pCtx->user, data, hdr->caplen, hdr->len, hdr->ts.tv_sec, hdr->ts.tv_usec);
+}
+
+}
+
+PCapImpl::PCapImpl() : IFCapImpl(), pPCapH_(NULL), pDevsH_(NULL), fanoutGroup_(0)
 {}
 
 PCapImpl::~PCapImpl() 
 {}
 
-int PCapImpl::doInit(const std::string &dev, std::string errmsg)
+#ifndef PCAP_NETMASK_UNKNOWN
+#   define PCAP_NETMASK_UNKNOWN 0xffffffff
+#endif
+
+int PCapImpl::doInit(const std::string &dev, const std::string &filter, 
+        std::string &errmsg)
 {
     char errbuf[PCAP_ERRBUF_SIZE];
 #ifdef _HAS_PCAP_OPEN
@@ -73,9 +102,77 @@ int PCapImpl::doInit(const std::string &dev, std::string errmsg)
         errmsg = errbuf;
         return -1;
     }
+    if ( setLinkType(pcap_datalink(pPCapH_), errmsg) || setFilter(filter, errmsg) || 
+            joinFanout(errmsg) )
+    {
+        doShutDown();
+        return -1;
+    }
+
+    /* When there is a descriptor to wait on, reads must never block */
+    if ( -1 != doGetSelectableFd() && -1 == pcap_setnonblock(pPCapH_, 1, errbuf) )
+    {
+        errmsg = errbuf;
+        doShutDown();
+        return -1;
+    }
     return 0;
 }
 
+int PCapImpl::setFilter(const std::string &filter, std::string &errmsg)
+{
+    /* Only DNS ever leaves the kernel, the user filter narrows it further */
+    std::string expr = dnsFilter(linkType(), filter);
+    bpf_program prog;
+    if ( -1 == pcap_compile(pPCapH_, &prog, expr.c_str(), 1, PCAP_NETMASK_UNKNOWN) )
+    {
+        errmsg = std::string("Bad filter: ") + pcap_geterr(pPCapH_);
+        return -1;
+    }
+    int ret = pcap_setfilter(pPCapH_, &prog);
+    if ( -1 == ret )
+        errmsg = pcap_geterr(pPCapH_);
+    pcap_freecode(&prog);
+    return ret;
+}
+
+void PCapImpl::setFanout(unsigned short groupId)
+{
+    fanoutGroup_ = groupId;
+}
+
+int PCapImpl::joinFanout(std::string &errmsg)
+{
+    if ( !fanoutGroup_ )
+        return 0;
+#if defined(__linux__) && defined(PACKET_FANOUT)
+    /* Symmetric flow hash, so a query and its response meet in one member;
+     * fragments are put back together first so they hash alike */
+    int arg = fanoutGroup_ | ( ( PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG ) << 16 );
+    if ( -1 == setsockopt(pcap_fileno(pPCapH_), SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) )
+    {
+        errmsg = std::string("PACKET_FANOUT: ") + std::strerror(errno);
+        return -1;
+    }
+    return 0;
+#else
+    errmsg = "Fanout needs Linux PACKET_FANOUT";
+    return -1;
+#endif
+}
+
+void PCapImpl::doGetStats(unsigned long long &recv, unsigned long long &drop, 
+        unsigned long long &ifDrop)
+{
+    pcap_stat ps;
+    if ( pPCapH_ && 0 == pcap_stats(pPCapH_, &ps) )
+    {
+        recv = ps.ps_recv;
+        drop = ps.ps_drop;
+        ifDrop = ps.ps_ifdrop;
+    }
+}
+
 void PCapImpl::doShutDown()
 {
     if (pPCapH_)
@@ -99,6 +196,10 @@ std::map<std::string, std::string> PCapImpl::doGetDeviceList(std::string &errmsg
     {
         for(pcap_if_t *d=pDevsH_; d; d=d->next)
         {
+            /* Linux's "any" has no addresses of its own */
+            if ( !std::strcmp(d->name, "any") )
+                _nameMap.insert(std::map<std::string, std::string>::value_type( 
+                    (d->description ? d->description : d->name), d->name ) );
             for (pcap_addr_t *addy=d->addresses; addy; addy=addy->next)
             {
                 if (addy->addr->sa_family == AF_INET || addy->addr->sa_family == AF_INET6)
@@ -114,7 +215,7 @@ std::map<std::string, std::string> PCapImpl::doGetDeviceList(std::string &errmsg
     return _nameMap;
 }
 
-int PCapImpl::doGetNextPkt(const u_char* &data, u_int &tv_sec)
+int PCapImpl::doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec)
 {
     pcap_pkthdr *hdr;
     const u_char *pdata;
@@ -124,10 +225,26 @@ int PCapImpl::doGetNextPkt(const u_char* &data, u_int &tv_sec)
         if ( hdr->caplen != hdr->len )
             return -1;
         data = pdata;
-        tv_sec = hdr->ts.tv_sec + ( ( hdr->ts.tv_usec + 500000 ) / 1000000 );
+        tv_sec = hdr->ts.tv_sec;
+        tv_usec = hdr->ts.tv_usec;
         return hdr->caplen;
     }
     return ret;
 }
 
+int PCapImpl::doDispatch(int maxPkts, PktHandler handler, void *user)
+{
+    DispatchCtx ctx = { handler, user };
+    return pcap_dispatch(pPCapH_, maxPkts, dispatchCallback, reinterpret_cast<u_char*>(&ctx));
+}
+
+int PCapImpl::doGetSelectableFd()
+{
+#ifdef WPCAP
+    return -1;
+#else
+    return pPCapH_ ? pcap_get_selectable_fd(pPCapH_) : -1;
+#endif
+}
+
 }
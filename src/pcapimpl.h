@@ -19,15 +19,30 @@ public:
     PCapImpl();
     ~PCapImpl();
 
+    /* Join PACKET_FANOUT group groupId (0 for none), flows hashed across
+     * its members. Linux only, set before init(). */
+    void setFanout(unsigned short groupId);
+
 protected:
-    virtual int doInit(const std::string &dev, std::string errmsg);
+    virtual int doInit(const std::string &dev, const std::string &filter, 
+            std::string &errmsg);
     virtual std::map<std::string, std::string> doGetDeviceList(std::string &errmsg);
-    virtual int doGetNextPkt(const u_char* &data, u_int &tv_sec);
+    virtual int doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec);
+    virtual int doDispatch(int maxPkts, PktHandler handler, void *user);
+    virtual int doGetSelectableFd();
     virtual void doShutDown();
+    virtual void doGetStats(unsigned long long &recv, unsigned long long &drop, 
+            unsigned long long &ifDrop);
+
+    int setFilter(const std::string &filter, std::string &errmsg);
 
-private:
     pcap_t *pPCapH_;
+
+private:
+    int joinFanout(std::string &errmsg);
+
     pcap_if_t *pDevsH_;
+    unsigned short fanoutGroup_;
 };
 
 }
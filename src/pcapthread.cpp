@@ -27,22 +27,56 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <queue>
+#include <vector>
+#include <QCoreApplication>
 #include <QTimer>
 #include <QThread>
 #include <QElapsedTimer>
+#include <QSocketNotifier>
 
 #include "pcapthread.h"
 #include "pcapimpl.h"
+#include "pcapfileimpl.h"
+#include "shardedfileimpl.h"
+#include "capworker.h"
+#include "metricsserver.h"
+#include "binlog.h"
+#include "nametable.h"
 
 namespace DNSView
 {
 
+namespace
+{
+
+/* Orders worker seq segments by their first local seq */
+struct SegmentBefore
+{
+    template <typename Segment>
+    bool operator()(unsigned long long seq, const Segment &segment) const
+    {
+        return seq < segment.local;
+    }
+};
+
+}
+
 /* QObject thread */
 PCapThread::PCapThread(QObject *parent)
-    : QObject(parent), spThread_(new QThread), spPCapImpl_(new PCapImpl)
+    : QObject(parent), spThread_(new QThread), spPCapImpl_(new PCapImpl),
+    spFileImpl_(new PCapFileImpl), spMMapImpl_(new ShardedFileImpl), 
+    pCapImpl_(spPCapImpl_.data()), replay_(false), nLogQueries_(0), nextSeq_(0), pNames_(NULL), timeoutMs_(5000), 
+    fanout_(1), ringBlockSize_(0), ringBlocks_(0), ringRetireMs_(0), prevBytes_(0), prevPackets_(0), prevParsed_(0), nDrained_(0), batchSize_(1024), budgetMs_(5), topNames_(0)
 {
+    qRegisterMetaType<QueryBatch>("QueryBatch");
+    qRegisterMetaType<AnswerBatch>("AnswerBatch");
+    qRegisterMetaType<StatsSnapshot>("StatsSnapshot");
+    qRegisterMetaType<TopSnapshot>("TopSnapshot");
     this->moveToThread(spThread_.data());
     
     /* Calls exec */
@@ -58,83 +92,514 @@ void PCapThread::waitForThread()
     spThread_->wait();
 }
 
-void PCapThread::slotStart(const QString &devDesc)
+/* Called directly from the main thread before the first start */
+void PCapThread::setBatch(int batchSize, int budgetMs)
+{
+    batchSize_ = batchSize > 0 ? batchSize : 1;
+    budgetMs_ = budgetMs > 0 ? budgetMs : 1;
+}
+
+/* Called directly from the main thread before the first start */
+void PCapThread::setNameTable(NameTable *pNames)
+{
+    pNames_ = pNames;
+    folder_.setNameTable(pNames);
+    spFileImpl_->setNameTable(pNames);
+    spMMapImpl_->setNameTable(pNames);
+}
+
+/* Called directly from the main thread before the first start */
+void PCapThread::setTimeout(unsigned int timeoutMs)
+{
+    timeoutMs_ = timeoutMs;
+    spFileImpl_->setTimeout(timeoutMs);
+    spMMapImpl_->setTimeout(timeoutMs);
+}
+
+/* Called directly from the main thread before the first start */
+void PCapThread::setHugePages(bool hugePages)
+{
+    spMMapImpl_->setHugePages(hugePages);
+}
+
+/* Called directly from the main thread before the first start */
+void PCapThread::setThreads(int nThreads)
+{
+    spMMapImpl_->setThreads(nThreads);
+}
+
+/* Called directly from the main thread before the first start */
+void PCapThread::setFanout(int nThreads)
+{
+    fanout_ = nThreads > 0 ? nThreads : 1;
+}
+
+/* Called directly from the main thread before the first start; no blocks
+ * captures through libpcap */
+void PCapThread::setRing(unsigned int blockSize, unsigned int blockCount, unsigned int retireMs)
+{
+    ringBlockSize_ = blockSize;
+    ringBlocks_ = blockCount;
+    ringRetireMs_ = retireMs;
+}
+
+/* Called directly from the main thread before the first start */
+int PCapThread::startMetrics(const std::string &addr, unsigned short port, int topNames, 
+        std::string &errmsg)
 {
-    /* Start the poll timer, kBps update timer, and the elapsed timer */
+    QSharedPointer<MetricsServer> spMetrics(new MetricsServer);
+    if ( spMetrics->start(addr, port, errmsg) )
+        return -1;
+    spMetrics_ = spMetrics;
+    topNames_ = topNames > 0 ? topNames : 0;
+    qtypeCounts_.assign(0x10000, 0);
+    return 0;
+}
+
+/* Called directly from the main thread before the first start */
+void PCapThread::setTopN(int nTop)
+{
+    top_.setSize(nTop);
+}
+
+void PCapThread::slotStart(const QStringList &devDescs, const QString &filter)
+{
+    /* One capture thread per interface, or fanout_ of them sharing it */
+    replay_ = false;
+    nextSeq_ = 0;
+    nDrained_ = 0;
+    seqMaps_.clear();
+    RingConfig ring = { ringBlockSize_, ringBlocks_, ringRetireMs_ };
+    std::string errmsg;
+    for (int d = 0; d < devDescs.size(); d++)
+    {
+        /* Descriptions come from the device list, anything else (a name
+         * given on the command line) goes to the capture as it is */
+        std::string dev(devDescs.at(d).toUtf8().constData());
+        std::map<std::string, std::string>::iterator it = devMap_.find(dev);
+        if ( devMap_.end() != it )
+            dev = it->second;
+        unsigned short group = fanout_ > 1 ? 
+            static_cast<unsigned short>(( QCoreApplication::applicationPid() * 31 + d ) % 0xffff + 1) : 0;
+        for (int f = 0; f < fanout_ && errmsg.empty(); f++)
+        {
+            QSharedPointer<CaptureWorker> spWorker(new CaptureWorker(workers_.size(), &queue_));
+            if ( spWorker->init(dev, filter.toUtf8().constData(), group, ring, pNames_, 
+                        timeoutMs_, batchSize_, errmsg) )
+                errmsg = devDescs.at(d).toUtf8().constData() + std::string(" ") + errmsg;
+            else
+                workers_.push_back(spWorker);
+        }
+        if ( !errmsg.empty() )
+            break;
+    }
+    if ( devDescs.isEmpty() )
+        errmsg = "No device selected";
+    if ( !errmsg.empty() )
+    {
+        workers_.clear();
+        emit sigError("Error initializing " + QString::fromStdString(errmsg) ); 
+        emit sigDone();
+        return;
+    }
+
+    seqMaps_.resize(workers_.size());
+    for (size_t i = 0; i < workers_.size(); i++)
+        workers_[i]->start();
+    startTimers();
+    spFlushTimer_ = QSharedPointer<QTimer>(new QTimer);
+    spFlushTimer_->setInterval(FLUSH_MS);
+    connect(spFlushTimer_.data(), SIGNAL(timeout()), this, SLOT(slotDrain()) );
+    spFlushTimer_->start();
+}
+
+void PCapThread::slotStartReplay(const QString &path, const QString &filter, bool realtime)
+{
+    std::string errmsg;
+    replay_ = true;
+    spFileImpl_->setRealtime(realtime);
+
+    /* Classic pcap files read at full speed come straight from a mapping,
+     * anything else (pcapng, pacing) goes through libpcap */
+    if ( BinLogReader::probe(path.toLocal8Bit().constData()) )
+        startLogImport(path);
+    else if ( !realtime && !spMMapImpl_->init(path.toLocal8Bit().constData(), 
+                filter.toUtf8().constData(), errmsg) )
+        startPolling(spMMapImpl_.data(), 0);
+    else if ( spFileImpl_->init(path.toLocal8Bit().constData(), filter.toUtf8().constData(), errmsg) )
+    {
+        emit sigError("Error opening " + path + " " + QString::fromStdString(errmsg) );
+        emit sigDone();
+    }
+    else
+    {
+        /* Read flat out, or check back every millisecond for the next due packet */
+        startPolling(spFileImpl_.data(), realtime ? 1 : 0);
+    }
+}
+
+void PCapThread::startLogImport(const QString &path)
+{
+    /* Read on a zero timer like a file replay; the filter and pacing do not
+     * apply to records */
+    std::string errmsg;
+    spLogReader_ = QSharedPointer<BinLogReader>(new BinLogReader);
+    if ( spLogReader_->open(path.toLocal8Bit().constData(), errmsg) )
+    {
+        spLogReader_ = QSharedPointer<BinLogReader>(NULL);
+        emit sigError("Error opening " + path + " " + QString::fromStdString(errmsg) );
+        emit sigDone();
+        return;
+    }
+    spSequencer_ = QSharedPointer<LogSequencer>(new LogSequencer);
+    nLogQueries_ = 0;
+    startTimers();
     spTimer_ = QSharedPointer<QTimer>(new QTimer);
     spTimer_->setInterval(0);
+    connect(spTimer_.data(), SIGNAL(timeout()), this, SLOT(slotReadLog()) );
+    spTimer_->start();
+}
+
+void PCapThread::slotReadLog()
+{
+    /* Whole blocks until the budget runs out, published as they are read */
+    QElapsedTimer budget;
+    budget.start();
+    std::string errmsg;
+    int ret;
+    do
+    {
+        size_t first = pending_.size(), firstAnswer = pendingAnswers_.size();
+        ret = spLogReader_->next(*pNames_, pending_, pendingAnswers_, errmsg);
+        spSequencer_->apply(pending_, first, pendingAnswers_, firstAnswer);
+        nLogQueries_ += pending_.size() - first;
+        slotFlush();
+    } while ( 0 < ret && budget.elapsed() < budgetMs_ );
+
+    if ( 0 > ret )
+        emit sigError(QString::fromStdString(errmsg));
+    if ( 0 >= ret )
+        finishLogImport();
+}
+
+void PCapThread::finishLogImport()
+{
+    qint64 elapsedMs = spRunTime_->elapsed();
+    unsigned long long nBytes = spLogReader_->bytesRead();
+    if ( spLogReader_->badBlocks() )
+        emit sigError(QString("Skipped %1 damaged blocks").arg(spLogReader_->badBlocks()));
+    slotStop();
+    emit sigReplayDone(nLogQueries_, nBytes, elapsedMs);
+}
+
+void PCapThread::startTimers()
+{
+    /* Start the kBps update timer and the elapsed timer */
     spkBpsTimer_ = QSharedPointer<QTimer>(new QTimer);
     spkBpsTimer_->setInterval(500);
     spElapsed_ = QSharedPointer<QElapsedTimer>(new QElapsedTimer);
-    connect(spTimer_.data(), SIGNAL(timeout()), this, SLOT(slotPoll()) );
+    spRunTime_ = QSharedPointer<QElapsedTimer>(new QElapsedTimer);
     connect(spkBpsTimer_.data(), SIGNAL(timeout()), this, SLOT(slotKbps()) );
-    std::string errmsg;
-    std::map<std::string, std::string>::iterator it;
-    if ( devMap_.end() == ( it = devMap_.find( devDesc.toUtf8().constData() ) ) )
+    prevBytes_ = prevPackets_ = prevParsed_ = 0;
+    if ( spMetrics_ )
     {
-        emit sigError("Device not found");
-        emit sigDone();
-    }   
-    else if ( spPCapImpl_->init(it->second, errmsg) )
-    {   
-        emit sigError("Error initializing " + devDesc + " " + QString::fromStdString(errmsg) ); 
-        emit sigDone();
+        qtypeCounts_.assign(qtypeCounts_.size(), 0);
+        nameCounts_.clear();
+    }
+    top_.clear();
+    folder_.clear();
+    spkBpsTimer_->start();
+    spElapsed_->start();
+    spRunTime_->start();
+}
+
+void PCapThread::startPolling(IFCapImpl *pImpl, int idleMs)
+{
+    pCapImpl_ = pImpl;
+    startTimers();
+
+    /* Wake up when the capture fd is readable, otherwise on a timer */
+    int fd = pCapImpl_->getSelectableFd();
+    if ( -1 != fd )
+    {
+        spNotifier_ = QSharedPointer<QSocketNotifier>(new QSocketNotifier(fd, QSocketNotifier::Read));
+        connect(spNotifier_.data(), SIGNAL(activated(int)), this, SLOT(slotPoll()) );
     }
     else
     {
-        spkBpsTimer_->start();
-        spElapsed_->start();
+        spTimer_ = QSharedPointer<QTimer>(new QTimer);
+        spTimer_->setInterval(idleMs);
+        connect(spTimer_.data(), SIGNAL(timeout()), this, SLOT(slotPoll()) );
         spTimer_->start();
     }
+    spFlushTimer_ = QSharedPointer<QTimer>(new QTimer);
+    spFlushTimer_->setInterval(FLUSH_MS);
+    connect(spFlushTimer_.data(), SIGNAL(timeout()), this, SLOT(slotFlush()) );
+    spFlushTimer_->start();
+}
+
+void PCapThread::collectStats(CapStats &stats, unsigned long long &queueDepth)
+{
+    /* Live captures add up their workers' counters, which are safe to read
+     * from here */
+    stats.clear();
+    queueDepth = 0;
+    if ( spLogReader_ )
+    {
+        stats.nPackets = stats.nParsed = nLogQueries_;
+        stats.nBytes = spLogReader_->bytesRead();
+        return;
+    }
+    if ( replay_ )
+    {
+        pCapImpl_->updateKernelStats();
+        pCapImpl_->getStats(stats);
+        return;
+    }
+    unsigned long long published = 0;
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+        CapStats workerStats;
+        workers_[i]->getStats(workerStats);
+        stats.add(workerStats);
+        published += workers_[i]->published();
+    }
+    queueDepth = published > nDrained_ ? published - nDrained_ : 0;
 }
 
 void PCapThread::slotKbps()
 {
-    /* Update the kBps, emit to the main thread */
-    quint64 nbytes = spPCapImpl_->getNBytes();
+    /* Update the kBps and the rates, emit to the main thread */
+    StatsSnapshot snap;
+    collectStats(snap.totals, snap.queueDepth);
     quint64 elapsed = spElapsed_->restart();
-    double kBps = ( static_cast<double>( ( nbytes - prevBytes_ ) * 8) / 1024.L ) 
-        / ( static_cast<double>(elapsed) / 1000.L );
-    prevBytes_ = nbytes;
-    emit sigkBps(kBps);
+    double secs = static_cast<double>(qMax<quint64>(elapsed, 1)) / 1000.L;
+    snap.kBps = ( static_cast<double>( ( snap.totals.nBytes - prevBytes_ ) * 8) / 1024.L ) / secs;
+    snap.pktRate = ( snap.totals.nPackets - prevPackets_ ) / secs;
+    snap.dnsRate = ( snap.totals.nParsed - prevParsed_ ) / secs;
+    snap.seconds = spRunTime_->elapsed() / 1000.0;
+    prevBytes_ = snap.totals.nBytes;
+    prevPackets_ = snap.totals.nPackets;
+    prevParsed_ = snap.totals.nParsed;
+    emit sigkBps(snap.kBps);
+    emit sigStats(snap);
+    if ( spMetrics_ )
+        publishMetrics(snap);
+    if ( top_.size() && pNames_ )
+    {
+        /* Merging the windows' sketches is a fixed cost, done here rather than per batch */
+        TopSnapshot top;
+        top_.snapshot(*pNames_, top);
+        emit sigTopN(top);
+    }
+}
+
+void PCapThread::countQueries(const QueryBatch &queries)
+{
+    for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+    {
+        ++qtypeCounts_[it->qtype];
+        if ( it->nameId >= NameTable::FULL_ID )
+            continue;
+        unsigned int nameId = folder_.fold(it->nameId);
+        if ( nameId >= nameCounts_.size() )
+            nameCounts_.resize(nameId + 1 + nameCounts_.size() / 2, 0);
+        ++nameCounts_[nameId];
+    }
+}
+
+void PCapThread::publishMetrics(const StatsSnapshot &snap)
+{
+    /* Fill the server's spare snapshot; scrapes never wait on this */
+    MetricsSnapshot &metrics = spMetrics_->writeBuffer();
+    metrics.stats = snap;
+    metrics.qtypes.clear();
+    for (size_t i = 0; i < qtypeCounts_.size(); i++)
+    {
+        if ( qtypeCounts_[i] )
+            metrics.qtypes.push_back(std::make_pair(static_cast<unsigned short>(i), qtypeCounts_[i]));
+    }
+
+    /* Busiest names through a min-heap of topNames_ entries */
+    typedef std::pair<unsigned int, unsigned int> CountId;
+    std::priority_queue<CountId, std::vector<CountId>, std::greater<CountId> > top;
+    for (size_t i = 0; pNames_ && i < nameCounts_.size() && topNames_; i++)
+    {
+        if ( !nameCounts_[i] )
+            continue;
+        if ( top.size() < static_cast<size_t>(topNames_) )
+            top.push(CountId(nameCounts_[i], static_cast<unsigned int>(i)));
+        else if ( nameCounts_[i] > top.top().first )
+        {
+            top.pop();
+            top.push(CountId(nameCounts_[i], static_cast<unsigned int>(i)));
+        }
+    }
+    metrics.topNames.resize(top.size());
+    for (size_t i = top.size(); i-- > 0; top.pop())
+    {
+        metrics.topNames[i].first = pNames_->text(top.top().second);
+        metrics.topNames[i].second = top.top().first;
+    }
+    spMetrics_->publish();
+}
+
+void PCapThread::stopPolling()
+{
+    /* Drop the poll source, the notifier must go before the fd is closed */
+    spNotifier_ = QSharedPointer<QSocketNotifier>(NULL);
+    if ( spTimer_ )
+        spTimer_->stop();
+    spTimer_ = QSharedPointer<QTimer>(NULL);
+    spFlushTimer_ = QSharedPointer<QTimer>(NULL);
+    stopWorkers();
+    slotFlush();
+}
+
+void PCapThread::stopWorkers()
+{
+    /* Once joined nothing pushes any more, so one drain empties the queue */
+    for (size_t i = 0; i < workers_.size(); i++)
+        workers_[i]->stop();
+    drainWorkers();
+    /* Report the final counts while the workers are still around */
+    if ( !workers_.empty() && spElapsed_ )
+        slotKbps();
+    workers_.clear();
+}
+
+void PCapThread::drainWorkers()
+{
+    /* Worker seqs are mapped onto one consecutive sequence in the order
+     * batches arrive, which is what QueryTableModel expects */
+    for (CaptureBatch *pBatch; ( pBatch = queue_.pop() ); )
+    {
+        std::deque<SeqSegment> &segments = seqMaps_[pBatch->worker];
+        if ( !pBatch->queries.empty() )
+        {
+            SeqSegment segment = { pBatch->queries.front().seq, nextSeq_, pBatch->queries.size() };
+            segments.push_back(segment);
+            size_t first = pending_.size();
+            pending_.insert(pending_.end(), pBatch->queries.begin(), pBatch->queries.end());
+            for (size_t i = first; i < pending_.size(); i++)
+                pending_[i].seq = nextSeq_++;
+        }
+        for (AnswerBatch::iterator it = pBatch->answers.begin(); it != pBatch->answers.end(); ++it)
+        {
+            std::deque<SeqSegment>::iterator seg = 
+                std::upper_bound(segments.begin(), segments.end(), it->seq, SegmentBefore());
+            if ( seg == segments.begin() || it->seq >= ( --seg )->local + seg->count )
+                continue;
+            it->seq = seg->global + ( it->seq - seg->local );
+            pendingAnswers_.push_back(*it);
+        }
+
+        /* Segments no answer can point into any more */
+        while ( !segments.empty() && segments.front().local + segments.front().count <= pBatch->floorSeq )
+            segments.pop_front();
+        workers_[pBatch->worker]->recycle(pBatch);
+        ++nDrained_;
+    }
+}
+
+void PCapThread::slotDrain()
+{
+    drainWorkers();
+    std::string errmsg;
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+        if ( workers_[i]->failed(errmsg) )
+        {
+            emit sigError(QString::fromStdString(errmsg));
+            slotStop();
+            return;
+        }
+    }
+    slotFlush();
+}
+
+void PCapThread::slotFlush()
+{
+    /* Publish everything parsed since the last flush, queries before the
+     * answers that refer to them */
+    if ( !pending_.empty() )
+    {
+        if ( spMetrics_ )
+            countQueries(pending_);
+        top_.add(pending_, folder_);
+        emit sigDataReady(pending_);
+        pending_.clear();
+    }
+    if ( !pendingAnswers_.empty() )
+    {
+        top_.add(pendingAnswers_);
+        emit sigAnswersReady(pendingAnswers_);
+        pendingAnswers_.clear();
+    }
 }
 
 void PCapThread::slotStop()
 {
-    /* Stop the two timers and disconnect their signals */
-    spTimer_->stop();
-    spkBpsTimer_->stop();
-    if ( !disconnect(spTimer_.data(), SIGNAL(timeout()), this, SLOT(slotPoll())) )
-        emit sigError("Error Disconnecting timer slot");
-    if (!disconnect(spkBpsTimer_.data(), SIGNAL(timeout()), this, SLOT(slotKbps())) )
-        emit sigError("Error Disconnecting kBps slot");
-    spPCapImpl_->shutDown();
+    /* Stop polling and the kBps timer */
+    stopPolling();
+    if ( spkBpsTimer_ )
+    {
+        spkBpsTimer_->stop();
+        if (!disconnect(spkBpsTimer_.data(), SIGNAL(timeout()), this, SLOT(slotKbps())) )
+            emit sigError("Error Disconnecting kBps slot");
+    }
+    if ( replay_ )
+    {
+        if ( spElapsed_ )
+            slotKbps();
+        if ( spLogReader_ )
+            spLogReader_ = QSharedPointer<BinLogReader>(NULL);
+        else
+            pCapImpl_->shutDown();
+    }
     emit sigDone();
 }
 
 void PCapThread::slotQuit()
 {
-    spTimer_ = QSharedPointer<QTimer>(NULL);
+    stopPolling();
     spkBpsTimer_ = QSharedPointer<QTimer>(NULL);
     spThread_->quit();
 }
 
 void PCapThread::slotPoll()
 {
-    /* Get the next DNS entry string */
-    std::string pktStr;
-    int ret = spPCapImpl_->getNextPacket(pktStr);
-    if ( 0 > ret )
+    /* Drain ready packets in batches until the capture is empty or the time
+     * budget runs out, then go back to the event loop so stop/quit get in */
+    QElapsedTimer budget;
+    budget.start();
+    int ret;
+    do
+    {
+        ret = pCapImpl_->dispatch(batchSize_, pending_, pendingAnswers_);
+        if ( pending_.size() + pendingAnswers_.size() >= FLUSH_COUNT )
+            slotFlush();
+    } while ( 0 < ret && budget.elapsed() < budgetMs_ );
+
+    if ( IFCapImpl::CAP_EOF == ret )
+        finishReplay();
+    else if ( 0 > ret )
     {
         emit sigError("Error reading from interface");
-        spTimer_->stop();
+        stopPolling();
         emit sigDone();
     }
-    else if ( 0 < ret && !pktStr.empty() )
-    {
-        QString qStr =  QString::fromStdString(pktStr);
-        emit sigDataReady(qStr);
-    }
+}
+
+void PCapThread::finishReplay()
+{
+    /* Nothing more can answer what is still pending at the end of the file */
+    pCapImpl_->expire(~0ULL, pendingAnswers_);
+    qint64 elapsedMs = spRunTime_->elapsed();
+    CapStats stats;
+    pCapImpl_->getStats(stats);
+    slotStop();
+    emit sigReplayDone(stats.nPackets, stats.nBytes, elapsedMs);
 }
 
 /* Called directly from the main thread */
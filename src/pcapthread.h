@@ -1,16 +1,38 @@
+#ifndef __PCAPTHREAD_H
+#define __PCAPTHREAD_H
+
+#include <deque>
 #include <map>
+#include <string>
+#include <vector>
 #include <QObject>
 #include <QSharedPointer>
 #include <QStringList>
+#include <QMetaType>
+
+#include "capstats.h"
+#include "dnsquery.h"
+#include "mpscqueue.h"
+#include "nametable.h"
+#include "topn.h"
 
 class QThread;
 class QTimer;
 class QElapsedTimer;
+class QSocketNotifier;
 
 namespace DNSView
 {
 
+class IFCapImpl;
 class PCapImpl;
+class PCapFileImpl;
+class ShardedFileImpl;
+class CaptureWorker;
+class MetricsServer;
+class BinLogReader;
+class LogSequencer;
+struct CaptureBatch;
 
 class PCapThread : public QObject
 {
@@ -21,29 +43,107 @@ public:
     virtual ~PCapThread();
 
     void waitForThread();
+    void setBatch(int batchSize, int budgetMs);
+    void setNameTable(NameTable *pNames);
+    void setTimeout(unsigned int timeoutMs);
+    void setHugePages(bool hugePages);
+    void setThreads(int nThreads);
+    void setFanout(int nThreads);
+    void setRing(unsigned int blockSize, unsigned int blockCount, unsigned int retireMs);
+    int startMetrics(const std::string &addr, unsigned short port, int topNames, 
+            std::string &errmsg);
+    void setTopN(int nTop);
 
     QStringList getDeviceList();
 
 public slots:
     void slotPoll();
-    void slotStart(const QString &devDesc);
+    void slotStart(const QStringList &devDescs, const QString &filter);
+    void slotStartReplay(const QString &path, const QString &filter, bool realtime);
     void slotStop();
     void slotQuit();
     void slotKbps();
+    void slotFlush();
+    void slotDrain();
+    void slotReadLog();
 
 signals:
-    void sigDataReady(const QString &value);
+    void sigDataReady(const QueryBatch &queries);
+    void sigAnswersReady(const AnswerBatch &answers);
     void sigError(const QString &value);
     void sigDone();
     void sigkBps(double value);
+    void sigStats(const StatsSnapshot &snap);
+    void sigTopN(const TopSnapshot &top);
+    void sigReplayDone(quint64 nPackets, quint64 nBytes, qint64 elapsedMs);
 
 private:
     QSharedPointer<QThread> spThread_;
-    QSharedPointer<QTimer> spTimer_, spkBpsTimer_;
+    void startTimers();
+    void startPolling(IFCapImpl *pImpl, int idleMs);
+    void stopPolling();
+    void stopWorkers();
+    void drainWorkers();
+    void collectStats(CapStats &stats, unsigned long long &queueDepth);
+    void finishReplay();
+    void startLogImport(const QString &path);
+    void finishLogImport();
+    void countQueries(const QueryBatch &queries);
+    void publishMetrics(const StatsSnapshot &snap);
+
+    QSharedPointer<QTimer> spTimer_, spkBpsTimer_, spFlushTimer_;
+    QSharedPointer<QSocketNotifier> spNotifier_;
     QSharedPointer<PCapImpl> spPCapImpl_;
-    QSharedPointer<QElapsedTimer> spElapsed_;
+    QSharedPointer<PCapFileImpl> spFileImpl_;
+    QSharedPointer<ShardedFileImpl> spMMapImpl_;
+    IFCapImpl *pCapImpl_;       /* the replay source */
+    bool replay_;
+
+    /* Replay of a binary query log, which holds records rather than packets */
+    QSharedPointer<BinLogReader> spLogReader_;
+    QSharedPointer<LogSequencer> spSequencer_;
+    unsigned long long nLogQueries_;
+
+    /* Live capture: worker threads feeding one queue, each worker's seqs
+     * mapped onto the global sequence a batch at a time */
+    struct SeqSegment
+    {
+        unsigned long long local, global;
+        size_t count;
+    };
+    MPSCQueue<CaptureBatch> queue_;
+    std::vector<QSharedPointer<CaptureWorker> > workers_;
+    std::vector<std::deque<SeqSegment> > seqMaps_;
+    unsigned long long nextSeq_;
+    NameTable *pNames_;
+    unsigned int timeoutMs_;
+    int fanout_;
+    unsigned int ringBlockSize_, ringBlocks_, ringRetireMs_;
+    QSharedPointer<QElapsedTimer> spElapsed_, spRunTime_;
     std::map<std::string, std::string> devMap_;
-    quint64 prevBytes_;
+    quint64 prevBytes_, prevPackets_, prevParsed_;
+    unsigned long long nDrained_;   /* batches taken off queue_ */
+    int batchSize_, budgetMs_;
+    QueryBatch pending_;
+    AnswerBatch pendingAnswers_;
+
+    /* Tallies for the metrics endpoint, kept only while it is enabled */
+    QSharedPointer<MetricsServer> spMetrics_;
+    int topNames_;
+    std::vector<unsigned long long> qtypeCounts_;
+    std::vector<unsigned int> nameCounts_;      /* by NameTable id */
+
+    /* Sliding-window heavy hitters for the top panel, while it is enabled */
+    TopTracker top_;
+    /* Names as counted by both, folded to lower case */
+    NameFolder folder_;
 };
 
 }
+
+Q_DECLARE_METATYPE(DNSView::QueryBatch)
+Q_DECLARE_METATYPE(DNSView::AnswerBatch)
+Q_DECLARE_METATYPE(DNSView::StatsSnapshot)
+Q_DECLARE_METATYPE(DNSView::TopSnapshot)
+
+#endif
@@ -0,0 +1,516 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#   include <direct.h>
+#   include <io.h>
+#else
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "dnsviewer.h"
+#ifdef HAVE_ZLIB
+#   include <zlib.h>
+#endif
+
+#include "querylog.h"
+#include "binlog.h"
+#include "querystore.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+long long monotonicSecs()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int makeDir(const std::string &path)
+{
+#ifdef _WIN32
+    int ret = _mkdir(path.c_str());
+#else
+    int ret = ::mkdir(path.c_str(), 0755);
+#endif
+    return ret && EEXIST != errno ? -1 : 0;
+}
+
+bool exists(const std::string &path)
+{
+    std::FILE *pFile = std::fopen(path.c_str(), "r");
+    if ( pFile )
+        std::fclose(pFile);
+    return NULL != pFile;
+}
+
+/* "<prefix><yyyymmdd-hhmmss><suffix>", with a counter if that is taken */
+std::string segmentName(const std::string &prefix, const char *suffix)
+{
+    std::time_t t = std::time(NULL);
+    std::tm tm;
+#ifdef _WIN32
+    bool ok = !localtime_s(&tm, &t);
+#else
+    bool ok = localtime_r(&t, &tm) != NULL;
+#endif
+    char stamp[32] = "0";
+    if ( ok )
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    std::string name = prefix + stamp + suffix;
+    for (int i = 1; ; i++)
+    {
+        if ( !exists(name) && !exists(name + ".gz") )
+            return name;
+        char counter[16];
+        std::snprintf(counter, sizeof(counter), "-%d", i);
+        name = prefix + stamp + counter + suffix;
+    }
+}
+
+#ifdef HAVE_ZLIB
+/* Compresses a rotated segment to <segment>.gz and removes it, on its own thread */
+struct Compressor
+{
+    std::string segment;
+
+    void operator()() const
+    {
+        std::string gzName = segment + ".gz";
+        std::FILE *pIn = std::fopen(segment.c_str(), "rb");
+        if ( !pIn )
+            return;
+        gzFile out = gzopen(gzName.c_str(), "wb6");
+        bool ok = NULL != out;
+        std::vector<char> buf(1 << 20);
+        size_t n;
+        while ( ok && ( n = std::fread(&buf[0], 1, buf.size(), pIn) ) > 0 )
+            ok = gzwrite(out, &buf[0], static_cast<unsigned>(n)) == static_cast<int>(n);
+        ok = ok && !std::ferror(pIn);
+        std::fclose(pIn);
+        if ( out && Z_OK != gzclose(out) )
+            ok = false;
+        /* Keep the plain segment if anything went wrong */
+        std::remove(ok ? segment.c_str() : gzName.c_str());
+    }
+};
+#endif
+
+}
+
+size_t formatLogLine(const DNSQuery &query, const NameTable &names, TimeFormatter &times, char *buf)
+{
+    size_t n = times.format(query.tv_sec, query.tv_usec, buf);
+    std::memcpy(buf + n, ": IPv", 5);
+    n += 5;
+    buf[n++] = static_cast<char>('0' + query.ver % 10);
+    buf[n++] = ':';
+    buf[n++] = ' ';
+    n += names.render(query.nameId, buf + n);
+    buf[n++] = '\n';
+    return n;
+}
+
+LogPolicy::LogPolicy() : maxBytes(0), rotateSecs(0), compress(false), fsyncSecs(0), binary(false), 
+    index(false)
+{}
+
+QueryLog::QueryLog() :
+    pNames_(NULL),
+    queued_(0),
+    dropped_(0),
+    reopen_(false),
+    stop_(false),
+    pFile_(NULL),
+    size_(0),
+    openedAt_(0),
+    syncedAt_(0),
+    reported_(0),
+    writeFailed_(false)
+{}
+
+QueryLog::~QueryLog()
+{
+    close();
+    if ( compressor_.joinable() )
+        compressor_.join();
+}
+
+void QueryLog::setPolicy(const LogPolicy &policy)
+{
+    next_ = policy;
+}
+
+int QueryLog::open(const std::string &path, const NameTable &names, std::string &errmsg)
+{
+    close();
+#ifndef HAVE_ZLIB
+    if ( next_.compress )
+    {
+        errmsg = "Compressed log segments need zlib, which this build does not have";
+        return -1;
+    }
+#endif
+    path_ = path;
+    policy_ = next_;
+    /* A .dnsl name asks for the binary format whatever the policy says */
+    if ( policy_.index || ( path.size() > 5 && !path.compare(path.size() - 5, 5, ".dnsl") ) )
+        policy_.binary = true;
+    if ( policy_.index && ( policy_.compress || "-" == path ) )
+    {
+        errmsg = "A query store needs a directory of plain segments";
+        return -1;
+    }
+    if ( policy_.index && makeDir(path) )
+    {
+        errmsg = "Error creating " + path + ": " + std::strerror(errno);
+        return -1;
+    }
+    pNames_ = &names;
+    spBinary_.reset(policy_.binary ? new BinLogWriter(names) : NULL);
+    spIndexer_.reset(policy_.index ? new SegmentIndexer(names) : NULL);
+    /* Opened here so a bad path is reported to the caller */
+    if ( openFile(errmsg) )
+        return -1;
+    queued_ = 0;
+    dropped_ = 0;
+    reported_ = 0;
+    reopen_ = false;
+    stop_ = false;
+    syncedAt_ = monotonicSecs();
+    writer_ = std::thread(&QueryLog::run, this);
+    return 0;
+}
+
+void QueryLog::reopen()
+{
+    reopen_ = true;
+    wake_.notify_one();
+}
+
+void QueryLog::close()
+{
+    if ( !writer_.joinable() )
+        return;
+    stop_ = true;
+    wake_.notify_one();
+    writer_.join();
+}
+
+bool QueryLog::isOpen() const
+{
+    return writer_.joinable();
+}
+
+void QueryLog::write(const QueryBatch &queries)
+{
+    /* Never waits on the writer; a full queue costs the batch instead */
+    if ( !writer_.joinable() || queries.empty() )
+        return;
+    if ( queued_.load(std::memory_order_relaxed) + queries.size() > MAX_QUEUED )
+    {
+        dropped_.fetch_add(queries.size(), std::memory_order_relaxed);
+        return;
+    }
+    LogBatch *pBatch = getBatch();
+    pBatch->queries.assign(queries.begin(), queries.end());
+    queued_.fetch_add(queries.size(), std::memory_order_relaxed);
+    queue_.push(pBatch);
+    wake_.notify_one();
+}
+
+void QueryLog::write(const AnswerBatch &answers)
+{
+    if ( !writer_.joinable() || !policy_.binary || answers.empty() )
+        return;
+    if ( queued_.load(std::memory_order_relaxed) + answers.size() > MAX_QUEUED )
+        return;
+    LogBatch *pBatch = getBatch();
+    pBatch->answers.assign(answers.begin(), answers.end());
+    queued_.fetch_add(answers.size(), std::memory_order_relaxed);
+    queue_.push(pBatch);
+    wake_.notify_one();
+}
+
+LogBatch *QueryLog::getBatch()
+{
+    LogBatch *pBatch = free_.pop();
+    if ( !pBatch )
+    {
+        batches_.push_back(std::unique_ptr<LogBatch>(new LogBatch));
+        pBatch = batches_.back().get();
+    }
+    return pBatch;
+}
+
+unsigned long long QueryLog::dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+bool QueryLog::takeError(std::string &errmsg)
+{
+    std::lock_guard<std::mutex> lock(errorLock_);
+    if ( error_.empty() )
+        return false;
+    errmsg.swap(error_);
+    error_.clear();
+    return true;
+}
+
+void QueryLog::run()
+{
+    buf_.reserve(BLOCK_SIZE + LOG_LINE_MAX);
+    for (;;)
+    {
+        /* Everything queued goes out in blocks, then whatever is left over */
+        LogBatch *pBatch;
+        while ( NULL != ( pBatch = queue_.pop() ) )
+        {
+            append(*pBatch);
+            queued_.fetch_sub(pBatch->queries.size() + pBatch->answers.size(), std::memory_order_relaxed);
+            pBatch->queries.clear();
+            pBatch->answers.clear();
+            free_.push(pBatch);
+        }
+        unsigned long long dropped = dropped_.load(std::memory_order_relaxed);
+        if ( dropped != reported_ && spBinary_ )
+        {
+            spBinary_->addDropped(dropped - reported_);
+            reported_ = dropped;
+        }
+        else if ( dropped != reported_ )
+        {
+            char line[64];
+            int n = std::snprintf(line, sizeof(line), "# %llu queries dropped, log writer behind\n", 
+                    dropped - reported_);
+            buf_.insert(buf_.end(), line, line + n);
+            reported_ = dropped;
+        }
+        flushBlock();
+
+        long long now = monotonicSecs();
+        if ( pFile_ && stdout != pFile_ && size_ && policy_.rotateSecs && 
+                now - openedAt_ >= policy_.rotateSecs )
+            rotate();
+        if ( policy_.fsyncSecs > 0 && now - syncedAt_ >= policy_.fsyncSecs )
+        {
+            sync();
+            syncedAt_ = now;
+        }
+        if ( reopen_.exchange(false) && stdout != pFile_ )
+        {
+            std::string errmsg;
+            closeFile();
+            if ( openFile(errmsg) )
+                setError(errmsg);
+        }
+        /* The queue may look empty for a moment while a push is half done */
+        if ( stop_ && !queued_.load(std::memory_order_relaxed) )
+            break;
+
+        std::unique_lock<std::mutex> lock(wakeLock_);
+        wake_.wait_for(lock, std::chrono::milliseconds(50));
+    }
+    if ( policy_.fsyncSecs >= 0 )
+        sync();
+    closeFile();
+}
+
+void QueryLog::append(const LogBatch &batch)
+{
+    if ( spBinary_ )
+    {
+        if ( spIndexer_ )
+            spIndexer_->add(batch.queries);
+        spBinary_->add(batch.queries);
+        spBinary_->add(batch.answers);
+        if ( spBinary_->size() >= BLOCK_SIZE )
+            flushBlock();
+        return;
+    }
+    const QueryBatch &queries = batch.queries;
+    char line[LOG_LINE_MAX];
+    for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+    {
+        size_t len = formatLogLine(*it, *pNames_, times_, line);
+        buf_.insert(buf_.end(), line, line + len);
+        if ( buf_.size() >= BLOCK_SIZE )
+            flushBlock();
+    }
+}
+
+void QueryLog::flushBlock()
+{
+    if ( spBinary_ && !spBinary_->empty() )
+        spBinary_->finish(buf_);
+    if ( buf_.empty() )
+        return;
+    if ( pFile_ && stdout != pFile_ && policy_.maxBytes && size_ && !spIndexer_ && 
+            size_ + buf_.size() > policy_.maxBytes )
+        rotate();
+    if ( pFile_ && spBinary_ && !size_ )
+    {
+        /* Every segment starts with its own header */
+        std::vector<char> header;
+        BinLogWriter::fileHeader(header);
+        writeOut(header);
+    }
+    if ( pFile_ && spIndexer_ )
+        spIndexer_->endBlock(size_, static_cast<unsigned int>(buf_.size()));
+    if ( pFile_ )
+        writeOut(buf_);
+    buf_.clear();
+    /* An indexed segment is only cut between blocks, so it may run over by one */
+    if ( pFile_ && spIndexer_ && policy_.maxBytes && size_ >= policy_.maxBytes )
+        rotate();
+}
+
+void QueryLog::writeOut(const std::vector<char> &data)
+{
+    size_t n = std::fwrite(&data[0], 1, data.size(), pFile_);
+    if ( stdout == pFile_ )
+        std::fflush(pFile_);
+    /* Reported once until a write goes through again */
+    if ( n != data.size() && !writeFailed_ )
+        setError("Error writing " + path_ + ": " + std::strerror(errno));
+    writeFailed_ = n != data.size();
+    size_ += n;
+}
+
+int QueryLog::openFile(std::string &errmsg)
+{
+    size_ = 0;
+    if ( "-" == path_ )
+    {
+        pFile_ = stdout;
+        return 0;
+    }
+    /* A store starts a segment named for its start time every time */
+    filePath_ = spIndexer_ ? segmentName(path_ + "/dns-", ".dnsl") : path_;
+    pFile_ = std::fopen(filePath_.c_str(), "ab");
+    if ( !pFile_ )
+    {
+        errmsg = "Error opening file " + filePath_ + ": " + std::strerror(errno);
+        return -1;
+    }
+    /* Blocks are already large, stdio's buffer would only copy them again */
+    std::setvbuf(pFile_, NULL, _IONBF, 0);
+    std::fseek(pFile_, 0, SEEK_END);
+    long pos = std::ftell(pFile_);
+    size_ = pos > 0 ? pos : 0;
+    openedAt_ = monotonicSecs();
+    return 0;
+}
+
+void QueryLog::closeFile()
+{
+    if ( pFile_ && stdout != pFile_ )
+        std::fclose(pFile_);
+    else if ( pFile_ )
+        std::fflush(pFile_);
+    if ( pFile_ && spIndexer_ && !spIndexer_->empty() )
+    {
+        /* The segment is complete, so its index can be written */
+        std::string errmsg;
+        if ( spIndexer_->write(filePath_.substr(0, filePath_.size() - 5) + ".dnsi", errmsg) )
+            setError(errmsg);
+    }
+    else if ( pFile_ && spIndexer_ && !size_ )
+        std::remove(filePath_.c_str());
+    if ( spIndexer_ )
+        spIndexer_->clear();
+    pFile_ = NULL;
+}
+
+void QueryLog::rotate()
+{
+    /* Store segments are named when they start and stay where they are */
+    std::string errmsg;
+    if ( spIndexer_ )
+    {
+        if ( policy_.fsyncSecs >= 0 )
+            sync();
+        closeFile();
+        if ( openFile(errmsg) )
+            setError(errmsg);
+        return;
+    }
+
+    /* The full segment is moved aside and a new one started under the same name */
+    std::string segment(segmentName(path_ + ".", ""));
+    if ( policy_.fsyncSecs >= 0 )
+        sync();
+    closeFile();
+    if ( std::rename(path_.c_str(), segment.c_str()) )
+        setError("Error renaming " + path_ + " to " + segment + ": " + std::strerror(errno));
+#ifdef HAVE_ZLIB
+    else if ( policy_.compress )
+    {
+        /* One segment at a time; a slow disk backs up the queue, not the caller */
+        if ( compressor_.joinable() )
+            compressor_.join();
+        Compressor compress = { segment };
+        compressor_ = std::thread(compress);
+    }
+#endif
+    if ( openFile(errmsg) )
+        setError(errmsg);
+}
+
+void QueryLog::sync()
+{
+    if ( !pFile_ || stdout == pFile_ )
+        return;
+    std::fflush(pFile_);
+#ifdef _WIN32
+    _commit(_fileno(pFile_));
+#else
+    ::fsync(fileno(pFile_));
+#endif
+}
+
+void QueryLog::setError(const std::string &errmsg)
+{
+    std::lock_guard<std::mutex> lock(errorLock_);
+    error_ = errmsg;
+}
+
+}
@@ -0,0 +1,137 @@
+#ifndef __QUERYLOG_H
+#define __QUERYLOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dnsquery.h"
+#include "mpscqueue.h"
+#include "nametable.h"
+#include "timefmt.h"
+
+namespace DNSView
+{
+
+class BinLogWriter;
+class SegmentIndexer;
+
+/* One line of the text log, "<local time>: IPv<n>: <name>\n"; buf must hold
+ * LOG_LINE_MAX bytes. Returns the length. */
+enum { LOG_LINE_MAX = TimeFormatter::TIME_STRLEN + 9 + NameTable::NAME_STRLEN };
+size_t formatLogLine(const DNSQuery &query, const NameTable &names, TimeFormatter &times, char *buf);
+
+/* When the log is cut into segments and flushed to the disk */
+struct LogPolicy
+{
+    unsigned long long maxBytes;    /* rotate past this size, 0 = never */
+    unsigned int rotateSecs;        /* rotate this often, 0 = never */
+    bool compress;                  /* gzip rotated segments */
+    int fsyncSecs;                  /* -1 never, 0 on rotate and close, n also every n seconds */
+    bool binary;                    /* binlog.h records instead of text lines */
+    bool index;                     /* the path is a querystore.h directory */
+
+    LogPolicy();
+};
+
+/* Queries or answers waiting for the writer thread */
+struct LogBatch : MPSCNode
+{
+    QueryBatch queries;
+    AnswerBatch answers;
+};
+
+/* The log of queries: text, "<local time>: IPv<n>: <name>" per line, the
+ * binary format of binlog.h, which also keeps the answers, or a searchable
+ * store of binary segments (querystore.h) indexed as they are written.
+ * write() only copies the batch onto a queue; a writer thread encodes it
+ * into large blocks, rotates and syncs the file, so the disk never holds up
+ * the caller. When the writer falls too far behind, batches are dropped and
+ * the log says how many. Shared by the window and the headless mode. */
+class QueryLog
+{
+public:
+    QueryLog();
+    ~QueryLog();
+
+    /* Applies to the next open() */
+    void setPolicy(const LogPolicy &policy);
+
+    /* Appends to path, "-" for standard output; names must outlive close() */
+    int open(const std::string &path, const NameTable &names, std::string &errmsg);
+    /* Has the writer close and open the same path again, after it was moved away */
+    void reopen();
+    /* Writes out everything queued and stops the writer */
+    void close();
+    bool isOpen() const;
+
+    void write(const QueryBatch &queries);
+    /* Binary logs only, ignored for text */
+    void write(const AnswerBatch &answers);
+
+    unsigned long long dropped() const;
+    /* The last error from the writer thread, once */
+    bool takeError(std::string &errmsg);
+
+private:
+    QueryLog(const QueryLog&);
+    QueryLog &operator=(const QueryLog&);
+
+    enum { BLOCK_SIZE = 1 << 20, MAX_QUEUED = 1 << 20 };
+
+    void run();
+    LogBatch *getBatch();
+    void append(const LogBatch &batch);
+    void flushBlock();
+    void writeOut(const std::vector<char> &data);
+    int openFile(std::string &errmsg);
+    void closeFile();
+    void rotate();
+    void sync();
+    void setError(const std::string &errmsg);
+
+    /* Set by open(), read by the writer */
+    std::string path_;
+    LogPolicy policy_;
+    LogPolicy next_;
+    const NameTable *pNames_;
+
+    /* Caller side */
+    MPSCQueue<LogBatch> free_;
+    std::vector<std::unique_ptr<LogBatch> > batches_;
+    std::thread writer_;
+
+    /* Between the caller and the writer */
+    MPSCQueue<LogBatch> queue_;
+    std::atomic<unsigned long long> queued_;    /* queries in the queue */
+    std::atomic<unsigned long long> dropped_;
+    std::atomic<bool> reopen_;
+    std::atomic<bool> stop_;
+    std::mutex wakeLock_;
+    std::condition_variable wake_;
+    std::mutex errorLock_;
+    std::string error_;
+
+    /* Writer side */
+    std::FILE *pFile_;
+    unsigned long long size_;
+    long long openedAt_;
+    long long syncedAt_;
+    unsigned long long reported_;
+    bool writeFailed_;
+    std::vector<char> buf_;     /* one block of lines or records */
+    std::unique_ptr<BinLogWriter> spBinary_;
+    std::unique_ptr<SegmentIndexer> spIndexer_;
+    std::string filePath_;      /* path_, or the store segment being written */
+    TimeFormatter times_;
+    std::thread compressor_;
+};
+
+}
+
+#endif
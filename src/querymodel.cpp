@@ -0,0 +1,757 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <climits>
+#include <QColor>
+#include <QStringList>
+
+#include "querymodel.h"
+#include "nametable.h"
+#include "dnsparse.h"
+
+namespace DNSView
+{
+
+struct QueryTableModel::Less
+{
+    const QueryTableModel *pModel;
+    int column;
+    bool desc;
+
+    bool operator()(quint32 a, quint32 b) const
+    {
+        return desc ? lessThan(b, a) : lessThan(a, b);
+    }
+
+    bool lessThan(quint32 a, quint32 b) const
+    {
+        const QueryTableModel &m = *pModel;
+        switch (column)
+        {
+        case COL_VER:
+            return m.ver_[a] < m.ver_[b];
+        case COL_SRC:
+            return m.addrs_[m.src_[a]] < m.addrs_[m.src_[b]];
+        case COL_DST:
+            return m.addrs_[m.dst_[a]] < m.addrs_[m.dst_[b]];
+        case COL_TYPE:
+            return m.qtype_[a] < m.qtype_[b];
+        case COL_NAME:
+            return m.pNames_->compare(m.name_[a], m.name_[b]) < 0;
+        case COL_LATENCY:
+            return m.latency_[a] < m.latency_[b];
+        case COL_RESULT:
+            return m.rcode_[a] < m.rcode_[b] || 
+                ( m.rcode_[a] == m.rcode_[b] && m.ancount_[a] < m.ancount_[b] );
+        default:
+            return m.sec_[a] < m.sec_[b] || ( m.sec_[a] == m.sec_[b] && m.usec_[a] < m.usec_[b] );
+        }
+    }
+};
+
+namespace
+{
+
+/* Slots allocated up front and the floor for dictionary compaction */
+const int MIN_SLOTS = 1024;
+const int MIN_DICT = 65536;
+
+template <typename T>
+void rotateToFront(QVector<T> &v, int head)
+{
+    std::rotate(v.begin(), v.begin() + head, v.end());
+}
+
+/* True for slots holding one of the n oldest rows */
+struct IsEvicted
+{
+    int size, head, n;
+
+    bool operator()(quint32 p) const
+    {
+        return ( static_cast<int>(p) - head + size ) % size < n;
+    }
+};
+
+}
+
+QueryTableModel::QueryTableModel(const NameTable *pNames, QObject *parent)
+    : QAbstractTableModel(parent), head_(0), count_(0), firstSeq_(0), maxRows_(0), windowSecs_(0), 
+    dropped_(0), sortCol_(COL_TIME), sortOrder_(Qt::AscendingOrder), gapAt_(0), gapLen_(0), filtered_(false), 
+    nameIndex_(*pNames), pNames_(pNames)
+{}
+
+QueryTableModel::~QueryTableModel()
+{}
+
+int QueryTableModel::rowCount(const QModelIndex &parent) const
+{
+    if ( parent.isValid() )
+        return 0;
+    return ( filtered_ ? visible_.size() : count_ ) - gapLen_;
+}
+
+int QueryTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : COL_COUNT;
+}
+
+bool QueryTableModel::isArrivalOrder() const
+{
+    return sortCol_ == COL_TIME && sortOrder_ == Qt::AscendingOrder;
+}
+
+int QueryTableModel::phys(int row) const
+{
+    int p = head_ + row;
+    return p >= sec_.size() ? p - sec_.size() : p;
+}
+
+quint32 QueryTableModel::rowAt(int row) const
+{
+    if ( row >= gapAt_ )
+        row += gapLen_;
+    if ( filtered_ )
+        return visible_[row];
+    return isArrivalOrder() ? phys(row) : order_[row];
+}
+
+QVariant QueryTableModel::data(const QModelIndex &index, int role) const
+{
+    if ( !index.isValid() || index.row() >= rowCount() )
+        return QVariant();
+    quint32 row = rowAt(index.row());
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return text(row, index.column());
+    case Qt::ForegroundRole:
+        /* Unanswered queries stand out */
+        if ( latency_[row] == TIMED_OUT )
+            return QColor(Qt::red);
+        return QVariant();
+    case Qt::TextAlignmentRole:
+        if ( index.column() == COL_LATENCY )
+            return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+        return QVariant();
+    default:
+        return QVariant();
+    }
+}
+
+QString QueryTableModel::text(quint32 row, int column) const
+{
+    /* Only ever called for rows the view is drawing */
+    switch (column)
+    {
+    case COL_TIME:
+    {
+        char buf[TimeFormatter::TIME_STRLEN];
+        size_t len = timeFmt_.format(sec_[row], usec_[row], buf);
+        return QString::fromLatin1(buf, static_cast<int>(len));
+    }
+    case COL_VER:
+        return QString("IPv%1").arg(ver_[row]);
+    case COL_SRC:
+    case COL_DST:
+    {
+        const QByteArray &addr = addrs_[column == COL_SRC ? src_[row] : dst_[row]];
+        char buf[ADDR_STRLEN];
+        formatAddr(addr.size() == 16 ? 6 : 4, 
+                reinterpret_cast<const unsigned char*>(addr.constData()), buf);
+        return QString::fromLatin1(buf);
+    }
+    case COL_TYPE:
+    {
+        const char *name = qtypeName(qtype_[row]);
+        return name ? QString::fromLatin1(name) : QString("TYPE%1").arg(qtype_[row]);
+    }
+    case COL_NAME:
+    {
+        char buf[NameTable::NAME_STRLEN];
+        size_t len = pNames_->render(name_[row], buf);
+        return QString::fromUtf8(buf, static_cast<int>(len));
+    }
+    case COL_LATENCY:
+        if ( latency_[row] == PENDING )
+            return QString();
+        if ( latency_[row] == TIMED_OUT )
+            return tr("timeout");
+        return QString::number(latency_[row] / 1000.0, 'f', 3);
+    case COL_RESULT:
+        return resultText(row);
+    default:
+        return QString();
+    }
+}
+
+QString QueryTableModel::resultText(quint32 row) const
+{
+    if ( latency_[row] == PENDING || latency_[row] == TIMED_OUT )
+        return QString();
+    const char *rcode = rcodeName(rcode_[row]);
+    QString str(rcode ? QString::fromLatin1(rcode) : QString("RCODE%1").arg(rcode_[row]));
+    switch (answerKind_[row])
+    {
+    case DNSAnswer::ADDR4:
+    case DNSAnswer::ADDR6:
+    {
+        const QByteArray &addr = addrs_[answer_[row]];
+        char buf[ADDR_STRLEN];
+        formatAddr(addr.size() == 16 ? 6 : 4, 
+                reinterpret_cast<const unsigned char*>(addr.constData()), buf);
+        str += ' ' + QString::fromLatin1(buf);
+        break;
+    }
+    case DNSAnswer::CNAME:
+    {
+        char buf[NameTable::NAME_STRLEN];
+        size_t len = pNames_->render(answer_[row], buf);
+        str += " CNAME " + QString::fromUtf8(buf, static_cast<int>(len));
+        break;
+    }
+    default:
+        break;
+    }
+    if ( ancount_[row] > 1 )
+        str += QString(" (+%1)").arg(ancount_[row] - 1);
+    if ( ancount_[row] )
+        str += QString(" ttl %1").arg(ttl_[row]);
+    return str;
+}
+
+QVariant QueryTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if ( role != Qt::DisplayRole || orientation != Qt::Horizontal )
+        return QVariant();
+    switch (section)
+    {
+    case COL_TIME: return tr("Time");
+    case COL_VER: return tr("IP");
+    case COL_SRC: return tr("Source");
+    case COL_DST: return tr("Destination");
+    case COL_TYPE: return tr("Type");
+    case COL_NAME: return tr("Name");
+    case COL_LATENCY: return tr("Latency (ms)");
+    case COL_RESULT: return tr("Result");
+    default: return QVariant();
+    }
+}
+
+quint32 QueryTableModel::internAddr(unsigned char ver, const unsigned char *addr)
+{
+    QByteArray key(reinterpret_cast<const char*>(addr), ver == 6 ? 16 : 4);
+    QHash<QByteArray, quint32>::const_iterator it = addrIds_.constFind(key);
+    if ( it != addrIds_.constEnd() )
+        return it.value();
+    quint32 id = addrs_.size();
+    addrs_.append(key);
+    addrIds_.insert(key, id);
+    return id;
+}
+
+void QueryTableModel::setRetention(int maxRows, int windowSecs)
+{
+    maxRows_ = maxRows > 0 ? maxRows : 0;
+    windowSecs_ = windowSecs > 0 ? windowSecs : 0;
+}
+
+quint64 QueryTableModel::dropped() const
+{
+    return dropped_;
+}
+
+int QueryTableModel::evictCount(quint32 newest, int adding) const
+{
+    /* Rows that fall outside the time window or over the cap, oldest first */
+    int n = 0;
+    if ( windowSecs_ )
+    {
+        quint32 cutoff = newest > static_cast<quint32>(windowSecs_) ? newest - windowSecs_ : 0;
+        while ( n < count_ && sec_[phys(n)] < cutoff )
+            n++;
+    }
+    if ( maxRows_ )
+        n = qMax(n, count_ + adding - maxRows_);
+    return qMin(n, count_);
+}
+
+void QueryTableModel::evict(int n)
+{
+    if ( n <= 0 )
+        return;
+    dropped_ += n;
+    IsEvicted evicted = { sec_.size(), head_, n };
+    if ( isArrivalOrder() && filtered_ )
+    {
+        /* The evicted rows still shown are the top ones */
+        int k = 0;
+        while ( k < visible_.size() && evicted(visible_[k]) )
+            k++;
+        if ( k )
+            beginRemoveRows(QModelIndex(), 0, k - 1);
+        visible_.erase(visible_.begin(), visible_.begin() + k);
+        head_ = phys(n);
+        count_ -= n;
+        firstSeq_ += n;
+        if ( k )
+            endRemoveRows();
+        return;
+    }
+    if ( isArrivalOrder() )
+    {
+        /* The oldest rows are the top rows, nothing else moves */
+        beginRemoveRows(QModelIndex(), 0, n - 1);
+        head_ = phys(n);
+        count_ -= n;
+        firstSeq_ += n;
+        endRemoveRows();
+        return;
+    }
+
+    /* Evicted slots are scattered through a sorted view. Each run of them is
+     * removed as it is found, with the rows kept so far compacted in front
+     * of the gap, so the whole pass is one walk over the shown rows. */
+    if ( filtered_ )
+        order_.erase(std::remove_if(order_.begin(), order_.end(), evicted), order_.end());
+    QVector<quint32> &shown = filtered_ ? visible_ : order_;
+    int size = shown.size();
+    for (int r = 0; r < size;)
+    {
+        if ( !evicted(shown[r]) )
+        {
+            shown[gapAt_++] = shown[r++];
+            continue;
+        }
+        int run = 1;
+        while ( r + run < size && evicted(shown[r + run]) )
+            run++;
+        beginRemoveRows(QModelIndex(), gapAt_, gapAt_ + run - 1);
+        r += run;
+        gapLen_ += run;
+        endRemoveRows();
+    }
+    shown.resize(gapAt_);
+    gapAt_ = gapLen_ = 0;
+    head_ = phys(n);
+    count_ -= n;
+    firstSeq_ += n;
+}
+
+void QueryTableModel::grow(int needed)
+{
+    /* Unwrap the ring so the free slots are contiguous at the end */
+    int size = sec_.size();
+    if ( head_ )
+    {
+        rotateToFront(sec_, head_);
+        rotateToFront(usec_, head_);
+        rotateToFront(name_, head_);
+        rotateToFront(src_, head_);
+        rotateToFront(dst_, head_);
+        rotateToFront(qtype_, head_);
+        rotateToFront(ver_, head_);
+        rotateToFront(latency_, head_);
+        rotateToFront(ttl_, head_);
+        rotateToFront(answer_, head_);
+        rotateToFront(ancount_, head_);
+        rotateToFront(rcode_, head_);
+        rotateToFront(answerKind_, head_);
+        for (QVector<quint32>::iterator it = order_.begin(); it != order_.end(); ++it)
+            *it = ( *it - head_ + size ) % size;
+        for (QVector<quint32>::iterator it = visible_.begin(); it != visible_.end(); ++it)
+            *it = ( *it - head_ + size ) % size;
+        head_ = 0;
+    }
+    int nSlots = qMax(qMax(size * 2, needed), MIN_SLOTS);
+    if ( maxRows_ )
+        nSlots = qMin(nSlots, maxRows_);
+    sec_.resize(nSlots);
+    usec_.resize(nSlots);
+    name_.resize(nSlots);
+    src_.resize(nSlots);
+    dst_.resize(nSlots);
+    qtype_.resize(nSlots);
+    ver_.resize(nSlots);
+    latency_.resize(nSlots);
+    ttl_.resize(nSlots);
+    answer_.resize(nSlots);
+    ancount_.resize(nSlots);
+    rcode_.resize(nSlots);
+    answerKind_.resize(nSlots);
+}
+
+void QueryTableModel::compactDictionaries()
+{
+    /* Addresses of evicted rows would otherwise pile up forever */
+    if ( addrs_.size() < qMax(2 * count_, MIN_DICT) )
+        return;
+    QVector<QByteArray> addrs;
+    QHash<QByteArray, quint32> addrIds;
+    QVector<quint32> addrMap(addrs_.size(), UINT_MAX);
+    for (int i = 0; i < count_; i++)
+    {
+        int p = phys(i);
+        quint32 *addrIdx[3] = { &src_[p], &dst_[p], &answer_[p] };
+        int nAddrs = ( answerKind_[p] == DNSAnswer::ADDR4 || answerKind_[p] == DNSAnswer::ADDR6 ) ? 3 : 2;
+        for (int j = 0; j < nAddrs; j++)
+        {
+            quint32 &addr = addrMap[*addrIdx[j]];
+            if ( addr == UINT_MAX )
+            {
+                addr = addrs.size();
+                addrs.append(addrs_[*addrIdx[j]]);
+                addrIds.insert(addrs.last(), addr);
+            }
+            *addrIdx[j] = addr;
+        }
+    }
+    addrs_.swap(addrs);
+    addrIds_.swap(addrIds);
+}
+
+void QueryTableModel::append(const QueryBatch &batch)
+{
+    if ( batch.empty() )
+        return;
+
+    /* A batch bigger than the cap only keeps its newest rows */
+    QueryBatch::const_iterator it = batch.begin();
+    if ( maxRows_ && static_cast<int>(batch.size()) > maxRows_ )
+    {
+        dropped_ += batch.size() - maxRows_;
+        it = batch.end() - maxRows_;
+    }
+    int n = static_cast<int>(batch.end() - it);
+
+    /* Make room: drop from the head first, then grow the ring if still full */
+    evict(evictCount(batch.back().tv_sec, n));
+    if ( !count_ )
+        firstSeq_ = it->seq;
+    if ( maxRows_ || windowSecs_ )
+        compactDictionaries();
+    if ( count_ + n > sec_.size() )
+        grow(count_ + n);
+
+    /* New rows always go on the end, then get merged into the sort order */
+    int first = count_;
+    QVector<quint32> shown;
+    if ( !filtered_ )
+        beginInsertRows(QModelIndex(), first, first + n - 1);
+    for (; it != batch.end(); ++it)
+    {
+        int p = phys(count_++);
+        sec_[p] = it->tv_sec;
+        usec_[p] = it->tv_usec;
+        ver_[p] = it->ver;
+        src_[p] = internAddr(it->ver, it->saddr);
+        dst_[p] = internAddr(it->ver, it->daddr);
+        qtype_[p] = it->qtype;
+        name_[p] = it->nameId;
+        latency_[p] = PENDING;
+        answerKind_[p] = DNSAnswer::NONE;
+        ancount_[p] = 0;
+        rcode_[p] = 0;
+        ttl_[p] = 0;
+        if ( nameIndex_.add(it->nameId) && !namePatterns_.empty() )
+            matchName(it->nameId, 0);
+        if ( !isArrivalOrder() )
+            order_.append(p);
+        if ( filtered_ && passes(p) )
+            shown.append(p);
+    }
+    int firstShown = visible_.size();
+    if ( !filtered_ )
+        endInsertRows();
+    else if ( !shown.isEmpty() )
+    {
+        beginInsertRows(QModelIndex(), firstShown, firstShown + shown.size() - 1);
+        visible_ += shown;
+        endInsertRows();
+    }
+
+    if ( !isArrivalOrder() )
+    {
+        emit layoutAboutToBeChanged();
+        QVector<quint32> rowSlots;
+        QModelIndexList persistent = persistentSlots(rowSlots);
+        Less less = { this, sortCol_, sortOrder_ == Qt::DescendingOrder };
+        std::stable_sort(order_.begin() + first, order_.end(), less);
+        std::inplace_merge(order_.begin(), order_.begin() + first, order_.end(), less);
+        if ( filtered_ )
+        {
+            std::stable_sort(visible_.begin() + firstShown, visible_.end(), less);
+            std::inplace_merge(visible_.begin(), visible_.begin() + firstShown, visible_.end(), less);
+        }
+        remapPersistent(persistent, rowSlots);
+        emit layoutChanged();
+    }
+}
+
+void QueryTableModel::applyAnswers(const AnswerBatch &batch)
+{
+    /* Rows are consecutive by seq, so the row for a query is an offset */
+    bool changed = false;
+    for (AnswerBatch::const_iterator it = batch.begin(); it != batch.end(); ++it)
+    {
+        for (unsigned int i = 0; i < it->count; i++)
+        {
+            quint64 seq = it->seq + i;
+            if ( seq < firstSeq_ || seq >= firstSeq_ + count_ )
+                continue;
+            int p = phys(static_cast<int>(seq - firstSeq_));
+            changed = true;
+            if ( it->status == DNSAnswer::TIMEOUT )
+            {
+                latency_[p] = TIMED_OUT;
+                continue;
+            }
+            latency_[p] = qMin(it->latencyUs, static_cast<quint32>(TIMED_OUT - 1));
+            rcode_[p] = it->rcode;
+            ancount_[p] = it->ancount;
+            ttl_[p] = it->ttl;
+            answerKind_[p] = it->kind;
+            if ( it->kind == DNSAnswer::ADDR4 || it->kind == DNSAnswer::ADDR6 )
+                answer_[p] = internAddr(it->kind == DNSAnswer::ADDR6 ? 6 : 4, it->addr);
+            else if ( it->kind == DNSAnswer::CNAME )
+                answer_[p] = it->cnameId;
+        }
+    }
+
+    /* One repaint of the two columns, the view only redraws what is visible */
+    if ( changed && rowCount() )
+        emit dataChanged(index(0, COL_LATENCY), index(rowCount() - 1, COL_RESULT));
+}
+
+void QueryTableModel::sort(int column, Qt::SortOrder order)
+{
+    emit layoutAboutToBeChanged();
+    QVector<quint32> rowSlots;
+    QModelIndexList persistent = persistentSlots(rowSlots);
+    sortCol_ = column;
+    sortOrder_ = order;
+    order_.clear();
+
+    /* Arrival order is time order, only build a permutation otherwise */
+    if ( !isArrivalOrder() )
+    {
+        order_.resize(count_);
+        for (int i = 0; i < count_; i++)
+            order_[i] = phys(i);
+        Less less = { this, column, order == Qt::DescendingOrder };
+        std::stable_sort(order_.begin(), order_.end(), less);
+    }
+    if ( filtered_ )
+        rebuildVisible();
+    remapPersistent(persistent, rowSlots);
+    emit layoutChanged();
+}
+
+QModelIndexList QueryTableModel::persistentSlots(QVector<quint32> &rowSlots) const
+{
+    /* The view's current index and selection, as the rows they show */
+    QModelIndexList persistent = persistentIndexList();
+    rowSlots.resize(persistent.size());
+    for (int i = 0; i < persistent.size(); i++)
+        rowSlots[i] = persistent[i].row() < rowCount() ? rowAt(persistent[i].row()) : UINT_MAX;
+    return persistent;
+}
+
+void QueryTableModel::remapPersistent(const QModelIndexList &from, const QVector<quint32> &rowSlots)
+{
+    if ( from.isEmpty() )
+        return;
+    /* One pass over the new display order finds where each of those rows went */
+    QHash<quint32, int> rows;
+    for (int i = 0; i < rowSlots.size(); i++)
+        rows.insert(rowSlots[i], -1);
+    int found = 0;
+    for (int row = 0, n = rowCount(); row < n && found < rows.size(); row++)
+    {
+        QHash<quint32, int>::iterator it = rows.find(rowAt(row));
+        if ( it != rows.end() && it.value() < 0 )
+        {
+            it.value() = row;
+            found++;
+        }
+    }
+    QModelIndexList to;
+    to.reserve(from.size());
+    for (int i = 0; i < from.size(); i++)
+    {
+        int row = rows.value(rowSlots[i], -1);
+        to.append(row < 0 ? QModelIndex() : index(row, from[i].column()));
+    }
+    changePersistentIndexList(from, to);
+}
+
+void QueryTableModel::clear()
+{
+    beginResetModel();
+    sec_.clear();
+    usec_.clear();
+    name_.clear();
+    src_.clear();
+    dst_.clear();
+    qtype_.clear();
+    ver_.clear();
+    latency_.clear();
+    ttl_.clear();
+    answer_.clear();
+    ancount_.clear();
+    rcode_.clear();
+    answerKind_.clear();
+    head_ = count_ = 0;
+    firstSeq_ = 0;
+    dropped_ = 0;
+    order_.clear();
+    addrs_.clear();
+    addrIds_.clear();
+    /* The filter stays, it is matched against the new names as they come */
+    visible_.clear();
+    nameIndex_.clear();
+    nameMatch_.clear();
+    endResetModel();
+}
+
+
+void QueryTableModel::matchName(unsigned int nameId, size_t firstPattern)
+{
+    bool match = true;
+    for (size_t i = firstPattern; match && i < namePatterns_.size(); i++)
+        match = nameIndex_.matches(nameId, namePatterns_[i]);
+    if ( nameId >= nameMatch_.size() )
+        nameMatch_.resize(std::max<size_t>(nameId + 1, nameMatch_.size() * 2), 0);
+    nameMatch_[nameId] = match;
+}
+
+bool QueryTableModel::passes(quint32 row) const
+{
+    if ( !namePatterns_.empty() && ( name_[row] >= nameMatch_.size() || !nameMatch_[name_[row]] ) )
+        return false;
+    if ( !filterTypes_.isEmpty() && !filterTypes_.contains(qtype_[row]) )
+        return false;
+    return filterClients_.isEmpty() || filterClients_.contains(addrs_[src_[row]]);
+}
+
+void QueryTableModel::rebuildVisible()
+{
+    /* One pass over the rows in display order, a few compares each */
+    visible_.clear();
+    for (int i = 0; i < count_; i++)
+    {
+        quint32 p = isArrivalOrder() ? phys(i) : order_[i];
+        if ( passes(p) )
+            visible_.append(p);
+    }
+}
+
+int QueryTableModel::setFilter(const QString &filter, QString &errmsg)
+{
+    std::vector<std::string> patterns;
+    QVector<quint16> types;
+    QVector<QByteArray> clients;
+    /* simplified() leaves one space between terms, only an empty filter
+     * splits into an empty term */
+    QStringList terms = filter.simplified().split(' ');
+    for (QStringList::const_iterator it = terms.begin(); it != terms.end(); ++it)
+    {
+        if ( it->isEmpty() )
+            continue;
+        QString term = it->toLower();
+        if ( term.startsWith("type:") )
+        {
+            /* By name as shown in the list, TYPE<n>, or the number */
+            QByteArray name = term.mid(5).toUpper().toLatin1();
+            bool ok = false;
+            unsigned int qtype = name.startsWith("TYPE") ? name.mid(4).toUInt(&ok) : name.toUInt(&ok);
+            for (unsigned int t = 0; !ok && t <= 0xffff; t++)
+            {
+                const char *known = qtypeName(static_cast<unsigned short>(t));
+                if ( known && name == known )
+                {
+                    qtype = t;
+                    ok = true;
+                }
+            }
+            if ( !ok || qtype > 0xffff )
+            {
+                errmsg = tr("Unknown query type: %1").arg(term.mid(5));
+                return -1;
+            }
+            types.append(static_cast<quint16>(qtype));
+        }
+        else if ( term.startsWith("client:") )
+        {
+            unsigned char ver, addr[16];
+            if ( parseAddr(term.mid(7).toLatin1().constData(), ver, addr) )
+            {
+                errmsg = tr("Not an address: %1").arg(term.mid(7));
+                return -1;
+            }
+            clients.append(QByteArray(reinterpret_cast<const char*>(addr), 6 == ver ? 16 : 4));
+        }
+        else
+        {
+            std::string pattern(term.toUtf8().constData());
+            if ( pattern.size() > 1 && '.' == pattern[pattern.size() - 1] )
+                pattern.erase(pattern.size() - 1);
+            patterns.push_back(pattern);
+        }
+    }
+
+    beginResetModel();
+    namePatterns_.swap(patterns);
+    filterTypes_ = types;
+    filterClients_ = clients;
+    filtered_ = !namePatterns_.empty() || !filterTypes_.isEmpty() || !filterClients_.isEmpty();
+    nameMatch_.clear();
+    if ( !namePatterns_.empty() )
+    {
+        /* The first pattern through the index, any others checked on its hits */
+        std::vector<unsigned int> ids;
+        nameIndex_.find(namePatterns_[0], ids);
+        for (std::vector<unsigned int>::const_iterator id = ids.begin(); id != ids.end(); ++id)
+            matchName(*id, 1);
+    }
+    visible_.clear();
+    if ( filtered_ )
+        rebuildVisible();
+    endResetModel();
+    return 0;
+}
+
+bool QueryTableModel::isFiltered() const
+{
+    return filtered_;
+}
+
+}
@@ -0,0 +1,126 @@
+#ifndef __QUERYMODEL_H
+#define __QUERYMODEL_H
+
+#include <QAbstractTableModel>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <string>
+#include <vector>
+
+#include "dnsquery.h"
+#include "nameindex.h"
+#include "timefmt.h"
+
+namespace DNSView
+{
+
+class NameTable;
+
+/* Column store for the captured queries. Rows are kept as parallel arrays of
+ * small fixed-size fields, names are NameTable ids, addresses are interned,
+ * and the display text is only built in data() for the rows the view asks for.
+ *
+ * The arrays are a ring: with a row cap or a time window set, the oldest rows
+ * are dropped from the head as new ones arrive so memory stays flat. In a
+ * sorted view the dropped rows are scattered, so each run of them is removed
+ * with its own beginRemoveRows and the view keeps its scroll position and
+ * selection.
+ *
+ * A filter shows only the matching rows. Name patterns are resolved through
+ * a NameIndex into one flag per distinct name, so each row is tested with a
+ * few compares, and new rows are tested as they are appended. */
+class QueryTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { COL_TIME, COL_VER, COL_SRC, COL_DST, COL_TYPE, COL_NAME, 
+        COL_LATENCY, COL_RESULT, COL_COUNT };
+
+    explicit QueryTableModel(const NameTable *pNames, QObject *parent = 0);
+    ~QueryTableModel();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+    void append(const QueryBatch &batch);
+    void applyAnswers(const AnswerBatch &batch);
+    void clear();
+
+    /* 0 disables either limit */
+    void setRetention(int maxRows, int windowSecs);
+    quint64 dropped() const;
+
+    /* Space-separated terms, all of which must match: text in the name,
+     * *.domain for names below it, type:<qtype> and client:<address>
+     * (either of several types or clients). Empty shows every row. */
+    int setFilter(const QString &filter, QString &errmsg);
+    bool isFiltered() const;
+
+private:
+    quint32 internAddr(unsigned char ver, const unsigned char *addr);
+    bool isArrivalOrder() const;
+    int phys(int row) const;
+    quint32 rowAt(int row) const;
+    int evictCount(quint32 newest, int adding) const;
+    void evict(int n);
+    void grow(int needed);
+    void compactDictionaries();
+    QString text(quint32 row, int column) const;
+    QString resultText(quint32 row) const;
+    void matchName(unsigned int nameId, size_t firstPattern);
+    bool passes(quint32 row) const;
+    void rebuildVisible();
+    QModelIndexList persistentSlots(QVector<quint32> &rowSlots) const;
+    void remapPersistent(const QModelIndexList &from, const QVector<quint32> &rowSlots);
+
+    struct Less;
+
+    /* One slot per row, rows in arrival order starting at head_ */
+    QVector<quint32> sec_, usec_, name_, src_, dst_;
+    QVector<quint16> qtype_;
+    QVector<quint8> ver_;
+    int head_, count_;
+    quint64 firstSeq_;          /* DNSQuery::seq of the row at head_ */
+
+    /* Filled in when the response arrives, latency_ is in microseconds */
+    enum { PENDING = 0xffffffff, TIMED_OUT = 0xfffffffe };
+    QVector<quint32> latency_, ttl_, answer_;
+    QVector<quint16> ancount_;
+    QVector<quint8> rcode_, answerKind_;
+
+    int maxRows_, windowSecs_;
+    quint64 dropped_;
+
+    /* Display order as slot indices, unused while sorted by arrival time */
+    QVector<quint32> order_;
+    /* While evict() compacts a sorted view, display rows from gapAt_ on are
+     * read gapLen_ entries further along */
+    int gapAt_, gapLen_;
+    int sortCol_;
+    Qt::SortOrder sortOrder_;
+
+    /* Rows passing the filter as slot indices in display order, while one is set */
+    bool filtered_;
+    QVector<quint32> visible_;
+    std::vector<std::string> namePatterns_;
+    QVector<quint16> filterTypes_;
+    QVector<QByteArray> filterClients_;
+    NameIndex nameIndex_;
+    std::vector<char> nameMatch_;       /* by NameTable id */
+
+    const NameTable *pNames_;
+    mutable TimeFormatter timeFmt_;
+    QVector<QByteArray> addrs_;
+    QHash<QByteArray, quint32> addrIds_;
+};
+
+}
+
+#endif
@@ -0,0 +1,725 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <dirent.h>
+#endif
+
+#include "querystore.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+const char INDEX_MAGIC[4] = { 'D', 'N', 'S', 'I' };
+
+/* Blocks after a match are read for its answers until this much later */
+const unsigned long long ANSWER_WINDOW_US = 30000000ULL;
+
+enum { BLOOM_BITS_PER_KEY = 10, BLOOM_HASHES = 7, KEY_ENTRY = 16 };
+
+/* FNV-1a, then mixed so the bloom filter can take bits from both halves */
+unsigned long long keyHash(char tag, const unsigned char *p, size_t len)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    h = ( h ^ static_cast<unsigned char>(tag) ) * 0x100000001b3ULL;
+    for (size_t i = 0; i < len; i++)
+        h = ( h ^ p[i] ) * 0x100000001b3ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+unsigned long long nameKey(char tag, const std::string &name)
+{
+    return keyHash(tag, reinterpret_cast<const unsigned char*>(name.data()), name.size());
+}
+
+unsigned long long clientKey(unsigned char ver, const unsigned char *addr)
+{
+    unsigned char buf[17];
+    buf[0] = ver;
+    size_t len = 6 == ver ? 16 : 4;
+    std::memcpy(buf + 1, addr, len);
+    return keyHash('c', buf, len + 1);
+}
+
+std::string lowerCase(const char *p, size_t len)
+{
+    std::string s(p, len);
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if ( s[i] >= 'A' && s[i] <= 'Z' )
+            s[i] = static_cast<char>(s[i] - 'A' + 'a');
+    }
+    return s;
+}
+
+/* The name itself, then each parent domain below the root */
+void nameKeys(const std::string &name, std::vector<unsigned long long> &keys)
+{
+    keys.push_back(nameKey('n', name));
+    for (size_t dot = name.find('.'); std::string::npos != dot && dot + 1 < name.size(); 
+            dot = name.find('.', dot + 1))
+        keys.push_back(nameKey('s', name.substr(dot + 1)));
+}
+
+void bloomBits(unsigned long long key, unsigned int nBits, unsigned int nHashes, unsigned int *bits)
+{
+    unsigned long long h1 = key & 0xffffffffULL, h2 = ( key >> 32 ) | 1;
+    for (unsigned int i = 0; i < nHashes; i++)
+        bits[i] = static_cast<unsigned int>(( h1 + i * h2 ) % nBits);
+}
+
+void put32(std::vector<char> &out, unsigned int v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<char>(( v >> ( i * 8 ) ) & 0xff));
+}
+
+void put64(std::vector<char> &out, unsigned long long v)
+{
+    put32(out, static_cast<unsigned int>(v));
+    put32(out, static_cast<unsigned int>(v >> 32));
+}
+
+unsigned int get32(const unsigned char *p)
+{
+    return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( static_cast<unsigned int>(p[3]) << 24 );
+}
+
+unsigned long long get64(const unsigned char *p)
+{
+    return get32(p) | ( static_cast<unsigned long long>(get32(p + 4)) << 32 );
+}
+
+struct IndexBlock
+{
+    unsigned long long offset;
+    unsigned int length;
+    unsigned long long firstUs, lastUs;
+};
+
+/* An index file opened for lookups; only the header is read up front */
+class IndexFile
+{
+public:
+    IndexFile() : pFile_(NULL), postingsLen_(0) {}
+    ~IndexFile()
+    {
+        if ( pFile_ )
+            std::fclose(pFile_);
+    }
+
+    /* 0 if the index is there and whole */
+    int open(const std::string &path)
+    {
+        pFile_ = std::fopen(path.c_str(), "rb");
+        unsigned char h[STORE_INDEX_HEADER];
+        if ( !pFile_ || sizeof(h) != std::fread(h, 1, sizeof(h), pFile_) || 
+                std::memcmp(h, INDEX_MAGIC, 4) || ( h[4] | ( h[5] << 8 ) ) > STORE_INDEX_VERSION )
+            return -1;
+        firstUs = get64(h + 8);
+        lastUs = get64(h + 16);
+        nBlocks_ = get32(h + 24);
+        nKeys_ = get32(h + 28);
+        nBloomBits_ = get32(h + 32);
+        nHashes_ = get32(h + 36);
+        postingsLen_ = get64(h + 40);
+        bloomAt_ = STORE_INDEX_HEADER + static_cast<unsigned long long>(nBlocks_) * STORE_BLOCK_ENTRY;
+        keysAt_ = bloomAt_ + ( nBloomBits_ + 7 ) / 8;
+        postingsAt_ = keysAt_ + static_cast<unsigned long long>(nKeys_) * KEY_ENTRY;
+        if ( !nBloomBits_ || nHashes_ > 32 || std::fseek(pFile_, 0, SEEK_END) )
+            return -1;
+        long size = std::ftell(pFile_);
+        /* postings() trusts postingsLen_ to bound the counts in the keys */
+        return size >= 0 && static_cast<unsigned long long>(size) >= postingsAt_ && 
+            postingsLen_ <= static_cast<unsigned long long>(size) - postingsAt_ ? 0 : -1;
+    }
+
+    bool mayContain(unsigned long long key)
+    {
+        if ( bloom_.empty() )
+        {
+            bloom_.resize(( nBloomBits_ + 7 ) / 8);
+            if ( !read(bloomAt_, &bloom_[0], bloom_.size()) )
+                return true;
+        }
+        unsigned int bits[32];
+        bloomBits(key, nBloomBits_, nHashes_, bits);
+        for (unsigned int i = 0; i < nHashes_; i++)
+        {
+            if ( !( bloom_[bits[i] / 8] & ( 1 << ( bits[i] % 8 ) ) ) )
+                return false;
+        }
+        return true;
+    }
+
+    /* Blocks holding key, ascending; binary search straight on the file */
+    void postings(unsigned long long key, std::vector<unsigned int> &blocks)
+    {
+        blocks.clear();
+        unsigned int lo = 0, hi = nKeys_;
+        unsigned char entry[KEY_ENTRY];
+        while ( lo < hi )
+        {
+            unsigned int mid = lo + ( hi - lo ) / 2;
+            if ( !read(keysAt_ + static_cast<unsigned long long>(mid) * KEY_ENTRY, entry, KEY_ENTRY) )
+                return;
+            unsigned long long k = get64(entry);
+            if ( k == key )
+            {
+                lo = mid;
+                break;
+            }
+            if ( k < key )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if ( lo >= nKeys_ || get64(entry) != key )
+            return;
+        /* Each posting takes 1 to 5 bytes of the postings section */
+        unsigned long long offset = get32(entry + 8), count = get32(entry + 12);
+        if ( !count || offset > postingsLen_ || count > postingsLen_ - offset )
+            return;
+        std::vector<unsigned char> buf(static_cast<size_t>(std::min(count * 5, postingsLen_ - offset)));
+        size_t n = readSome(postingsAt_ + offset, &buf[0], buf.size());
+        unsigned int block = 0;
+        size_t p = 0;
+        for (unsigned long long i = 0; i < count && p < n; i++)
+        {
+            unsigned int v = 0;
+            for (int shift = 0; p < n && shift < 35; shift += 7)
+            {
+                unsigned char b = buf[p++];
+                v |= static_cast<unsigned int>(b & 0x7f) << shift;
+                if ( !( b & 0x80 ) )
+                    break;
+            }
+            block += v;
+            if ( block < nBlocks_ )
+                blocks.push_back(block);
+        }
+    }
+
+    void blocks(std::vector<IndexBlock> &out)
+    {
+        std::vector<unsigned char> buf(static_cast<size_t>(nBlocks_) * STORE_BLOCK_ENTRY);
+        out.clear();
+        if ( buf.empty() || !read(STORE_INDEX_HEADER, &buf[0], buf.size()) )
+            return;
+        out.resize(nBlocks_);
+        for (unsigned int i = 0; i < nBlocks_; i++)
+        {
+            const unsigned char *p = &buf[i * STORE_BLOCK_ENTRY];
+            IndexBlock block = { get64(p), get32(p + 8), get64(p + 12), get64(p + 20) };
+            out[i] = block;
+        }
+    }
+
+    unsigned long long firstUs, lastUs;
+
+private:
+    bool read(unsigned long long at, unsigned char *buf, size_t len)
+    {
+        return readSome(at, buf, len) == len;
+    }
+
+    size_t readSome(unsigned long long at, unsigned char *buf, size_t len)
+    {
+        if ( seekFile(pFile_, at) )
+            return 0;
+        return std::fread(buf, 1, len, pFile_);
+    }
+
+    std::FILE *pFile_;
+    unsigned int nBlocks_, nKeys_, nBloomBits_, nHashes_;
+    unsigned long long bloomAt_, keysAt_, postingsAt_, postingsLen_;
+    std::vector<unsigned char> bloom_;
+};
+
+bool overlaps(const StoreFilter &filter, unsigned long long firstUs, unsigned long long lastUs)
+{
+    return ( !filter.toUs || firstUs < filter.toUs ) && ( !filter.fromUs || lastUs >= filter.fromUs );
+}
+
+/* Picks the matches out of decoded blocks and pairs them with their answers */
+class Matcher
+{
+public:
+    Matcher(const StoreFilter &filter, const NameTable &names, SearchSink &sink) :
+        filter_(filter), names_(names), sink_(sink), lastMatchUs_(0)
+    {}
+
+    int block(const QueryBatch &queries, const AnswerBatch &answers, bool candidate, 
+            std::string &errmsg)
+    {
+        out_.clear();
+        outAnswers_.clear();
+        for (QueryBatch::const_iterator it = queries.begin(); candidate && it != queries.end(); ++it)
+        {
+            if ( !filter_.matches(*it, names_) )
+                continue;
+            out_.push_back(*it);
+            pending_.insert(it->seq);
+            lastMatchUs_ = std::max(lastMatchUs_, it->tv_sec * 1000000ULL + it->tv_usec);
+        }
+        for (AnswerBatch::const_iterator it = answers.begin(); !pending_.empty() && it != answers.end(); ++it)
+        {
+            bool matched = false;
+            for (unsigned int i = 0; i < it->count || ( !i && !it->count ); i++)
+                matched = pending_.erase(it->seq + i) || matched;
+            if ( matched )
+                outAnswers_.push_back(*it);
+        }
+        if ( out_.empty() && outAnswers_.empty() )
+            return 0;
+        return sink_.onResults(out_, outAnswers_, errmsg);
+    }
+
+    bool waiting(unsigned long long firstUs) const
+    {
+        return !pending_.empty() && firstUs <= lastMatchUs_ + ANSWER_WINDOW_US;
+    }
+
+private:
+    const StoreFilter &filter_;
+    const NameTable &names_;
+    SearchSink &sink_;
+    std::unordered_set<unsigned long long> pending_;
+    unsigned long long lastMatchUs_;
+    QueryBatch out_;
+    AnswerBatch outAnswers_;
+};
+
+/* Reads every block, for logs without an index */
+int scanLog(BinLogReader &reader, const StoreFilter &filter, NameTable &names, SearchSink &sink, 
+        SearchStats &stats, std::string &errmsg)
+{
+    Matcher matcher(filter, names, sink);
+    QueryBatch queries;
+    AnswerBatch answers;
+    int ret;
+    while ( 0 < ( ret = reader.next(names, queries, answers, errmsg) ) )
+    {
+        stats.blocksRead++;
+        const BinLogBlock &block = reader.block();
+        if ( matcher.block(queries, answers, overlaps(filter, block.firstUs, block.lastUs), errmsg) )
+            return -1;
+        queries.clear();
+        answers.clear();
+    }
+    return ret;
+}
+
+/* Reads the blocks the index points at, and the ones after them that may
+ * hold their answers */
+int searchIndexed(BinLogReader &reader, IndexFile &index, const StoreFilter &filter, NameTable &names, 
+        SearchSink &sink, SearchStats &stats, std::string &errmsg)
+{
+    std::vector<unsigned long long> keys;
+    if ( !filter.name.empty() )
+    {
+        bool below = !filter.name.compare(0, 2, "*.");
+        keys.push_back(nameKey(below ? 's' : 'n', below ? filter.name.substr(2) : filter.name));
+    }
+    if ( filter.hasClient )
+        keys.push_back(clientKey(filter.ver, filter.client));
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if ( !index.mayContain(keys[i]) )
+        {
+            stats.skipped++;
+            return 0;
+        }
+    }
+
+    std::vector<IndexBlock> blocks;
+    index.blocks(blocks);
+    std::vector<bool> candidate(blocks.size(), keys.empty());
+    if ( !keys.empty() )
+    {
+        /* Blocks holding every key */
+        std::vector<unsigned int> hits, next, both;
+        index.postings(keys[0], hits);
+        for (size_t i = 1; i < keys.size() && !hits.empty(); i++)
+        {
+            index.postings(keys[i], next);
+            both.clear();
+            std::set_intersection(hits.begin(), hits.end(), next.begin(), next.end(), std::back_inserter(both));
+            hits.swap(both);
+        }
+        for (size_t i = 0; i < hits.size(); i++)
+            candidate[hits[i]] = true;
+    }
+
+    Matcher matcher(filter, names, sink);
+    QueryBatch queries;
+    AnswerBatch answers;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        bool hit = candidate[b] && overlaps(filter, blocks[b].firstUs, blocks[b].lastUs);
+        if ( !hit && !matcher.waiting(blocks[b].firstUs) )
+            continue;
+        if ( reader.seek(blocks[b].offset, errmsg) )
+            return -1;
+        int ret = reader.next(names, queries, answers, errmsg);
+        if ( 0 > ret )
+            return -1;
+        stats.blocksRead++;
+        /* A damaged block is passed over by the reader */
+        if ( ret && reader.block().offset == blocks[b].offset && 
+                matcher.block(queries, answers, hit, errmsg) )
+            return -1;
+        queries.clear();
+        answers.clear();
+    }
+    return 0;
+}
+
+bool endsWith(const std::string &s, const char *suffix)
+{
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && !s.compare(s.size() - n, n, suffix);
+}
+
+/* Orders segment names by start time, then by the counter QueryLog adds to
+ * one started in the same second: dns-<date>-<time>[-<n>].dnsl */
+struct SegmentOrder
+{
+    static void split(const std::string &path, std::string &stamp, long &counter)
+    {
+        std::string name(path.substr(0, path.size() - 5));
+        size_t slash = name.find_last_of("/\\");
+        size_t dash = name.rfind('-');
+        counter = 0;
+        stamp = name;
+        if ( std::string::npos != dash && std::count(name.begin() + ( std::string::npos == slash ? 0 : slash ), 
+                    name.end(), '-') > 2 )
+        {
+            counter = std::atol(name.c_str() + dash + 1);
+            stamp.erase(dash);
+        }
+    }
+
+    bool operator()(const std::string &a, const std::string &b) const
+    {
+        std::string stampA, stampB;
+        long counterA, counterB;
+        split(a, stampA, counterA);
+        split(b, stampB, counterB);
+        return stampA != stampB ? stampA < stampB : counterA < counterB;
+    }
+};
+
+int listSegments(const std::string &dir, std::vector<std::string> &paths, std::string &errmsg)
+{
+#ifdef _WIN32
+    _finddata_t data;
+    intptr_t h = _findfirst(( dir + "/*.dnsl" ).c_str(), &data);
+    if ( -1 == h )
+        return 0;
+    do
+        paths.push_back(dir + "/" + data.name);
+    while ( !_findnext(h, &data) );
+    _findclose(h);
+#else
+    DIR *pDir = opendir(dir.c_str());
+    if ( !pDir )
+    {
+        errmsg = "Error opening " + dir + ": " + std::strerror(errno);
+        return -1;
+    }
+    for (dirent *pEnt; NULL != ( pEnt = readdir(pDir) ); )
+    {
+        std::string name(pEnt->d_name);
+        if ( endsWith(name, ".dnsl") )
+            paths.push_back(dir + "/" + name);
+    }
+    closedir(pDir);
+#endif
+    /* A segment just started may not have its header yet */
+    std::vector<std::string>::iterator out = paths.begin();
+    for (std::vector<std::string>::iterator it = paths.begin(); it != paths.end(); ++it)
+    {
+        if ( BinLogReader::probe(*it) )
+            *out++ = *it;
+    }
+    paths.erase(out, paths.end());
+    std::sort(paths.begin(), paths.end(), SegmentOrder());
+    return 0;
+}
+
+}
+
+SegmentIndexer::SegmentIndexer(const NameTable &names) :
+    names_(names),
+    firstUs_(~0ULL),
+    lastUs_(0)
+{}
+
+void SegmentIndexer::post(unsigned long long key)
+{
+    std::vector<unsigned int> &blocks = postings_[key];
+    unsigned int block = static_cast<unsigned int>(blocks_.size());
+    if ( blocks.empty() || blocks.back() != block )
+        blocks.push_back(block);
+}
+
+void SegmentIndexer::add(const QueryBatch &queries)
+{
+    /* A name's keys are worked out once per segment and posted once per block */
+    unsigned int block = static_cast<unsigned int>(blocks_.size());
+    for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+    {
+        unsigned long long us = it->tv_sec * 1000000ULL + it->tv_usec;
+        firstUs_ = std::min(firstUs_, us);
+        lastUs_ = std::max(lastUs_, us);
+        post(clientKey(it->ver, it->saddr));
+        unsigned int id = it->nameId;
+        if ( id >= NameTable::FULL_ID )
+            continue;
+        if ( id >= nameKeys_.size() )
+        {
+            nameKeys_.resize(id + 1 + id / 2);
+            nameBlock_.resize(nameKeys_.size(), 0);
+        }
+        if ( nameBlock_[id] == block + 1 )
+            continue;
+        nameBlock_[id] = block + 1;
+        std::vector<unsigned long long> &keys = nameKeys_[id];
+        if ( keys.empty() )
+        {
+            char text[NameTable::NAME_STRLEN];
+            size_t len = names_.render(id, text);
+            nameKeys(lowerCase(text, len), keys);
+        }
+        for (size_t i = 0; i < keys.size(); i++)
+            post(keys[i]);
+    }
+}
+
+void SegmentIndexer::endBlock(unsigned long long offset, unsigned int length)
+{
+    /* A block of answers only takes the time of the one before */
+    BlockEntry entry = { offset, length, firstUs_, lastUs_ };
+    if ( ~0ULL == firstUs_ )
+        entry.firstUs = entry.lastUs = blocks_.empty() ? 0 : blocks_.back().lastUs;
+    blocks_.push_back(entry);
+    firstUs_ = ~0ULL;
+    lastUs_ = 0;
+}
+
+bool SegmentIndexer::empty() const
+{
+    return blocks_.empty();
+}
+
+int SegmentIndexer::write(const std::string &path, std::string &errmsg)
+{
+    std::vector<unsigned long long> keys;
+    keys.reserve(postings_.size());
+    for (std::unordered_map<unsigned long long, std::vector<unsigned int> >::const_iterator it = postings_.begin(); 
+            it != postings_.end(); ++it)
+        keys.push_back(it->first);
+    std::sort(keys.begin(), keys.end());
+
+    unsigned int nBits = static_cast<unsigned int>(std::max<size_t>(64, keys.size() * BLOOM_BITS_PER_KEY));
+    std::vector<unsigned char> bloom(( nBits + 7 ) / 8, 0);
+    std::vector<char> table, postings;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        unsigned int bits[BLOOM_HASHES];
+        bloomBits(keys[i], nBits, BLOOM_HASHES, bits);
+        for (int k = 0; k < BLOOM_HASHES; k++)
+            bloom[bits[k] / 8] |= static_cast<unsigned char>(1 << ( bits[k] % 8 ));
+
+        const std::vector<unsigned int> &blocks = postings_[keys[i]];
+        put64(table, keys[i]);
+        put32(table, static_cast<unsigned int>(postings.size()));
+        put32(table, static_cast<unsigned int>(blocks.size()));
+        unsigned int prev = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            unsigned int v = blocks[b] - prev;
+            prev = blocks[b];
+            while ( v >= 0x80 )
+            {
+                postings.push_back(static_cast<char>(( v & 0x7f ) | 0x80));
+                v >>= 7;
+            }
+            postings.push_back(static_cast<char>(v));
+        }
+    }
+
+    std::vector<char> out;
+    out.insert(out.end(), INDEX_MAGIC, INDEX_MAGIC + 4);
+    out.push_back(static_cast<char>(STORE_INDEX_VERSION));
+    out.push_back(0);
+    out.push_back(0);
+    out.push_back(0);
+    unsigned long long first = ~0ULL, last = 0;
+    for (size_t i = 0; i < blocks_.size(); i++)
+    {
+        first = std::min(first, blocks_[i].firstUs);
+        last = std::max(last, blocks_[i].lastUs);
+    }
+    put64(out, blocks_.empty() ? 0 : first);
+    put64(out, last);
+    put32(out, static_cast<unsigned int>(blocks_.size()));
+    put32(out, static_cast<unsigned int>(keys.size()));
+    put32(out, nBits);
+    put32(out, BLOOM_HASHES);
+    put64(out, postings.size());
+    for (size_t i = 0; i < blocks_.size(); i++)
+    {
+        put64(out, blocks_[i].offset);
+        put32(out, blocks_[i].length);
+        put64(out, blocks_[i].firstUs);
+        put64(out, blocks_[i].lastUs);
+    }
+    out.insert(out.end(), bloom.begin(), bloom.end());
+    out.insert(out.end(), table.begin(), table.end());
+    out.insert(out.end(), postings.begin(), postings.end());
+
+    std::string tmp = path + ".tmp";
+    std::FILE *pFile = std::fopen(tmp.c_str(), "wb");
+    bool ok = pFile && out.size() == std::fwrite(&out[0], 1, out.size(), pFile);
+    if ( pFile && std::fclose(pFile) )
+        ok = false;
+    std::remove(path.c_str());
+    if ( !ok || std::rename(tmp.c_str(), path.c_str()) )
+    {
+        errmsg = "Error writing index " + path + ": " + std::strerror(errno);
+        std::remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+void SegmentIndexer::clear()
+{
+    blocks_.clear();
+    postings_.clear();
+    nameKeys_.clear();
+    nameBlock_.clear();
+    firstUs_ = ~0ULL;
+    lastUs_ = 0;
+}
+
+StoreFilter::StoreFilter() : hasClient(false), ver(0), fromUs(0), toUs(0)
+{
+    std::memset(client, 0, sizeof(client));
+}
+
+void StoreFilter::normalize()
+{
+    name = lowerCase(name.data(), name.size());
+    if ( name.size() > 1 && '.' == name[name.size() - 1] )
+        name.erase(name.size() - 1);
+}
+
+bool StoreFilter::matches(const DNSQuery &query, const NameTable &names) const
+{
+    unsigned long long us = query.tv_sec * 1000000ULL + query.tv_usec;
+    if ( ( fromUs && us < fromUs ) || ( toUs && us >= toUs ) )
+        return false;
+    if ( hasClient && ( query.ver != ver || std::memcmp(query.saddr, client, 6 == ver ? 16 : 4) ) )
+        return false;
+    if ( name.empty() )
+        return true;
+    char buf[NameTable::NAME_STRLEN];
+    std::string text(lowerCase(buf, names.render(query.nameId, buf)));
+    if ( name.compare(0, 2, "*.") )
+        return text == name;
+    /* Strictly below the domain */
+    size_t n = name.size() - 1;
+    return text.size() > n && !text.compare(text.size() - n, n, name, 1, n);
+}
+
+SearchStats::SearchStats() : segments(0), skipped(0), indexed(0), blocksRead(0), badBlocks(0)
+{}
+
+int searchLog(const std::string &path, const StoreFilter &filter, NameTable &names,
+        SearchSink &sink, SearchStats &stats, std::string &errmsg)
+{
+    stats.segments++;
+    BinLogReader reader;
+    if ( reader.open(path, errmsg) )
+        return -1;
+    IndexFile index;
+    std::string indexPath = endsWith(path, ".dnsl") ? path.substr(0, path.size() - 5) + ".dnsi" : path + ".dnsi";
+    int ret;
+    if ( index.open(indexPath) )
+        ret = scanLog(reader, filter, names, sink, stats, errmsg);
+    else if ( !overlaps(filter, index.firstUs, index.lastUs) )
+    {
+        stats.indexed++;
+        stats.skipped++;
+        ret = 0;
+    }
+    else
+    {
+        stats.indexed++;
+        ret = searchIndexed(reader, index, filter, names, sink, stats, errmsg);
+    }
+    stats.badBlocks += reader.badBlocks();
+    return ret;
+}
+
+int searchStore(const std::string &dir, const StoreFilter &filter, NameTable &names,
+        SearchSink &sink, SearchStats &stats, std::string &errmsg)
+{
+    std::vector<std::string> paths;
+    if ( listSegments(dir, paths, errmsg) )
+        return -1;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        if ( searchLog(paths[i], filter, names, sink, stats, errmsg) )
+            return -1;
+    }
+    return 0;
+}
+
+}
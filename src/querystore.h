@@ -0,0 +1,110 @@
+#ifndef __QUERYSTORE_H
+#define __QUERYSTORE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "binlog.h"
+#include "dnsquery.h"
+
+namespace DNSView
+{
+
+class NameTable;
+
+/* A query store is a directory of binary log segments, dns-<time>.dnsl,
+ * written by QueryLog with LogPolicy::index. Each closed segment has an
+ * index beside it (.dnsi), little-endian:
+ *
+ *   header   "DNSI", u16 version, u16 reserved, u64 first and last query
+ *            time (us), u32 blocks, u32 keys, u32 bloom bits, u32 bloom
+ *            hashes, u64 postings length
+ *   blocks   u64 offset, u32 length, u64 first and last query time
+ *   bloom    filter over the keys
+ *   keys     u64 key, u32 postings offset, u32 count, sorted by key
+ *   postings varint deltas of block numbers
+ *
+ * Keys hash the lower-cased name, every parent domain of it and the
+ * client address. A search reads the index headers, skips segments by time
+ * and bloom filter, looks its keys up with a binary search on the file and
+ * decodes only the blocks they point at. Segments without an index, the one
+ * being written or one cut off by a crash, are scanned block by block. */
+enum { STORE_INDEX_VERSION = 1, STORE_INDEX_HEADER = 48, STORE_BLOCK_ENTRY = 28 };
+
+/* Builds the index of the segment being written, a block at a time */
+class SegmentIndexer
+{
+public:
+    explicit SegmentIndexer(const NameTable &names);
+
+    void add(const QueryBatch &queries);
+    /* Everything added since the last call went into the block at offset */
+    void endBlock(unsigned long long offset, unsigned int length);
+    bool empty() const;
+    /* Written under a temporary name and renamed, so a search never reads
+     * half an index */
+    int write(const std::string &path, std::string &errmsg);
+    void clear();
+
+private:
+    struct BlockEntry
+    {
+        unsigned long long offset;
+        unsigned int length;
+        unsigned long long firstUs, lastUs;
+    };
+
+    void post(unsigned long long key);
+
+    const NameTable &names_;
+    std::vector<BlockEntry> blocks_;
+    std::unordered_map<unsigned long long, std::vector<unsigned int> > postings_;
+    std::vector<std::vector<unsigned long long> > nameKeys_;    /* by NameTable id */
+    std::vector<unsigned int> nameBlock_;   /* block + 1 a name was last posted for */
+    unsigned long long firstUs_, lastUs_;
+};
+
+/* What a search looks for; unset fields match anything */
+struct StoreFilter
+{
+    std::string name;           /* "www.example.com", or "*.example.com" for names below it */
+    bool hasClient;
+    unsigned char ver;
+    unsigned char client[16];
+    unsigned long long fromUs, toUs;    /* query time, toUs excluded; 0 = open */
+
+    StoreFilter();
+
+    /* Lower-cases the name and drops a trailing dot */
+    void normalize();
+    bool matches(const DNSQuery &query, const NameTable &names) const;
+};
+
+/* Receives the results a block at a time: the matching queries, then the
+ * answers to them found so far */
+class SearchSink
+{
+public:
+    virtual ~SearchSink() {}
+    virtual int onResults(const QueryBatch &queries, const AnswerBatch &answers,
+            std::string &errmsg) = 0;
+};
+
+struct SearchStats
+{
+    unsigned long long segments, skipped, indexed, blocksRead, badBlocks;
+
+    SearchStats();
+};
+
+/* Searches every segment of a store directory, oldest first */
+int searchStore(const std::string &dir, const StoreFilter &filter, NameTable &names,
+        SearchSink &sink, SearchStats &stats, std::string &errmsg);
+/* Searches one binary log, through its index if it has one */
+int searchLog(const std::string &path, const StoreFilter &filter, NameTable &names,
+        SearchSink &sink, SearchStats &stats, std::string &errmsg);
+
+}
+
+#endif
@@ -0,0 +1,269 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <functional>
+
+#include "shardedfileimpl.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+/* Bytes of file per chunk, and windows decoded ahead of the merge */
+const size_t CHUNK_BYTES = 4 * 1024 * 1024;
+const size_t WINDOWS_AHEAD = 2;
+
+struct TsLess
+{
+    bool operator()(const DecodedMsg &a, const DecodedMsg &b) const
+    {
+        return a.ts < b.ts;
+    }
+};
+
+}
+
+/* Min-heap order on (timestamp, chunk), ties go to the earlier chunk */
+struct ShardedFileImpl::Later
+{
+    bool operator()(const std::pair<unsigned long long, unsigned int> &a, 
+            const std::pair<unsigned long long, unsigned int> &b) const
+    {
+        return a > b;
+    }
+};
+
+ShardedFileImpl::ShardedFileImpl() : MMapFileImpl(), nThreads_(1), stopping_(false), merging_(false)
+{}
+
+ShardedFileImpl::~ShardedFileImpl() 
+{
+    doShutDown();
+}
+
+void ShardedFileImpl::setThreads(int nThreads)
+{
+    nThreads_ = nThreads > 0 ? nThreads : 1;
+}
+
+int ShardedFileImpl::doInit(const std::string &dev, const std::string &filter, 
+        std::string &errmsg)
+{
+    if ( MMapFileImpl::doInit(dev, filter, errmsg) )
+        return -1;
+    if ( nThreads_ < 2 )
+        return 0;
+    stopping_ = false;
+    for (int i = 0; i < nThreads_; i++)
+        workers_.push_back(std::thread(&ShardedFileImpl::work, this));
+    for (size_t i = 0; i < WINDOWS_AHEAD && submitWindow(); i++)
+        ;
+    return 0;
+}
+
+void ShardedFileImpl::doShutDown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        jobs_.clear();
+    }
+    jobReady_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++)
+        workers_[i].join();
+    workers_.clear();
+    windows_.clear();
+    heap_.clear();
+    merging_ = false;
+    MMapFileImpl::doShutDown();
+}
+
+void ShardedFileImpl::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        while ( !stopping_ && jobs_.empty() )
+            jobReady_.wait(lock);
+        if ( stopping_ )
+            return;
+        Chunk *pChunk = jobs_.front();
+        jobs_.pop_front();
+        lock.unlock();
+        decodeChunk(*pChunk);
+        lock.lock();
+        if ( !--pChunk->pWindow->pending )
+            chunkDone_.notify_all();
+    }
+}
+
+void ShardedFileImpl::decodeChunk(Chunk &chunk) const
+{
+    /* Runs on a worker, only the mapping, the filter and NameTable are shared.
+     * TCP segments and IP fragments are passed through to be reassembled in
+     * merged order. */
+    size_t offset = chunk.begin;
+    const u_char *data;
+    u_int caplen, len, tv_sec, tv_usec;
+    DecodedMsg msg;
+    while ( offset < chunk.end && nextRecord(offset, data, caplen, len, tv_sec, tv_usec) )
+    {
+        if ( !passes(data, caplen, len, tv_sec, tv_usec) )
+            continue;
+        ++chunk.counts.nPackets;
+        chunk.counts.nBytes += caplen;
+        int reason = caplen == len ? 
+            decodeMessage(data, caplen, tv_sec, tv_usec, msg, chunk.questions) : FAIL_SNAPLEN;
+        if ( FAIL_NONE == reason || DECODE_PENDING == reason )
+            chunk.msgs.push_back(msg);
+        else
+            ++chunk.counts.failures[reason];
+    }
+
+    /* Captures are nearly sorted already, this is usually just the check */
+    if ( !std::is_sorted(chunk.msgs.begin(), chunk.msgs.end(), TsLess()) )
+        std::stable_sort(chunk.msgs.begin(), chunk.msgs.end(), TsLess());
+}
+
+bool ShardedFileImpl::submitWindow()
+{
+    /* Cut the next stretch of the file into one chunk per worker, walking
+     * only record headers */
+    if ( offset_ >= mapLen_ )
+        return false;
+    std::unique_ptr<Window> spWindow(new Window);
+    spWindow->chunks.resize(nThreads_);
+    int nChunks = 0;
+    const u_char *data;
+    u_int caplen, len, tv_sec, tv_usec;
+    for (; nChunks < nThreads_; nChunks++)
+    {
+        Chunk &chunk = spWindow->chunks[nChunks];
+        chunk.pWindow = spWindow.get();
+        chunk.begin = offset_;
+        chunk.counts.clear();
+        chunk.next = 0;
+        while ( offset_ - chunk.begin < CHUNK_BYTES && 
+                nextRecord(offset_, data, caplen, len, tv_sec, tv_usec) )
+            ;
+        chunk.end = offset_;
+        if ( chunk.end == chunk.begin )
+            break;
+    }
+    if ( !nChunks )
+    {
+        /* Only a cut-off record was left */
+        offset_ = mapLen_;
+        return false;
+    }
+    spWindow->chunks.resize(nChunks);
+    spWindow->end = offset_;
+    spWindow->pending = nChunks;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < nChunks; i++)
+        jobs_.push_back(&spWindow->chunks[i]);
+    windows_.push_back(std::move(spWindow));
+    jobReady_.notify_all();
+    return true;
+}
+
+bool ShardedFileImpl::startMerge(void *user)
+{
+    if ( windows_.empty() )
+        return false;
+    Window *pWindow = windows_.front().get();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while ( pWindow->pending )
+            chunkDone_.wait(lock);
+    }
+
+    /* Keep the workers busy on the next window while this one is merged */
+    submitWindow();
+
+    CapStats counts;
+    counts.clear();
+    heap_.clear();
+    for (unsigned int i = 0; i < pWindow->chunks.size(); i++)
+    {
+        const Chunk &chunk = pWindow->chunks[i];
+        counts.add(chunk.counts);
+        if ( !chunk.msgs.empty() )
+            heap_.push_back(std::make_pair(chunk.msgs[0].ts, i));
+    }
+    std::make_heap(heap_.begin(), heap_.end(), Later());
+    countPackets(user, counts);
+    merging_ = true;
+    return true;
+}
+
+int ShardedFileImpl::doDispatch(int maxPkts, PktHandler handler, void *user)
+{
+    if ( nThreads_ < 2 )
+        return MMapFileImpl::doDispatch(maxPkts, handler, user);
+
+    /* Numbering and pairing stay on this thread, in merged order */
+    int n = 0;
+    while ( n < maxPkts )
+    {
+        if ( !merging_ && !startMerge(user) )
+            return n ? n : CAP_EOF;
+        if ( heap_.empty() )
+        {
+            size_t end = windows_.front()->end;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                windows_.pop_front();
+            }
+            merging_ = false;
+            release(end);
+            continue;
+        }
+        std::pop_heap(heap_.begin(), heap_.end(), Later());
+        Chunk &chunk = windows_.front()->chunks[heap_.back().second];
+        const DecodedMsg &msg = chunk.msgs[chunk.next++];
+        deliver(user, msg, msg.nQuestions ? &chunk.questions[msg.firstQuestion] : NULL);
+        n++;
+        if ( chunk.next < chunk.msgs.size() )
+        {
+            heap_.back().first = chunk.msgs[chunk.next].ts;
+            std::push_heap(heap_.begin(), heap_.end(), Later());
+        }
+        else
+            heap_.pop_back();
+    }
+    return n;
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef __SHARDEDFILEIMPL_H
+#define __SHARDEDFILEIMPL_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mmapfileimpl.h"
+
+namespace DNSView
+{
+
+/* Parallel replay of a mapped pcap file. The dispatching thread is the
+ * reader: it cuts the file into chunks on record boundaries, a pool of
+ * workers decodes them, and the per-chunk results are k-way merged back
+ * into timestamp order before they are numbered, paired and published.
+ * Each window of chunks (one per worker) is merged on its own, so order
+ * across windows is file order. With one thread this is MMapFileImpl. */
+class ShardedFileImpl : public MMapFileImpl
+{
+public:
+    ShardedFileImpl();
+    ~ShardedFileImpl();
+
+    /* Set before init() */
+    void setThreads(int nThreads);
+
+protected:
+    virtual int doInit(const std::string &dev, const std::string &filter, 
+            std::string &errmsg);
+    virtual int doDispatch(int maxPkts, PktHandler handler, void *user);
+    virtual void doShutDown();
+
+private:
+    struct Window;
+
+    struct Chunk
+    {
+        Window *pWindow;
+        size_t begin, end;
+        std::vector<DecodedMsg> msgs;
+        std::vector<DecodedQuestion> questions;
+        CapStats counts;        /* packets, bytes and parse failures */
+        size_t next;            /* merge cursor into msgs */
+    };
+
+    struct Window
+    {
+        std::vector<Chunk> chunks;
+        size_t end;
+        int pending;            /* chunks the workers have not finished */
+    };
+
+    struct Later;
+
+    void work();
+    void decodeChunk(Chunk &chunk) const;
+    bool submitWindow();
+    bool startMerge(void *user);
+
+    int nThreads_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable jobReady_, chunkDone_;
+    std::deque<Chunk*> jobs_;
+    bool stopping_;
+
+    /* Windows in file order, the front one is being merged */
+    std::deque<std::unique_ptr<Window> > windows_;
+    bool merging_;
+    std::vector<std::pair<unsigned long long, unsigned int> > heap_;
+};
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "tcpflowtable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+inline size_t messageEnd(const unsigned char *prefix)
+{
+    return 2 + ( static_cast<size_t>(prefix[0]) << 8 | prefix[1] );
+}
+
+}
+
+bool TcpFlowKey::operator==(const TcpFlowKey &other) const
+{
+    return port == other.port && fromServer == other.fromServer && ver == other.ver && 
+        !std::memcmp(client, other.client, sizeof(client)) && 
+        !std::memcmp(server, other.server, sizeof(server));
+}
+
+TcpFlowTable::TcpFlowTable(unsigned int capacity, size_t maxBuffered) 
+    : maxBuffered_(maxBuffered), timeoutUs_(30000000)
+{
+    /* Twice as many buckets as flows, a power of two */
+    unsigned int size = 1;
+    while ( size < capacity )
+        size <<= 1;
+    flows_.resize(capacity ? capacity : 1);
+    buckets_.resize(size * 2);
+    clear();
+}
+
+void TcpFlowTable::setTimeout(unsigned int timeoutMs)
+{
+    timeoutUs_ = static_cast<unsigned long long>(timeoutMs) * 1000;
+}
+
+void TcpFlowTable::clear()
+{
+    buckets_.assign(buckets_.size(), -1);
+    for (size_t i = 0; i < flows_.size(); i++)
+    {
+        std::vector<unsigned char>().swap(flows_[i].partial);
+        flows_[i].live = false;
+        flows_[i].next = static_cast<int>(i) + 1;
+    }
+    flows_.back().next = -1;
+    free_ = 0;
+    oldest_ = newest_ = -1;
+    live_ = buffered_ = 0;
+}
+
+size_t TcpFlowTable::flows() const
+{
+    return live_;
+}
+
+size_t TcpFlowTable::buffered() const
+{
+    return buffered_;
+}
+
+unsigned int TcpFlowTable::bucket(const TcpFlowKey &key) const
+{
+    /* FNV-1a, as in TxnTable */
+    unsigned int h = 2166136261u;
+    const unsigned char *parts[2] = { key.client, key.server };
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 16; j++)
+            h = ( h ^ parts[i][j] ) * 16777619u;
+    h = ( h ^ key.port ) * 16777619u;
+    h = ( h ^ key.fromServer ) * 16777619u;
+    return h & ( buckets_.size() - 1 );
+}
+
+int TcpFlowTable::find(const TcpFlowKey &key) const
+{
+    for (int slot = buckets_[bucket(key)]; -1 != slot; slot = flows_[slot].next)
+    {
+        if ( flows_[slot].key == key )
+            return slot;
+    }
+    return -1;
+}
+
+int TcpFlowTable::alloc(const TcpFlowKey &key, unsigned long long ts)
+{
+    /* A full table gives up its idlest flow */
+    if ( -1 == free_ )
+        release(oldest_);
+    int slot = free_;
+    Flow &flow = flows_[slot];
+    free_ = flow.next;
+    flow.key = key;
+    flow.ts = ts;
+    flow.partial.clear();
+    flow.live = true;
+    int &head = buckets_[bucket(key)];
+    flow.next = head;
+    head = slot;
+    flow.older = newest_;
+    flow.newer = -1;
+    if ( -1 != newest_ )
+        flows_[newest_].newer = slot;
+    else
+        oldest_ = slot;
+    newest_ = slot;
+    buffered_ += flow.partial.capacity();
+    live_++;
+    return slot;
+}
+
+void TcpFlowTable::release(int slot)
+{
+    Flow &flow = flows_[slot];
+    int *pLink = &buckets_[bucket(flow.key)];
+    while ( *pLink != slot )
+        pLink = &flows_[*pLink].next;
+    *pLink = flow.next;
+    ( -1 != flow.older ? flows_[flow.older].newer : oldest_ ) = flow.newer;
+    ( -1 != flow.newer ? flows_[flow.newer].older : newest_ ) = flow.older;
+
+    /* Small buffers stay with the slot for the flow that takes it next */
+    buffered_ -= flow.partial.capacity();
+    if ( flow.partial.capacity() > KEEP_BYTES )
+        std::vector<unsigned char>().swap(flow.partial);
+    flow.live = false;
+    flow.next = free_;
+    free_ = slot;
+    live_--;
+}
+
+void TcpFlowTable::touch(int slot, unsigned long long ts)
+{
+    Flow &flow = flows_[slot];
+    flow.ts = ts;
+    if ( slot == newest_ )
+        return;
+    ( -1 != flow.older ? flows_[flow.older].newer : oldest_ ) = flow.newer;
+    flows_[flow.newer].older = flow.older;
+    flow.older = newest_;
+    flow.newer = -1;
+    flows_[newest_].newer = slot;
+    newest_ = slot;
+}
+
+int TcpFlowTable::add(const TcpFlowKey &key, unsigned long long ts, const TCPSegment &segment, 
+        TcpMessageSink &sink)
+{
+    int slot = find(key);
+    unsigned int seq = segment.seq;
+    if ( segment.flags & TCPSegment::SYN )
+    {
+        /* A new connection on the same ports starts over, data (TCP Fast
+         * Open) begins after the SYN */
+        if ( -1 != slot )
+            release(slot);
+        slot = -1;
+        seq++;
+    }
+    bool closing = 0 != ( segment.flags & ( TCPSegment::FIN | TCPSegment::RST ) );
+    if ( !segment.payloadLen )
+    {
+        if ( -1 != slot && closing )
+            release(slot);
+        return SEGMENT_NO_DATA;
+    }
+
+    const unsigned char *data = segment.payload;
+    size_t len = segment.payloadLen;
+    int result = SEGMENT_OK;
+    if ( -1 == slot )
+    {
+        slot = alloc(key, ts);
+        flows_[slot].nextSeq = seq;
+    }
+    else
+    {
+        Flow &flow = flows_[slot];
+        touch(slot, ts);
+        int ahead = static_cast<int>(seq - flow.nextSeq);
+        if ( ahead > 0 )
+        {
+            /* Lost or not captured: the message being put together cannot
+             * be finished, pick the stream up again here */
+            buffered_ -= flow.partial.capacity();
+            if ( flow.partial.capacity() > KEEP_BYTES )
+                std::vector<unsigned char>().swap(flow.partial);
+            flow.partial.clear();
+            buffered_ += flow.partial.capacity();
+            flow.nextSeq = seq;
+            result = SEGMENT_GAP;
+        }
+        else if ( ahead < 0 )
+        {
+            size_t seen = static_cast<size_t>(-static_cast<long long>(ahead));
+            if ( seen >= len )
+            {
+                if ( closing )
+                    release(slot);
+                return SEGMENT_RETRANSMIT;
+            }
+            data += seen;
+            len -= seen;
+        }
+    }
+    flows_[slot].nextSeq += static_cast<unsigned int>(len);
+    consume(slot, data, len, sink);
+    if ( closing )
+        release(slot);
+    else if ( buffered_ > maxBuffered_ )
+        trim(slot);
+    return result;
+}
+
+void TcpFlowTable::consume(int slot, const unsigned char *data, size_t len, TcpMessageSink &sink)
+{
+    std::vector<unsigned char> &partial = flows_[slot].partial;
+    size_t before = partial.capacity();
+    while ( len )
+    {
+        if ( partial.empty() )
+        {
+            /* Whole messages are handed on from the segment itself */
+            if ( len >= 2 && len >= messageEnd(data) )
+            {
+                size_t end = messageEnd(data);
+                sink.onMessage(data + 2, end - 2);
+                data += end;
+                len -= end;
+                continue;
+            }
+            if ( len >= 2 )
+                partial.reserve(messageEnd(data));
+            partial.assign(data, data + len);
+            break;
+        }
+
+        size_t want = partial.size() < 2 ? 2 : messageEnd(&partial[0]);
+        size_t take = std::min(want - partial.size(), len);
+        partial.insert(partial.end(), data, data + take);
+        data += take;
+        len -= take;
+        if ( partial.size() < 2 )
+            break;
+        if ( partial.size() == 2 )
+            partial.reserve(messageEnd(&partial[0]));
+        if ( partial.size() == messageEnd(&partial[0]) )
+        {
+            sink.onMessage(&partial[0] + 2, partial.size() - 2);
+            partial.clear();
+            if ( partial.capacity() > KEEP_BYTES )
+                std::vector<unsigned char>().swap(partial);
+        }
+    }
+    buffered_ = buffered_ - before + partial.capacity();
+}
+
+void TcpFlowTable::trim(int keep)
+{
+    /* Over the byte budget: drop the idlest flows, never the one just fed */
+    while ( buffered_ > maxBuffered_ && -1 != oldest_ && oldest_ != keep )
+        release(oldest_);
+}
+
+void TcpFlowTable::expire(unsigned long long now)
+{
+    while ( -1 != oldest_ && flows_[oldest_].ts + timeoutUs_ <= now )
+        release(oldest_);
+}
+
+}
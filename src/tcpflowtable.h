@@ -0,0 +1,101 @@
+#ifndef __TCPFLOWTABLE_H
+#define __TCPFLOWTABLE_H
+
+#include <vector>
+
+#include "dnsparse.h"
+
+namespace DNSView
+{
+
+/* One direction of a TCP connection to or from port 53 */
+struct TcpFlowKey
+{
+    unsigned char ver;
+    unsigned char client[16];
+    unsigned char server[16];
+    unsigned short port;        /* client port */
+    bool fromServer;
+
+    bool operator==(const TcpFlowKey &other) const;
+};
+
+/* Receives each complete DNS message without its length prefix, valid only
+ * during the call */
+class TcpMessageSink
+{
+public:
+    virtual ~TcpMessageSink() {}
+    virtual void onMessage(const unsigned char *msg, size_t len) = 0;
+};
+
+/* DNS over TCP (RFC 7766): every message has a 2-byte length in front and
+ * may be split over segments or share one with others. Each direction of a
+ * connection is a flow holding the next expected sequence number and any
+ * message it has only part of. Messages that arrive whole are handed on
+ * straight from the packet; only the unfinished tail of a segment is
+ * copied. Memory is fixed: flows come from a preallocated pool in LRU
+ * order, so a full table reuses the longest idle flow, and when the partial
+ * messages held exceed the byte budget the idlest flows are dropped. A flow
+ * is only made for a segment carrying data, so a SYN flood costs nothing.
+ * Segments are expected in capture order; a retransmission is trimmed or
+ * skipped, a missing segment abandons the partial message and restarts the
+ * stream at the next segment. Not thread-safe. */
+class TcpFlowTable
+{
+public:
+    enum Result
+    {
+        SEGMENT_OK = 0,
+        SEGMENT_NO_DATA,        /* handshake or teardown only */
+        SEGMENT_RETRANSMIT,     /* every byte was seen before */
+        SEGMENT_GAP             /* bytes before it were missed */
+    };
+
+    explicit TcpFlowTable(unsigned int capacity = 1 << 14, size_t maxBuffered = 32 << 20);
+
+    /* Flows idle this long are forgotten by expire() */
+    void setTimeout(unsigned int timeoutMs);
+    void clear();
+    size_t flows() const;
+    /* Bytes held for partial messages */
+    size_t buffered() const;
+
+    /* ts is in microseconds */
+    int add(const TcpFlowKey &key, unsigned long long ts, const TCPSegment &segment, 
+            TcpMessageSink &sink);
+    void expire(unsigned long long now);
+
+private:
+    enum { KEEP_BYTES = 1024 };     /* buffer kept by a freed flow for the next */
+
+    struct Flow
+    {
+        TcpFlowKey key;
+        unsigned long long ts;
+        unsigned int nextSeq;
+        std::vector<unsigned char> partial;     /* length prefix included */
+        bool live;
+        int next;               /* hash chain, or the free list */
+        int older, newer;       /* LRU list of live flows */
+    };
+
+    unsigned int bucket(const TcpFlowKey &key) const;
+    int find(const TcpFlowKey &key) const;
+    int alloc(const TcpFlowKey &key, unsigned long long ts);
+    void release(int slot);
+    void touch(int slot, unsigned long long ts);
+    void consume(int slot, const unsigned char *data, size_t len, TcpMessageSink &sink);
+    void trim(int keep);
+
+    std::vector<Flow> flows_;
+    std::vector<int> buckets_;
+    int free_;
+    int oldest_, newest_;
+    size_t live_, buffered_, maxBuffered_;
+    unsigned long long timeoutUs_;
+};
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstddef>
+
+#include "../dnsparse.h"
+
+/* libFuzzer entry point: the input is an IP packet, decoded the way the
+ * capture path does, with every name converted to wire and text form. The
+ * input is also tried as a bare DNS message so names get fuzzed without
+ * having to find valid IP and UDP headers first. */
+
+using namespace DNSView;
+
+namespace
+{
+
+void fuzzMessage(const unsigned char *msg, size_t len)
+{
+    DNSParser parser;
+    if ( parser.init(msg, len) )
+        return;
+    unsigned char wire[DNS_MAX_NAME];
+    char text[DNS_MAX_TEXT];
+    size_t nameLen;
+    const DNSHeader &hdr = parser.header();
+    DNSQuestion question;
+    for (unsigned int i = 0; i < hdr.qdcount; ++i)
+    {
+        if ( parser.nextQuestion(question) )
+            return;
+        nameToWire(question.name, wire, nameLen);
+        nameToText(question.name, text, nameLen);
+    }
+    DNSRecord record;
+    unsigned int records = hdr.ancount + hdr.nscount + hdr.arcount;
+    for (unsigned int i = 0; i < records; ++i)
+    {
+        if ( parser.nextRecord(record) )
+            return;
+        nameToText(record.name, text, nameLen);
+        nameToText(record.rdataName, text, nameLen);
+    }
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    fuzzMessage(data, size);
+
+    IPPacket ip;
+    if ( parseIP(data, size, ip) )
+        return 0;
+    if ( ip.proto == 17 )
+    {
+        UDPDatagram udp;
+        if ( !parseUDP(ip.payload, ip.payloadLen, udp) )
+            fuzzMessage(udp.payload, udp.payloadLen);
+    }
+    else if ( ip.proto == 6 )
+    {
+        TCPSegment tcp;
+        /* Skip the two byte length prefix, reassembly is not fuzzed here */
+        if ( !parseTCP(ip.payload, ip.payloadLen, tcp) && tcp.payloadLen >= 2 )
+            fuzzMessage(tcp.payload + 2, tcp.payloadLen - 2);
+    }
+    return 0;
+}
@@ -0,0 +1,610 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../dnsparse.h"
+
+/* Edge cases for the wire parser: truncation at every layer, compression
+ * pointers that must be refused, over-long names, IPv6 extension chains and
+ * counts that promise more than the message holds. Exits nonzero on failure. */
+
+using namespace DNSView;
+
+namespace
+{
+
+typedef std::vector<unsigned char> Bytes;
+
+int failures = 0;
+
+#define CHECK_EQ(actual, expected) \
+    checkEq(__FILE__, __LINE__, #actual, static_cast<long>(actual), static_cast<long>(expected))
+
+void checkEq(const char *file, int line, const char *what, long actual, long expected)
+{
+    if ( actual == expected )
+        return;
+    std::fprintf(stderr, "%s:%d: %s is %ld, expected %ld\n", file, line, what, actual, expected);
+    ++failures;
+}
+
+void put16(Bytes &b, unsigned int v)
+{
+    b.push_back(static_cast<unsigned char>(v >> 8));
+    b.push_back(static_cast<unsigned char>(v));
+}
+
+/* 12 byte DNS header */
+Bytes dnsHeader(unsigned int qdcount, unsigned int ancount)
+{
+    Bytes b;
+    put16(b, 0x1234);
+    put16(b, 0x0100);
+    put16(b, qdcount);
+    put16(b, ancount);
+    put16(b, 0);
+    put16(b, 0);
+    return b;
+}
+
+void putLabel(Bytes &b, const char *label)
+{
+    size_t len = std::strlen(label);
+    b.push_back(static_cast<unsigned char>(len));
+    b.insert(b.end(), label, label + len);
+}
+
+void putLabel(Bytes &b, size_t len, char fill)
+{
+    b.push_back(static_cast<unsigned char>(len));
+    b.insert(b.end(), len, static_cast<unsigned char>(fill));
+}
+
+/* www.example.com, uncompressed */
+void putName(Bytes &b)
+{
+    putLabel(b, "www");
+    putLabel(b, "example");
+    putLabel(b, "com");
+    b.push_back(0);
+}
+
+void putPointer(Bytes &b, unsigned int offset)
+{
+    put16(b, 0xc000 | offset);
+}
+
+/* Type A, class IN */
+void putTypeClass(Bytes &b)
+{
+    put16(b, 1);
+    put16(b, 1);
+}
+
+/* IPv4 header of 20 bytes followed by the payload */
+Bytes ipv4(const Bytes &payload, unsigned int frag)
+{
+    Bytes b;
+    b.push_back(0x45);
+    b.push_back(0);
+    put16(b, 20 + payload.size());
+    put16(b, 0x4321);
+    put16(b, frag);
+    b.push_back(64);
+    b.push_back(17);
+    put16(b, 0);
+    for (int i = 0; i < 8; ++i)
+        b.push_back(static_cast<unsigned char>(10 + i));
+    b.insert(b.end(), payload.begin(), payload.end());
+    return b;
+}
+
+/* IPv6 header, payload is everything after it including extension headers */
+Bytes ipv6(unsigned int next, const Bytes &payload)
+{
+    Bytes b;
+    b.push_back(0x60);
+    b.push_back(0);
+    put16(b, 0);
+    put16(b, payload.size());
+    b.push_back(static_cast<unsigned char>(next));
+    b.push_back(64);
+    b.insert(b.end(), 32, 0x20);
+    b.insert(b.end(), payload.begin(), payload.end());
+    return b;
+}
+
+/* Options style extension header of ( units + 1 ) * 8 bytes */
+void putExtension(Bytes &b, unsigned int next, unsigned int units)
+{
+    b.push_back(static_cast<unsigned char>(next));
+    b.push_back(static_cast<unsigned char>(units));
+    b.insert(b.end(), ( units + 1 ) * 8 - 2, 0);
+}
+
+void putFragment(Bytes &b, unsigned int next, unsigned int offset, bool more)
+{
+    b.push_back(static_cast<unsigned char>(next));
+    b.push_back(0);
+    put16(b, offset | ( more ? 1 : 0 ));
+    put16(b, 0xabcd);
+    put16(b, 0x0001);
+}
+
+Bytes udp(const Bytes &payload)
+{
+    Bytes b;
+    put16(b, 40000);
+    put16(b, 53);
+    put16(b, 8 + payload.size());
+    put16(b, 0);
+    b.insert(b.end(), payload.begin(), payload.end());
+    return b;
+}
+
+Bytes query()
+{
+    Bytes b = dnsHeader(1, 0);
+    putName(b);
+    putTypeClass(b);
+    return b;
+}
+
+/* Answer header after the name: class IN, TTL, rdata length */
+void putRecord(Bytes &b, unsigned int type, unsigned int ttl, unsigned int rdlen)
+{
+    put16(b, type);
+    put16(b, 1);
+    put16(b, ttl >> 16);
+    put16(b, ttl);
+    put16(b, rdlen);
+}
+
+/* Status of the last of the qdcount questions, stopping at the first error */
+int questions(const Bytes &msg)
+{
+    DNSParser parser;
+    int ret = parser.init(&msg[0], msg.size());
+    DNSQuestion question;
+    for (unsigned int i = 0; !ret && i < parser.header().qdcount; ++i)
+        ret = parser.nextQuestion(question);
+    return ret;
+}
+
+void testTruncatedIP()
+{
+    Bytes pkt = ipv4(udp(query()), 0);
+    IPPacket ip;
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_OK);
+    CHECK_EQ(ip.proto, 17);
+    CHECK_EQ(ip.payloadLen, pkt.size() - 20);
+
+    CHECK_EQ(parseIP(&pkt[0], 0, ip), PARSE_TRUNCATED);
+    CHECK_EQ(parseIP(&pkt[0], 19, ip), PARSE_TRUNCATED);
+    /* Total length says more than was captured */
+    CHECK_EQ(parseIP(&pkt[0], pkt.size() - 1, ip), PARSE_TRUNCATED);
+
+    /* Trailing link padding is not payload */
+    Bytes padded = pkt;
+    padded.insert(padded.end(), 6, 0);
+    CHECK_EQ(parseIP(&padded[0], padded.size(), ip), PARSE_OK);
+    CHECK_EQ(ip.payloadLen, pkt.size() - 20);
+
+    Bytes bad = pkt;
+    bad[0] = 0x44;
+    CHECK_EQ(parseIP(&bad[0], bad.size(), ip), PARSE_BAD_IP);
+    bad = pkt;
+    bad[0] = 0x55;
+    CHECK_EQ(parseIP(&bad[0], bad.size(), ip), PARSE_BAD_IP);
+
+    Bytes v6 = ipv6(17, udp(query()));
+    CHECK_EQ(parseIP(&v6[0], 39, ip), PARSE_TRUNCATED);
+    CHECK_EQ(parseIP(&v6[0], v6.size() - 1, ip), PARSE_TRUNCATED);
+    CHECK_EQ(parseIP(&v6[0], v6.size(), ip), PARSE_OK);
+}
+
+void testTruncatedUDP()
+{
+    Bytes dgram = udp(query());
+    UDPDatagram u;
+    CHECK_EQ(parseUDP(&dgram[0], dgram.size(), u), PARSE_OK);
+    CHECK_EQ(u.dport, 53);
+    CHECK_EQ(u.payloadLen, dgram.size() - 8);
+
+    CHECK_EQ(parseUDP(&dgram[0], 7, u), PARSE_TRUNCATED);
+    /* UDP length says more than the IP payload holds */
+    CHECK_EQ(parseUDP(&dgram[0], dgram.size() - 1, u), PARSE_TRUNCATED);
+
+    Bytes bad = dgram;
+    bad[4] = 0;
+    bad[5] = 7;
+    CHECK_EQ(parseUDP(&bad[0], bad.size(), u), PARSE_BAD_IP);
+}
+
+void testTruncatedTCP()
+{
+    Bytes seg;
+    put16(seg, 40000);
+    put16(seg, 53);
+    put16(seg, 0);
+    put16(seg, 1);
+    put16(seg, 0);
+    put16(seg, 0);
+    seg.push_back(0x60);        /* 24 byte header */
+    seg.push_back(TCPSegment::SYN);
+    seg.insert(seg.end(), 10, 0);
+    TCPSegment tcp;
+    CHECK_EQ(parseTCP(&seg[0], seg.size(), tcp), PARSE_OK);
+    CHECK_EQ(tcp.seq, 1);
+    CHECK_EQ(tcp.flags, TCPSegment::SYN);
+    CHECK_EQ(tcp.payloadLen, 0);
+
+    CHECK_EQ(parseTCP(&seg[0], 19, tcp), PARSE_TRUNCATED);
+    /* Data offset past the end of the segment */
+    CHECK_EQ(parseTCP(&seg[0], 20, tcp), PARSE_TRUNCATED);
+    seg[12] = 0x40;
+    CHECK_EQ(parseTCP(&seg[0], seg.size(), tcp), PARSE_BAD_IP);
+}
+
+void testTruncatedDNS()
+{
+    Bytes msg = query();
+    DNSParser parser;
+    CHECK_EQ(parser.init(&msg[0], 11), PARSE_TRUNCATED);
+    /* Cut inside the name, then inside the type and class */
+    CHECK_EQ(questions(Bytes(msg.begin(), msg.begin() + 20)), PARSE_TRUNCATED);
+    CHECK_EQ(questions(Bytes(msg.begin(), msg.end() - 1)), PARSE_TRUNCATED);
+    CHECK_EQ(questions(msg), PARSE_OK);
+
+    /* A pointer cut after its first byte */
+    Bytes cut = dnsHeader(1, 0);
+    cut.push_back(0xc0);
+    CHECK_EQ(questions(cut), PARSE_TRUNCATED);
+}
+
+void testPointerLoop()
+{
+    /* Points at itself */
+    Bytes msg = dnsHeader(1, 0);
+    putPointer(msg, 12);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_NAME_LOOP);
+
+    /* A label followed by a pointer back to that label */
+    msg = dnsHeader(1, 0);
+    putLabel(msg, "x");
+    putPointer(msg, 12);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_NAME_LOOP);
+
+    /* The same in the second question, after a good first one */
+    msg = query();
+    msg[5] = 2;
+    size_t at = msg.size();
+    putLabel(msg, "x");
+    putPointer(msg, at);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_NAME_LOOP);
+}
+
+void testForwardPointer()
+{
+    /* The question name points at a valid name later in the message */
+    Bytes msg = dnsHeader(1, 0);
+    putPointer(msg, 18);
+    putTypeClass(msg);
+    putName(msg);
+    CHECK_EQ(questions(msg), PARSE_NAME_LOOP);
+
+    /* Backwards is fine, and the cursor lands just past the pointer */
+    msg = query();
+    msg[5] = 3;
+    putLabel(msg, "mail");
+    putPointer(msg, 16);
+    putTypeClass(msg);
+    putPointer(msg, 12);
+    putTypeClass(msg);
+    DNSParser parser;
+    DNSQuestion question;
+    char text[DNS_MAX_TEXT];
+    size_t len;
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(nameToText(question.name, text, len), PARSE_OK);
+    CHECK_EQ(std::strcmp(text, "mail.example.com"), 0);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(nameToText(question.name, text, len), PARSE_OK);
+    CHECK_EQ(std::strcmp(text, "www.example.com"), 0);
+    CHECK_EQ(question.qtype, 1);
+}
+
+void testLongName()
+{
+    /* 3 * 64 + 62 + 1 = 255 octets, the limit */
+    Bytes msg = dnsHeader(1, 0);
+    for (int i = 0; i < 3; ++i)
+        putLabel(msg, 63, 'a');
+    putLabel(msg, 61, 'b');
+    msg.push_back(0);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_OK);
+
+    DNSParser parser;
+    DNSQuestion question;
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    unsigned char wire[DNS_MAX_NAME];
+    char text[DNS_MAX_TEXT];
+    size_t len;
+    CHECK_EQ(nameToWire(question.name, wire, len), PARSE_OK);
+    CHECK_EQ(len, DNS_MAX_NAME);
+    CHECK_EQ(nameToText(question.name, text, len), PARSE_OK);
+    CHECK_EQ(len, DNS_MAX_TEXT - 3);
+
+    /* One octet more */
+    msg = dnsHeader(1, 0);
+    for (int i = 0; i < 3; ++i)
+        putLabel(msg, 63, 'a');
+    putLabel(msg, 62, 'b');
+    msg.push_back(0);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_BAD_NAME);
+
+    /* Over the limit only once a pointer is followed */
+    msg = query();
+    msg[5] = 2;
+    for (int i = 0; i < 4; ++i)
+        putLabel(msg, 63, 'c');
+    putPointer(msg, 12);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_BAD_NAME);
+
+    /* Label length with the reserved 01/10 type bits */
+    msg = dnsHeader(1, 0);
+    msg.push_back(0x40);
+    msg.push_back(0);
+    putTypeClass(msg);
+    CHECK_EQ(questions(msg), PARSE_BAD_NAME);
+}
+
+void testIPv6Extensions()
+{
+    Bytes dgram = udp(query());
+    IPPacket ip;
+
+    /* hop-by-hop -> destination options (16 bytes) -> routing -> UDP */
+    Bytes chain;
+    putExtension(chain, 60, 0);
+    putExtension(chain, 43, 1);
+    putExtension(chain, 17, 0);
+    size_t extLen = chain.size();
+    chain.insert(chain.end(), dgram.begin(), dgram.end());
+    Bytes pkt = ipv6(0, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_OK);
+    CHECK_EQ(ip.ver, 6);
+    CHECK_EQ(ip.proto, 17);
+    CHECK_EQ(ip.payload - &pkt[0], static_cast<long>(40 + extLen));
+    CHECK_EQ(ip.payloadLen, dgram.size());
+
+    /* Authentication header counts in 4 byte units */
+    chain.clear();
+    chain.push_back(17);
+    chain.push_back(4);
+    chain.insert(chain.end(), 22, 0);
+    chain.insert(chain.end(), dgram.begin(), dgram.end());
+    pkt = ipv6(51, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_OK);
+    CHECK_EQ(ip.payload - &pkt[0], 40 + 24);
+
+    /* An extension header claiming more than the payload */
+    chain.clear();
+    putExtension(chain, 17, 0);
+    chain[1] = 1;
+    pkt = ipv6(0, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_TRUNCATED);
+
+    /* A chain cut between headers */
+    chain.clear();
+    putExtension(chain, 60, 0);
+    pkt = ipv6(0, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_TRUNCATED);
+
+    /* A later fragment behind a hop-by-hop header */
+    chain.clear();
+    putExtension(chain, 44, 0);
+    putFragment(chain, 17, 8, true);
+    chain.insert(chain.end(), 16, 0);
+    pkt = ipv6(0, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_FRAGMENT);
+
+    /* Nothing to see past ESP */
+    pkt = ipv6(50, Bytes(16, 0));
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_UNSUPPORTED);
+}
+
+void testFragments()
+{
+    Bytes dgram = udp(query());
+    IPPacket ip;
+
+    /* The first fragment is a fragment too, DF alone is not */
+    Bytes pkt = ipv4(dgram, 0x2000);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_FRAGMENT);
+    CHECK_EQ(ip.fragId, 0x4321);
+    CHECK_EQ(ip.fragOffset, 0);
+    CHECK_EQ(ip.moreFragments, true);
+    CHECK_EQ(ip.payloadLen, dgram.size());
+    pkt = ipv4(dgram, 0x0003);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_FRAGMENT);
+    CHECK_EQ(ip.fragOffset, 24);
+    CHECK_EQ(ip.moreFragments, false);
+    pkt = ipv4(dgram, 0x4000);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_OK);
+
+    /* Atomic IPv6 fragment is the whole datagram */
+    Bytes chain;
+    putFragment(chain, 17, 0, false);
+    chain.insert(chain.end(), dgram.begin(), dgram.end());
+    pkt = ipv6(44, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_OK);
+    CHECK_EQ(ip.proto, 17);
+    CHECK_EQ(ip.payloadLen, dgram.size());
+
+    /* The fields come from the fragment header, behind a hop-by-hop one */
+    chain.clear();
+    putExtension(chain, 44, 0);
+    putFragment(chain, 17, 8, true);
+    chain.insert(chain.end(), 16, 0);
+    pkt = ipv6(0, chain);
+    CHECK_EQ(parseIP(&pkt[0], pkt.size(), ip), PARSE_FRAGMENT);
+    CHECK_EQ(ip.proto, 17);
+    CHECK_EQ(ip.fragOffset, 8);
+    CHECK_EQ(ip.moreFragments, true);
+    CHECK_EQ(ip.fragId, 0xabcd0001);
+    CHECK_EQ(ip.payloadLen, 16);
+}
+
+void testRecords()
+{
+    /* CNAME mail.example.com -> www.example.com, both compressed */
+    Bytes msg = query();
+    msg[7] = 1;
+    putLabel(msg, "mail");
+    putPointer(msg, 16);
+    putRecord(msg, 5, 300, 2);
+    putPointer(msg, 12);
+    DNSParser parser;
+    DNSQuestion question;
+    DNSRecord record;
+    char text[DNS_MAX_TEXT];
+    size_t len;
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(parser.nextRecord(record), PARSE_OK);
+    CHECK_EQ(record.type, 5);
+    CHECK_EQ(record.ttl, 300);
+    CHECK_EQ(record.rdlen, 2);
+    CHECK_EQ(nameToText(record.name, text, len), PARSE_OK);
+    CHECK_EQ(std::strcmp(text, "mail.example.com"), 0);
+    CHECK_EQ(nameToText(record.rdataName, text, len), PARSE_OK);
+    CHECK_EQ(std::strcmp(text, "www.example.com"), 0);
+
+    /* rdata running off the end */
+    msg = query();
+    msg[7] = 1;
+    putPointer(msg, 12);
+    putRecord(msg, 1, 60, 4);
+    msg.push_back(192);
+    msg.push_back(0);
+    msg.push_back(2);
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(parser.nextRecord(record), PARSE_TRUNCATED);
+
+    /* Two pointers at each other: the second answer's name jumps back into
+     * the first answer's rdata, which points forward at it again */
+    msg = query();
+    msg[7] = 2;
+    putPointer(msg, 12);
+    putRecord(msg, 5, 60, 2);
+    size_t rdata = msg.size();
+    putPointer(msg, rdata + 2);
+    putPointer(msg, rdata);
+    putRecord(msg, 1, 60, 0);
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(parser.nextRecord(record), PARSE_OK);
+    CHECK_EQ(nameToText(record.rdataName, text, len), PARSE_NAME_LOOP);
+    CHECK_EQ(parser.nextRecord(record), PARSE_NAME_LOOP);
+}
+
+void testCountsBeyondPayload()
+{
+    /* QDCOUNT says 3, the message holds one question */
+    Bytes msg = query();
+    msg[5] = 3;
+    DNSParser parser;
+    DNSQuestion question;
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.header().qdcount, 3);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_TRUNCATED);
+    CHECK_EQ(questions(msg), PARSE_TRUNCATED);
+
+    /* A header alone with every count at the maximum */
+    msg = dnsHeader(0xffff, 0xffff);
+    CHECK_EQ(questions(msg), PARSE_TRUNCATED);
+}
+
+void testRecordCountsBeyondPayload()
+{
+    Bytes msg = dnsHeader(0, 0xffff);
+    DNSParser parser;
+    DNSQuestion question;
+    DNSRecord record;
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextRecord(record), PARSE_TRUNCATED);
+
+    /* ANCOUNT past the end after good questions */
+    msg = query();
+    msg[7] = 2;
+    CHECK_EQ(parser.init(&msg[0], msg.size()), PARSE_OK);
+    CHECK_EQ(parser.nextQuestion(question), PARSE_OK);
+    CHECK_EQ(parser.nextRecord(record), PARSE_TRUNCATED);
+}
+
+}
+
+int main()
+{
+    testTruncatedIP();
+    testTruncatedUDP();
+    testTruncatedTCP();
+    testTruncatedDNS();
+    testPointerLoop();
+    testForwardPointer();
+    testLongName();
+    testIPv6Extensions();
+    testFragments();
+    testRecords();
+    testCountsBeyondPayload();
+    testRecordCountsBeyondPayload();
+    if ( failures )
+    {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("all parser checks passed\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ctime>
+#include <cstring>
+
+#include "timefmt.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+/* Proleptic Gregorian date of a day count from 1970-01-01 */
+void civilFromDays(long long days, int &year, int &month, int &day)
+{
+    days += 719468;
+    long long era = ( days >= 0 ? days : days - 146096 ) / 146097;
+    unsigned int doe = static_cast<unsigned int>(days - era * 146097);
+    unsigned int yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+    unsigned int doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+    unsigned int mp = ( 5 * doy + 2 ) / 153;
+    day = static_cast<int>(doy - ( 153 * mp + 2 ) / 5 + 1);
+    month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int>(yoe + era * 400 + ( month <= 2 ));
+}
+
+long long daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    long long era = ( year >= 0 ? year : year - 399 ) / 400;
+    unsigned int yoe = static_cast<unsigned int>(year - era * 400);
+    unsigned int doy = ( 153 * ( month > 2 ? month - 3 : month + 9 ) + 2 ) / 5 + day - 1;
+    unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<long long>(doe) - 719468;
+}
+
+inline void put2(char *p, int v)
+{
+    p[0] = static_cast<char>('0' + v / 10);
+    p[1] = static_cast<char>('0' + v % 10);
+}
+
+}
+
+TimeFormatter::TimeFormatter() : cachedSec_(-1), offsetFrom_(0), offsetUntil_(0), offset_(0)
+{
+    prefix_[0] = '\0';
+}
+
+size_t TimeFormatter::format(unsigned int tv_sec, unsigned int tv_usec, char *buf)
+{
+    if ( tv_sec != cachedSec_ )
+        update(tv_sec);
+    std::memcpy(buf, prefix_, PREFIX_LEN);
+    buf[PREFIX_LEN] = '.';
+    if ( tv_usec > 999999 )
+        tv_usec = 999999;
+    for (int i = PREFIX_LEN + 6; i > PREFIX_LEN; i--)
+    {
+        buf[i] = static_cast<char>('0' + tv_usec % 10);
+        tv_usec /= 10;
+    }
+    buf[PREFIX_LEN + 7] = '\0';
+    return PREFIX_LEN + 7;
+}
+
+size_t TimeFormatter::formatSeconds(unsigned int tv_sec, char *buf)
+{
+    if ( tv_sec != cachedSec_ )
+        update(tv_sec);
+    std::memcpy(buf, prefix_, PREFIX_LEN + 1);
+    return PREFIX_LEN;
+}
+
+void TimeFormatter::update(long long sec)
+{
+    /* Only the offset lookup touches the C library's timezone state */
+    if ( sec < offsetFrom_ || sec >= offsetUntil_ )
+        lookupOffset(sec);
+    long long local = sec + offset_;
+    long long days = ( local >= 0 ? local : local - 86399 ) / 86400;
+    int secs = static_cast<int>(local - days * 86400);
+    int year, month, day;
+    civilFromDays(days, year, month, day);
+
+    char *p = prefix_;
+    put2(p, ( year / 100 ) % 100);
+    put2(p + 2, year % 100);
+    p[4] = '-';
+    put2(p + 5, month);
+    p[7] = '-';
+    put2(p + 8, day);
+    p[10] = ' ';
+    put2(p + 11, secs / 3600);
+    p[13] = ':';
+    put2(p + 14, ( secs / 60 ) % 60);
+    p[16] = ':';
+    put2(p + 17, secs % 60);
+    p[PREFIX_LEN] = '\0';
+    cachedSec_ = sec;
+}
+
+void TimeFormatter::lookupOffset(long long sec)
+{
+    std::time_t t = static_cast<std::time_t>(sec);
+    std::tm tm;
+#ifdef _WIN32
+    bool ok = !localtime_s(&tm, &t);
+#else
+    bool ok = localtime_r(&t, &tm) != NULL;
+#endif
+    offset_ = 0;
+    if ( ok )
+    {
+        long long local = daysFromCivil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) * 86400 + 
+            tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+        offset_ = static_cast<long>(local - sec);
+    }
+    offsetFrom_ = sec - sec % OFFSET_SPAN;
+    offsetUntil_ = offsetFrom_ + OFFSET_SPAN;
+}
+
+}
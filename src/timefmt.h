@@ -0,0 +1,40 @@
+#ifndef __TIMEFMT_H
+#define __TIMEFMT_H
+
+#include <cstddef>
+
+namespace DNSView
+{
+
+/* Renders packet timestamps as "yyyy-MM-dd hh:mm:ss.uuuuuu" in local time.
+ * The date and time of the last second seen are kept as text, so packets
+ * within the same second only render their microseconds. The UTC offset is
+ * looked up once per quarter hour, the finest step of any DST change.
+ * Nothing is allocated; not thread-safe, give each thread its own. */
+class TimeFormatter
+{
+public:
+    enum { TIME_STRLEN = 27 };
+
+    TimeFormatter();
+
+    /* buf must hold at least TIME_STRLEN, returns the length written */
+    size_t format(unsigned int tv_sec, unsigned int tv_usec, char *buf);
+    /* As format() without the fraction */
+    size_t formatSeconds(unsigned int tv_sec, char *buf);
+
+private:
+    enum { PREFIX_LEN = 19, OFFSET_SPAN = 900 };
+
+    void update(long long sec);
+    void lookupOffset(long long sec);
+
+    long long cachedSec_;
+    char prefix_[PREFIX_LEN + 1];
+    long long offsetFrom_, offsetUntil_;
+    long offset_;       /* seconds east of UTC */
+};
+
+}
+
+#endif
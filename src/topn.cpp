@@ -0,0 +1,308 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cstdio>
+
+#include "topn.h"
+#include "dnsparse.h"
+#include "nametable.h"
+
+namespace DNSView
+{
+
+namespace
+{
+
+const unsigned int WINDOWS[] = { 10, 60, 300 };
+
+struct Counts
+{
+    unsigned long long count, error;
+
+    Counts() : count(0), error(0) {}
+};
+
+/* Most counted first */
+struct ByCount
+{
+    bool operator()(const TopEntry &a, const TopEntry &b) const
+    {
+        return a.count > b.count;
+    }
+};
+
+struct NameLabel
+{
+    const NameTable &names;
+
+    std::string operator()(unsigned int id) const
+    {
+        return names.text(id);
+    }
+};
+
+struct ClientLabel
+{
+    std::string operator()(const ClientKey &key) const
+    {
+        char buf[ADDR_STRLEN];
+        formatAddr(key.ver, key.addr, buf);
+        return buf;
+    }
+};
+
+struct QTypeLabel
+{
+    std::string operator()(unsigned short qtype) const
+    {
+        const char *name = qtypeName(qtype);
+        char buf[16];
+        if ( !name )
+            std::snprintf(buf, sizeof(buf), "TYPE%u", qtype);
+        return name ? name : buf;
+    }
+};
+
+/* The sum of a window's sketches, then its n largest */
+template <typename Key, typename Hash = std::hash<Key> >
+class Merge
+{
+public:
+    void add(const SpaceSaving<Key, Hash> &sketch)
+    {
+        const std::vector<typename SpaceSaving<Key, Hash>::Entry> &entries = sketch.entries();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            Counts &counts = counts_[entries[i].key];
+            counts.count += entries[i].count;
+            counts.error += entries[i].error;
+        }
+    }
+
+    template <typename Label>
+    void top(size_t n, const Label &label, std::vector<TopEntry> &out) const
+    {
+        std::vector<std::pair<unsigned long long, Key> > all;
+        all.reserve(counts_.size());
+        for (typename std::unordered_map<Key, Counts, Hash>::const_iterator it = counts_.begin(); 
+                it != counts_.end(); ++it)
+            all.push_back(std::make_pair(it->second.count, it->first));
+        n = std::min(n, all.size());
+        std::partial_sort(all.begin(), all.begin() + n, all.end(), ByFirst());
+        out.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            const Counts &counts = counts_.find(all[i].second)->second;
+            out[i].label = label(all[i].second);
+            out[i].count = counts.count;
+            out[i].error = counts.error;
+        }
+    }
+
+private:
+    struct ByFirst
+    {
+        bool operator()(const std::pair<unsigned long long, Key> &a, 
+                const std::pair<unsigned long long, Key> &b) const
+        {
+            return a.first > b.first;
+        }
+    };
+
+    std::unordered_map<Key, Counts, Hash> counts_;
+};
+
+}
+
+size_t ClientKeyHash::operator()(const ClientKey &key) const
+{
+    /* FNV-1a */
+    unsigned long long h = 14695981039346656037ULL ^ key.ver;
+    for (size_t i = 0; i < sizeof(key.addr); i++)
+    {
+        h ^= key.addr[i];
+        h *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(h ^ ( h >> 32 ));
+}
+
+TopTracker::TopTracker() :
+    nTop_(0),
+    now_(0)
+{}
+
+void TopTracker::setSize(int nTop)
+{
+    nTop_ = nTop > 0 ? nTop : 0;
+    seconds_.clear();
+    if ( !nTop_ )
+        return;
+    size_t capacity = std::max(64, 8 * nTop_);
+    seconds_.resize(SECONDS);
+    for (size_t i = 0; i < seconds_.size(); i++)
+    {
+        seconds_[i].names.setCapacity(capacity);
+        seconds_[i].clients.setCapacity(capacity);
+        seconds_[i].qtypes.setCapacity(capacity);
+    }
+    clear();
+}
+
+int TopTracker::size() const
+{
+    return nTop_;
+}
+
+void TopTracker::clear()
+{
+    for (size_t i = 0; i < seconds_.size(); i++)
+    {
+        Second &second = seconds_[i];
+        second.second = ~0ULL;
+        second.queries = second.answers = 0;
+        second.names.clear();
+        second.clients.clear();
+        second.qtypes.clear();
+        std::memset(second.rcodes, 0, sizeof(second.rcodes));
+    }
+    now_ = 0;
+}
+
+TopTracker::Second *TopTracker::secondOf(unsigned long long second)
+{
+    /* Older than the longest window, from a reordered or late batch */
+    if ( second + SECONDS <= now_ )
+        return NULL;
+    now_ = std::max(now_, second);
+    Second &slot = seconds_[second % SECONDS];
+    if ( slot.second != second )
+    {
+        slot.second = second;
+        slot.queries = slot.answers = 0;
+        slot.names.clear();
+        slot.clients.clear();
+        slot.qtypes.clear();
+        std::memset(slot.rcodes, 0, sizeof(slot.rcodes));
+    }
+    return &slot;
+}
+
+void TopTracker::add(const QueryBatch &queries, NameFolder &folder)
+{
+    if ( !nTop_ )
+        return;
+    Second *pSecond = NULL;
+    unsigned long long current = ~0ULL;
+    for (QueryBatch::const_iterator it = queries.begin(); it != queries.end(); ++it)
+    {
+        if ( it->tv_sec != current )
+        {
+            current = it->tv_sec;
+            pSecond = secondOf(current);
+        }
+        if ( !pSecond )
+            continue;
+        pSecond->queries++;
+        if ( it->nameId < NameTable::FULL_ID )
+            pSecond->names.add(folder.fold(it->nameId));
+        ClientKey client;
+        client.ver = it->ver;
+        std::memset(client.addr, 0, sizeof(client.addr));
+        std::memcpy(client.addr, it->saddr, 6 == it->ver ? 16 : 4);
+        pSecond->clients.add(client);
+        pSecond->qtypes.add(it->qtype);
+    }
+}
+
+void TopTracker::add(const AnswerBatch &answers)
+{
+    /* Answers carry no time of their own, they count towards the latest second */
+    if ( !nTop_ || answers.empty() )
+        return;
+    Second *pSecond = secondOf(now_);
+    for (AnswerBatch::const_iterator it = answers.begin(); it != answers.end(); ++it)
+    {
+        pSecond->answers++;
+        pSecond->rcodes[DNSAnswer::TIMEOUT == it->status ? RCODE_TIMEOUT : it->rcode % RCODES]++;
+    }
+}
+
+void TopTracker::snapshot(const NameTable &names, TopSnapshot &snap) const
+{
+    snap.windows.resize(nTop_ ? sizeof(WINDOWS) / sizeof(WINDOWS[0]) : 0);
+    for (size_t w = 0; w < snap.windows.size(); w++)
+    {
+        TopWindow &window = snap.windows[w];
+        window.seconds = WINDOWS[w];
+        window.queries = window.answers = 0;
+        Merge<unsigned int> nameMerge;
+        Merge<ClientKey, ClientKeyHash> clientMerge;
+        Merge<unsigned short> qtypeMerge;
+        unsigned long long rcodes[RCODES + 1] = { 0 };
+        for (unsigned long long s = now_; s + WINDOWS[w] > now_ && s != ~0ULL; s--)
+        {
+            const Second &second = seconds_[s % SECONDS];
+            if ( second.second != s )
+                continue;
+            window.queries += second.queries;
+            window.answers += second.answers;
+            nameMerge.add(second.names);
+            clientMerge.add(second.clients);
+            qtypeMerge.add(second.qtypes);
+            for (int i = 0; i <= RCODES; i++)
+                rcodes[i] += second.rcodes[i];
+        }
+        NameLabel nameLabel = { names };
+        nameMerge.top(nTop_, nameLabel, window.names);
+        clientMerge.top(nTop_, ClientLabel(), window.clients);
+        qtypeMerge.top(nTop_, QTypeLabel(), window.qtypes);
+
+        /* Response codes are few enough to count exactly */
+        window.rcodes.clear();
+        for (int i = 0; i <= RCODES; i++)
+        {
+            if ( !rcodes[i] )
+                continue;
+            TopEntry entry;
+            const char *name = RCODE_TIMEOUT == i ? "timeout" : rcodeName(i);
+            char buf[16];
+            if ( !name )
+                std::snprintf(buf, sizeof(buf), "RCODE%d", i);
+            entry.label = name ? name : buf;
+            entry.count = rcodes[i];
+            entry.error = 0;
+            window.rcodes.push_back(entry);
+        }
+        std::sort(window.rcodes.begin(), window.rcodes.end(), ByCount());
+    }
+}
+
+}
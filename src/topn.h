@@ -0,0 +1,206 @@
+#ifndef __TOPN_H
+#define __TOPN_H
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dnsquery.h"
+
+namespace DNSView
+{
+
+class NameTable;
+class NameFolder;
+
+/* Space-Saving heavy hitters: at most capacity keys are counted, a new key
+ * takes over the smallest counter and inherits its count as the error. Any
+ * key seen more than total / capacity times is kept, and a count is never
+ * more than error above the truth. The counters are a min-heap so the
+ * smallest is found in O(1) and an update costs O(log capacity). Not
+ * thread-safe. */
+template <typename Key, typename Hash = std::hash<Key> >
+class SpaceSaving
+{
+public:
+    struct Entry
+    {
+        Key key;
+        unsigned long long count, error;
+    };
+
+    explicit SpaceSaving(size_t capacity = 0) : capacity_(capacity) {}
+
+    void setCapacity(size_t capacity)
+    {
+        capacity_ = capacity;
+        clear();
+    }
+
+    void clear()
+    {
+        entries_.clear();
+        heap_.clear();
+        pos_.clear();
+        index_.clear();
+    }
+
+    void add(const Key &key, unsigned long long n = 1)
+    {
+        typename std::unordered_map<Key, unsigned int, Hash>::iterator it = index_.find(key);
+        if ( it != index_.end() )
+        {
+            entries_[it->second].count += n;
+            siftDown(pos_[it->second]);
+            return;
+        }
+        if ( !capacity_ )
+            return;
+        if ( entries_.size() < capacity_ )
+        {
+            Entry entry = { key, n, 0 };
+            unsigned int id = static_cast<unsigned int>(entries_.size());
+            entries_.push_back(entry);
+            heap_.push_back(id);
+            pos_.push_back(id);
+            index_[key] = id;
+            siftUp(id);
+            return;
+        }
+        /* Evict the smallest, the newcomer may have been seen that often */
+        unsigned int id = heap_[0];
+        Entry &min = entries_[id];
+        index_.erase(min.key);
+        min.key = key;
+        min.error = min.count;
+        min.count += n;
+        index_[key] = id;
+        siftDown(0);
+    }
+
+    /* In no particular order */
+    const std::vector<Entry> &entries() const { return entries_; }
+
+private:
+    /* The heap holds entry numbers, so moving one never touches the map */
+    void place(size_t i, unsigned int id)
+    {
+        heap_[i] = id;
+        pos_[id] = static_cast<unsigned int>(i);
+    }
+
+    void siftUp(size_t i)
+    {
+        unsigned int id = heap_[i];
+        unsigned long long count = entries_[id].count;
+        while ( i > 0 && entries_[heap_[( i - 1 ) / 2]].count > count )
+        {
+            place(i, heap_[( i - 1 ) / 2]);
+            i = ( i - 1 ) / 2;
+        }
+        place(i, id);
+    }
+
+    void siftDown(size_t i)
+    {
+        unsigned int id = heap_[i];
+        unsigned long long count = entries_[id].count;
+        for (size_t child; ( child = 2 * i + 1 ) < heap_.size(); i = child)
+        {
+            if ( child + 1 < heap_.size() && entries_[heap_[child + 1]].count < entries_[heap_[child]].count )
+                child++;
+            if ( entries_[heap_[child]].count >= count )
+                break;
+            place(i, heap_[child]);
+        }
+        place(i, id);
+    }
+
+    size_t capacity_;
+    std::vector<Entry> entries_;
+    std::vector<unsigned int> heap_;    /* entry numbers, min-heap on count */
+    std::vector<unsigned int> pos_;     /* entry number -> position in heap_ */
+    std::unordered_map<Key, unsigned int, Hash> index_;   /* key -> entry number */
+};
+
+/* A client address as counted, the bytes past an IPv4 address zeroed */
+struct ClientKey
+{
+    unsigned char ver;
+    unsigned char addr[16];
+
+    bool operator==(const ClientKey &other) const
+    {
+        return ver == other.ver && !std::memcmp(addr, other.addr, sizeof(addr));
+    }
+};
+
+struct ClientKeyHash
+{
+    size_t operator()(const ClientKey &key) const;
+};
+
+/* One ranked row: count is at most error above the true number */
+struct TopEntry
+{
+    std::string label;
+    unsigned long long count, error;
+};
+
+struct TopWindow
+{
+    unsigned int seconds;
+    unsigned long long queries, answers;
+    std::vector<TopEntry> names, clients, qtypes, rcodes;
+};
+
+/* What the capture thread reports a few times a second */
+struct TopSnapshot
+{
+    std::vector<TopWindow> windows;     /* shortest first */
+};
+
+/* Busiest names, clients, query types and response codes over sliding
+ * windows of 10 s, 1 min and 5 min of capture time. Every second of the
+ * longest window has its own sketches, so a window is the sum of its
+ * seconds and memory stays fixed however many names and clients there are.
+ * Runs on the capture thread. */
+class TopTracker
+{
+public:
+    enum { SECONDS = 300, RCODES = 16, RCODE_TIMEOUT = RCODES };
+
+    TopTracker();
+
+    /* Rows per list, 0 turns counting off. The sketches keep several times
+     * as many keys so the rows shown are exact in all but the closest calls. */
+    void setSize(int nTop);
+    int size() const;
+    void clear();
+
+    /* Names are counted by their lower-cased id */
+    void add(const QueryBatch &queries, NameFolder &folder);
+    void add(const AnswerBatch &answers);
+    void snapshot(const NameTable &names, TopSnapshot &snap) const;
+
+private:
+    struct Second
+    {
+        unsigned long long second, queries, answers;
+        SpaceSaving<unsigned int> names;
+        SpaceSaving<ClientKey, ClientKeyHash> clients;
+        SpaceSaving<unsigned short> qtypes;
+        unsigned long long rcodes[RCODES + 1];
+    };
+
+    Second *secondOf(unsigned long long second);
+
+    int nTop_;
+    std::vector<Second> seconds_;   /* by second % SECONDS */
+    unsigned long long now_;        /* latest query time seen, seconds */
+};
+
+}
+
+#endif
@@ -0,0 +1,355 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#   include <sys/mman.h>
+#   include <sys/ioctl.h>
+#   include <sys/socket.h>
+#   include <unistd.h>
+#   include <net/if.h>
+#   include <net/if_arp.h>
+#   include <arpa/inet.h>
+#   include <linux/if_packet.h>
+#   include <linux/if_ether.h>
+#   include <linux/filter.h>
+#endif
+
+#include "dnsviewer.h"
+#include "pcap.h"
+#include "tpacketimpl.h"
+
+namespace DNSView
+{
+
+TPacketImpl::TPacketImpl() : IFCapImpl(), blockSize_(1 << 20), blockCount_(64), retireMs_(10), 
+    fanoutGroup_(0), fd_(-1), pRing_(NULL), ringLen_(0), curBlock_(0), pBlock_(NULL), pPkt_(NULL), 
+    remaining_(0), recv_(0), drop_(0)
+{}
+
+TPacketImpl::~TPacketImpl() 
+{
+    doShutDown();
+}
+
+void TPacketImpl::setRing(unsigned int blockSize, unsigned int blockCount, unsigned int retireMs)
+{
+    blockSize_ = blockSize;
+    blockCount_ = blockCount;
+    retireMs_ = retireMs;
+}
+
+void TPacketImpl::setFanout(unsigned short groupId)
+{
+    fanoutGroup_ = groupId;
+}
+
+std::map<std::string, std::string> TPacketImpl::doGetDeviceList(std::string &)
+{
+    return std::map<std::string, std::string>();
+}
+
+int TPacketImpl::doGetSelectableFd()
+{
+    return fd_;
+}
+
+#ifdef __linux__
+
+namespace
+{
+
+/* Ethernet and the loopback device carry an Ethernet header */
+bool ethernetFramed(const std::string &dev)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if ( -1 == fd )
+        return false;
+    ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, dev.c_str(), IFNAMSIZ - 1);
+    bool framed = 0 == ioctl(fd, SIOCGIFHWADDR, &ifr) && 
+        ( ARPHRD_ETHER == ifr.ifr_hwaddr.sa_family || ARPHRD_LOOPBACK == ifr.ifr_hwaddr.sa_family );
+    close(fd);
+    return framed;
+}
+
+}
+
+int TPacketImpl::doInit(const std::string &dev, const std::string &filter, 
+        std::string &errmsg)
+{
+    doShutDown();
+    recv_ = drop_ = 0;
+
+    /* "any" (every interface) and devices without Ethernet framing, such
+     * as tunnels, are read cooked: the kernel strips the link header */
+    int ifIndex = "any" == dev ? 0 : static_cast<int>(if_nametoindex(dev.c_str()));
+    if ( !ifIndex && "any" != dev )
+    {
+        errmsg = "No such interface " + dev;
+        return -1;
+    }
+    bool cooked = !ifIndex || !ethernetFramed(dev);
+    if ( setLinkType(cooked ? DLT_RAW : DLT_EN10MB, errmsg) )
+        return -1;
+    if ( -1 == ( fd_ = socket(AF_PACKET, cooked ? SOCK_DGRAM : SOCK_RAW, htons(ETH_P_ALL)) ) )
+    {
+        errmsg = std::string("AF_PACKET socket: ") + std::strerror(errno);
+        return -1;
+    }
+
+    /* The filter goes on before the bind so nothing unfiltered is queued */
+    if ( attachFilter(filter, errmsg) || setupRing(errmsg) )
+    {
+        doShutDown();
+        return -1;
+    }
+    sockaddr_ll addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifIndex;
+    if ( -1 == bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) )
+        errmsg = std::string("bind: ") + std::strerror(errno);
+    if ( !errmsg.empty() || joinFanout(errmsg) )
+    {
+        doShutDown();
+        return -1;
+    }
+    return 0;
+}
+
+int TPacketImpl::attachFilter(const std::string &filter, std::string &errmsg)
+{
+    /* Same expression as the libpcap backend, classic BPF is what
+     * SO_ATTACH_FILTER takes */
+    std::string expr = dnsFilter(linkType(), filter);
+    pcap_t *pDead = pcap_open_dead(linkType(), 65535);
+    bpf_program prog;
+    if ( !pDead || -1 == pcap_compile(pDead, &prog, expr.c_str(), 1, PCAP_NETMASK_UNKNOWN) )
+    {
+        errmsg = std::string("Bad filter: ") + ( pDead ? pcap_geterr(pDead) : "" );
+        if ( pDead )
+            pcap_close(pDead);
+        return -1;
+    }
+    sock_fprog fprog;
+    fprog.len = static_cast<unsigned short>(prog.bf_len);
+    fprog.filter = reinterpret_cast<sock_filter*>(prog.bf_insns);
+    int ret = setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+    if ( -1 == ret )
+        errmsg = std::string("SO_ATTACH_FILTER: ") + std::strerror(errno);
+    pcap_freecode(&prog);
+    pcap_close(pDead);
+    return ret;
+}
+
+int TPacketImpl::setupRing(std::string &errmsg)
+{
+    int version = TPACKET_V3;
+    if ( -1 == setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) )
+    {
+        errmsg = std::string("TPACKET_V3: ") + std::strerror(errno);
+        return -1;
+    }
+
+    /* Blocks must be a multiple of the page size; frames are variable in V3,
+     * tp_frame_size only sizes the frame count the kernel checks */
+    long pageSize = sysconf(_SC_PAGESIZE);
+    unsigned int blockSize = ( blockSize_ + pageSize - 1 ) / pageSize * pageSize;
+    tpacket_req3 req;
+    std::memset(&req, 0, sizeof(req));
+    req.tp_block_size = blockSize;
+    req.tp_block_nr = blockCount_;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = blockSize / req.tp_frame_size * blockCount_;
+    req.tp_retire_blk_tov = retireMs_;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if ( -1 == setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) )
+    {
+        errmsg = std::string("PACKET_RX_RING: ") + std::strerror(errno);
+        return -1;
+    }
+    ringLen_ = static_cast<size_t>(blockSize) * blockCount_;
+    void *pRing = mmap(NULL, ringLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_, 0);
+    if ( MAP_FAILED == pRing )
+        pRing = mmap(NULL, ringLen_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if ( MAP_FAILED == pRing )
+    {
+        errmsg = std::string("mmap ring: ") + std::strerror(errno);
+        ringLen_ = 0;
+        return -1;
+    }
+    pRing_ = static_cast<u_char*>(pRing);
+    blockSize_ = blockSize;
+    curBlock_ = 0;
+    pBlock_ = NULL;
+    remaining_ = 0;
+    return 0;
+}
+
+int TPacketImpl::joinFanout(std::string &errmsg)
+{
+    if ( !fanoutGroup_ )
+        return 0;
+    int arg = fanoutGroup_ | ( ( PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG ) << 16 );
+    if ( -1 == setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) )
+    {
+        errmsg = std::string("PACKET_FANOUT: ") + std::strerror(errno);
+        return -1;
+    }
+    return 0;
+}
+
+bool TPacketImpl::nextPacket(const u_char* &data, u_int &caplen, u_int &len, 
+        u_int &tv_sec, u_int &tv_usec)
+{
+    /* A block is given back to the kernel only on the call after its last
+     * packet, so the pointer handed out last is still good until then */
+    while ( !pBlock_ || !remaining_ )
+    {
+        if ( pBlock_ )
+            releaseBlock();
+        tpacket_block_desc *pDesc = reinterpret_cast<tpacket_block_desc*>(
+                pRing_ + static_cast<size_t>(curBlock_) * blockSize_);
+        if ( !( __atomic_load_n(&pDesc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER ) )
+            return false;
+        pBlock_ = reinterpret_cast<u_char*>(pDesc);
+        remaining_ = pDesc->hdr.bh1.num_pkts;
+        pPkt_ = pBlock_ + pDesc->hdr.bh1.offset_to_first_pkt;
+    }
+    const tpacket3_hdr *pHdr = reinterpret_cast<const tpacket3_hdr*>(pPkt_);
+    data = pPkt_ + pHdr->tp_mac;
+    caplen = pHdr->tp_snaplen;
+    len = pHdr->tp_len;
+    tv_sec = pHdr->tp_sec;
+    tv_usec = pHdr->tp_nsec / 1000;
+    pPkt_ += pHdr->tp_next_offset;
+    --remaining_;
+    return true;
+}
+
+void TPacketImpl::releaseBlock()
+{
+    tpacket_block_desc *pDesc = reinterpret_cast<tpacket_block_desc*>(pBlock_);
+    __atomic_store_n(&pDesc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    pBlock_ = NULL;
+    curBlock_ = ( curBlock_ + 1 ) % blockCount_;
+}
+
+int TPacketImpl::doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec)
+{
+    u_int caplen, len;
+    if ( !pRing_ )
+        return -1;
+    while ( nextPacket(data, caplen, len, tv_sec, tv_usec) )
+    {
+        if ( caplen == len )
+            return static_cast<int>(caplen);
+    }
+    return 0;
+}
+
+int TPacketImpl::doDispatch(int maxPkts, PktHandler handler, void *user)
+{
+    /* Whole blocks at a time: keep going to the end of the block that
+     * reaches maxPkts */
+    if ( !pRing_ )
+        return -1;
+    const u_char *data;
+    u_int caplen, len, tv_sec, tv_usec;
+    int n = 0;
+    while ( ( n < maxPkts || remaining_ ) && nextPacket(data, caplen, len, tv_sec, tv_usec) )
+    {
+        handler(user, data, caplen, len, tv_sec, tv_usec);
+        n++;
+    }
+    if ( pBlock_ && !remaining_ )
+        releaseBlock();
+    return n;
+}
+
+void TPacketImpl::doShutDown()
+{
+    if ( pRing_ )
+        munmap(pRing_, ringLen_);
+    pRing_ = NULL;
+    ringLen_ = 0;
+    pBlock_ = NULL;
+    remaining_ = 0;
+    if ( -1 != fd_ )
+        close(fd_);
+    fd_ = -1;
+}
+
+void TPacketImpl::doGetStats(unsigned long long &recv, unsigned long long &drop, 
+        unsigned long long &)
+{
+    tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if ( -1 != fd_ && 0 == getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) )
+    {
+        recv_ += stats.tp_packets;
+        drop_ += stats.tp_drops;
+    }
+    recv = recv_;
+    drop = drop_;
+}
+
+#else
+
+int TPacketImpl::doInit(const std::string &, const std::string &, std::string &errmsg)
+{
+    errmsg = "TPACKET_V3 capture needs Linux";
+    return -1;
+}
+
+int TPacketImpl::doGetNextPkt(const u_char* &, u_int &, u_int &)
+{
+    return -1;
+}
+
+int TPacketImpl::doDispatch(int, PktHandler, void *)
+{
+    return -1;
+}
+
+void TPacketImpl::doShutDown()
+{}
+
+void TPacketImpl::doGetStats(unsigned long long &, unsigned long long &, unsigned long long &)
+{}
+
+#endif
+
+}
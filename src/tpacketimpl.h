@@ -0,0 +1,66 @@
+#ifndef __TPACKETIMPL_H
+#define __TPACKETIMPL_H
+
+#include <string>
+#include <vector>
+
+#include "ifcapimpl.h"
+
+namespace DNSView
+{
+
+/* Linux AF_PACKET capture with a TPACKET_V3 block ring. The kernel fills
+ * whole blocks and hands them over, packets are walked in place inside the
+ * mapped ring, so there is no syscall and no copy per packet. The BPF
+ * filter is compiled with libpcap and attached to the socket. "any" and
+ * interfaces without an Ethernet header are captured cooked, as raw IP. */
+class TPacketImpl : public IFCapImpl
+{
+public:
+    TPacketImpl();
+    ~TPacketImpl();
+
+    /* Ring geometry and how long the kernel holds a partly filled block,
+     * set before init() */
+    void setRing(unsigned int blockSize, unsigned int blockCount, unsigned int retireMs);
+    /* Join PACKET_FANOUT group groupId (0 for none) */
+    void setFanout(unsigned short groupId);
+
+protected:
+    virtual int doInit(const std::string &dev, const std::string &filter, 
+            std::string &errmsg);
+    virtual std::map<std::string, std::string> doGetDeviceList(std::string &errmsg);
+    virtual int doGetNextPkt(const u_char* &data, u_int &tv_sec, u_int &tv_usec);
+    virtual int doDispatch(int maxPkts, PktHandler handler, void *user);
+    virtual int doGetSelectableFd();
+    virtual void doShutDown();
+    virtual void doGetStats(unsigned long long &recv, unsigned long long &drop, 
+            unsigned long long &ifDrop);
+
+private:
+    int setupRing(std::string &errmsg);
+    int attachFilter(const std::string &filter, std::string &errmsg);
+    int joinFanout(std::string &errmsg);
+    bool nextPacket(const u_char* &data, u_int &caplen, u_int &len, 
+            u_int &tv_sec, u_int &tv_usec);
+    void releaseBlock();
+
+    unsigned int blockSize_, blockCount_, retireMs_;
+    unsigned short fanoutGroup_;
+    int fd_;
+    u_char *pRing_;
+    size_t ringLen_;
+
+    /* Walk position: the block we own, the next packet in it, how many are left */
+    unsigned int curBlock_;
+    u_char *pBlock_;
+    const u_char *pPkt_;
+    unsigned int remaining_;
+
+    /* PACKET_STATISTICS resets on every read */
+    unsigned long long recv_, drop_;
+};
+
+}
+
+#endif
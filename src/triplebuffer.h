@@ -0,0 +1,51 @@
+#ifndef __TRIPLEBUFFER_H
+#define __TRIPLEBUFFER_H
+
+#include <atomic>
+
+namespace DNSView
+{
+
+/* Hands the latest value from one writer thread to one reader thread with
+ * no locks: each side owns a buffer and they swap through a third. The
+ * writer never waits for the reader, the reader always sees a complete
+ * value, possibly the same one again. */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : spare_(1), write_(0), read_(2) {}
+
+    /* Writer: fill this in completely, then publish() it */
+    T &writeBuffer()
+    {
+        return buffers_[write_];
+    }
+
+    void publish()
+    {
+        write_ = spare_.exchange(write_ | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /* Reader: the newest published value */
+    const T &read()
+    {
+        if ( spare_.load(std::memory_order_relaxed) & FRESH )
+            read_ = spare_.exchange(read_, std::memory_order_acq_rel) & INDEX;
+        return buffers_[read_];
+    }
+
+private:
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer &operator=(const TripleBuffer&);
+
+    enum { INDEX = 3, FRESH = 4 };
+
+    T buffers_[3];
+    std::atomic<int> spare_;
+    int write_, read_;
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2013, Justin Borodinsky
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the {organization} nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+
+#include "txntable.h"
+
+namespace DNSView
+{
+
+bool TxnKey::operator==(const TxnKey &other) const
+{
+    return txid == other.txid && port == other.port && ver == other.ver && 
+        !std::memcmp(client, other.client, sizeof(client)) && 
+        !std::memcmp(server, other.server, sizeof(server));
+}
+
+TxnTable::TxnTable(unsigned int capacity) 
+    : head_(0), tail_(0), timeoutUs_(5000000), live_(0)
+{
+    /* Power of two ring, twice as many buckets */
+    unsigned int size = 1;
+    while ( size < capacity )
+        size <<= 1;
+    ring_.resize(size);
+    buckets_.assign(size * 2, -1);
+}
+
+void TxnTable::setTimeout(unsigned int timeoutMs)
+{
+    timeoutUs_ = static_cast<unsigned long long>(timeoutMs) * 1000;
+}
+
+void TxnTable::clear()
+{
+    buckets_.assign(buckets_.size(), -1);
+    head_ = tail_ = 0;
+    live_ = 0;
+}
+
+size_t TxnTable::pending() const
+{
+    return live_;
+}
+
+unsigned long long TxnTable::oldestSeq(unsigned long long none) const
+{
+    /* The ring is in seq order, a matched head entry only makes this lower */
+    return head_ == tail_ ? none : ring_[head_ & ( ring_.size() - 1 )].seq;
+}
+
+unsigned int TxnTable::bucket(const TxnKey &key) const
+{
+    /* FNV-1a over the fields that vary most */
+    unsigned int h = 2166136261u;
+    const unsigned char *parts[2] = { key.client, key.server };
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 16; j++)
+            h = ( h ^ parts[i][j] ) * 16777619u;
+    h = ( h ^ key.port ) * 16777619u;
+    h = ( h ^ key.txid ) * 16777619u;
+    return h & ( buckets_.size() - 1 );
+}
+
+void TxnTable::unlink(unsigned int slot)
+{
+    int *pLink = &buckets_[bucket(ring_[slot].key)];
+    while ( *pLink != static_cast<int>(slot) )
+        pLink = &ring_[*pLink].next;
+    *pLink = ring_[slot].next;
+    ring_[slot].live = false;
+    live_--;
+}
+
+void TxnTable::popHead(AnswerBatch &expired)
+{
+    unsigned int slot = head_++ & ( ring_.size() - 1 );
+    Entry &entry = ring_[slot];
+    if ( !entry.live )
+        return;
+    unlink(slot);
+    DNSAnswer answer;
+    std::memset(&answer, 0, sizeof(answer));
+    answer.seq = entry.seq;
+    answer.count = entry.count;
+    answer.status = DNSAnswer::TIMEOUT;
+    expired.push_back(answer);
+}
+
+void TxnTable::add(const TxnKey &key, unsigned long long ts, unsigned long long seq, 
+        unsigned short count, AnswerBatch &expired)
+{
+    expire(ts, expired);
+    if ( tail_ - head_ == ring_.size() )
+        popHead(expired);
+    unsigned int slot = tail_++ & ( ring_.size() - 1 );
+    Entry &entry = ring_[slot];
+    entry.key = key;
+    entry.ts = ts;
+    entry.seq = seq;
+    entry.count = count;
+    entry.live = true;
+
+    /* Newest first, so a retransmission is matched before the original */
+    int &head = buckets_[bucket(key)];
+    entry.next = head;
+    head = slot;
+    live_++;
+}
+
+bool TxnTable::match(const TxnKey &key, unsigned long long ts, DNSAnswer &answer)
+{
+    for (int slot = buckets_[bucket(key)]; -1 != slot; slot = ring_[slot].next)
+    {
+        const Entry &entry = ring_[slot];
+        if ( entry.key == key )
+        {
+            answer.seq = entry.seq;
+            answer.count = entry.count;
+            answer.latencyUs = ts > entry.ts ? static_cast<unsigned int>(ts - entry.ts) : 0;
+            unlink(slot);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TxnTable::expire(unsigned long long now, AnswerBatch &expired)
+{
+    while ( head_ != tail_ )
+    {
+        const Entry &entry = ring_[head_ & ( ring_.size() - 1 )];
+        if ( entry.live && entry.ts + timeoutUs_ > now )
+            break;
+        popHead(expired);
+    }
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef __TXNTABLE_H
+#define __TXNTABLE_H
+
+#include <vector>
+
+#include "dnsquery.h"
+
+namespace DNSView
+{
+
+struct TxnKey
+{
+    unsigned char ver;
+    unsigned char client[16];
+    unsigned char server[16];
+    unsigned short port;        /* client port */
+    unsigned short txid;
+
+    bool operator==(const TxnKey &other) const;
+};
+
+/* Outstanding queries waiting for their response. Entries sit in a ring in
+ * capture order, so expiring the oldest is O(1), and a chained hash over the
+ * ring finds the query a response belongs to. Memory is fixed: when the ring
+ * is full the oldest query is reported as unanswered to make room. */
+class TxnTable
+{
+public:
+    explicit TxnTable(unsigned int capacity = 1 << 18);
+
+    void setTimeout(unsigned int timeoutMs);
+    void clear();
+    size_t pending() const;
+    /* No answer can refer to a seq below this, none if nothing is pending */
+    unsigned long long oldestSeq(unsigned long long none) const;
+
+    /* ts is in microseconds, anything pushed out is added to expired */
+    void add(const TxnKey &key, unsigned long long ts, unsigned long long seq, 
+            unsigned short count, AnswerBatch &expired);
+    /* Fills seq, count and latencyUs of answer and forgets the query */
+    bool match(const TxnKey &key, unsigned long long ts, DNSAnswer &answer);
+    void expire(unsigned long long now, AnswerBatch &expired);
+
+private:
+    struct Entry
+    {
+        TxnKey key;
+        unsigned long long ts;
+        unsigned long long seq;
+        unsigned short count;
+        bool live;
+        int next;
+    };
+
+    unsigned int bucket(const TxnKey &key) const;
+    void unlink(unsigned int slot);
+    void popHead(AnswerBatch &expired);
+
+    std::vector<Entry> ring_;
+    std::vector<int> buckets_;
+    unsigned long long head_, tail_;
+    unsigned long long timeoutUs_;
+    size_t live_;
+};
+
+}
+
+#endif